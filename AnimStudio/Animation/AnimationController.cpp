@@ -1,16 +1,11 @@
 ﻿#include "AnimationController.h"
 #include "BuiltInPalettes.h"
+#include "ConversionPipeline.h"
 #include "Palette.h"
 #include <QtConcurrent/QtConcurrent>
 #include <QFutureWatcher>
-#include "Formats/Import/RawImporter.h"
-#include "Formats/Import/AniImporter.h"
-#include "Formats/Import/EffImporter.h"
-#include "Formats/Import/ApngImporter.h"
-#include "Formats/Export/RawExporter.h"
-#include "Formats/Export/AniExporter.h"
-#include "Formats/Export/EffExporter.h"
-#include "Formats/Export/ApngExporter.h"
+#include <cmath>
+#include <memory>
 
 AnimationController::AnimationController(QObject* parent)
     : QObject(parent)
@@ -31,154 +26,77 @@ void AnimationController::loadApngFile(const QString& path) {
     beginLoad(AnimationType::Apng, path);
 }
 
-void AnimationController::exportAnimation(const QString& path, AnimationType type, ImageFormat fmt, CompressionFormat cFormat, QString name) {
+void AnimationController::exportAnimation(const QString& path, AnimationType type, ImageFormat fmt, CompressionFormat cFormat, QString name, ApngPreset apngPreset) {
     if (!m_loaded) return;
 
-    auto* watcher = new QFutureWatcher<ExportResult>(this);
-
-    QString n;
-
-    if (name.isEmpty()) {
-        n = m_data.baseName;
-    } else {
-        QFileInfo info(name);
-        n = info.completeBaseName(); // removes the extension, if any
-    }
-
-    QFuture<ExportResult> future = QtConcurrent::run([=]() -> ExportResult {
-        ExportResult result;
-
-        switch (type) {
-        case AnimationType::Ani: {
-            AniExporter exporter;
-            exporter.setProgressCallback([this](float p) {
-                QMetaObject::invokeMethod(this, "exportProgress", Qt::QueuedConnection, Q_ARG(float, p));
-                });
-
-            if (!m_data.quantized) {
-                qInfo() << "ANI export requires quantization. Running with defaults.";
-
-                QEventLoop loop;
-                QObject::connect(this, &AnimationController::quantizationFinished, &loop, &QEventLoop::quit);
-
-                this->quantize({}, 100, 256, true);
-                loop.exec(); // Block here until quantization completes
+    ExportOptions options;
+    options.type = type;
+    options.path = path;
+    options.imageFormat = fmt;
+    options.compression = cFormat;
+    options.apngPreset = apngPreset;
+    options.dds = m_ddsSettings;
+    options.tgaRle = m_tgaRle;
+    options.baseName = name;
+    startExport(options);
+}
 
-                if (!m_data.quantized) {
-                    result = ExportResult::fail("Automatic quantization failed.");
-                    break;
-                }
-            }
+void AnimationController::exportAllFrames(const QString& dir, ImageFormat fmt, CompressionFormat cFormat) {
+    if (!m_loaded) return;
 
-            result = exporter.exportAnimation(m_data, path, n);
-            break;
-        }
-        case AnimationType::Eff: {
-            EffExporter exporter;
-            exporter.setProgressCallback([this](float p) {
+    ExportOptions options;
+    options.type = AnimationType::Raw;
+    options.path = dir;
+    options.imageFormat = fmt;
+    options.compression = cFormat;
+    options.dds = m_ddsSettings;
+    options.tgaRle = m_tgaRle;
+    startExport(options);
+}
+
+void AnimationController::startExport(const ExportOptions& options) {
+    // The pipeline quantizes ANI and PCX exports with defaults if needed. It works on a copy,
+    // which shares the frame buffers, and its quantized set is taken over once it's done.
+    auto data = std::make_shared<AnimationData>(m_data);
+    const bool wasQuantized = m_data.quantized;
+    const quint64 generation = m_frameGeneration;
+
+    QFuture<ExportResult> future = QtConcurrent::run([this, data, options]() -> ExportResult {
+        ConversionToken token;
+        token.setProgressCallback([this](ConversionStage stage, float p) {
+            if (stage == ConversionStage::Quantize) {
+                QMetaObject::invokeMethod(this, "quantizationProgress", Qt::QueuedConnection, Q_ARG(int, int(p * 100.0f)));
+            } else {
                 QMetaObject::invokeMethod(this, "exportProgress", Qt::QueuedConnection, Q_ARG(float, p));
-                });
-
-            if (!m_data.quantized && fmt == ImageFormat::Pcx) {
-                qInfo() << "PCX export requires quantization. Running with defaults.";
-
-                QEventLoop loop;
-                QObject::connect(this, &AnimationController::quantizationFinished, &loop, &QEventLoop::quit);
-
-                this->quantize({}, 100, 256, true);
-                loop.exec(); // Block here until quantization completes
-
-                if (!m_data.quantized) {
-                    result = ExportResult::fail("Automatic quantization failed.");
-                    break;
-                }
-            }
-            if (fmt == ImageFormat::Dds) {
-                auto width = m_data.originalSize.width();
-                auto height = m_data.originalSize.height();
-                if (width % 4 != 0 || height % 4 != 0) {
-                    result = ExportResult::fail("DDS format requires dimensions to be multiples of 4.");
-                    break;
-                }
             }
-            result = exporter.exportAnimation(m_data, path, fmt, cFormat, n);
-            break;
-        }
-        case AnimationType::Apng: {
-            ApngExporter exporter;
-            exporter.setProgressCallback([this](float p) {
-                QMetaObject::invokeMethod(this, "exportProgress", Qt::QueuedConnection, Q_ARG(float, p));
-                });
-            result = exporter.exportAnimation(m_data, path, n);
-            break;
-        }
-        default:
-            result = ExportResult::fail("Invalid export type.");
-            break;
-        }
-
-        return result;
         });
+        return ConversionPipeline(&token).exportAnimation(*data, options);
+    });
 
+    auto* watcher = new QFutureWatcher<ExportResult>(this);
     connect(watcher, &QFutureWatcher<ExportResult>::finished, this, [=]() {
         ExportResult result = watcher->result();
-        if (!result.success) {
-            emit errorOccurred("Export Failed", result.errorMessage.isEmpty()
-                ? "An unknown error occurred while exporting."
-                : result.errorMessage);
-        }
-        emit exportFinished(result.success, type, fmt, m_data.frameCount);
         watcher->deleteLater();
-        });
-
-    watcher->setFuture(future);
-}
-
-void AnimationController::exportAllFrames(const QString& dir, ImageFormat fmt, CompressionFormat cFormat) {
-    if (!m_loaded) return;
-
-    if (fmt == ImageFormat::Pcx && !m_data.quantized) {
-        qInfo() << "PCX export requires quantization. Running with defaults.";
 
-        QEventLoop loop;
-        QObject::connect(this, &AnimationController::quantizationFinished, &loop, &QEventLoop::quit);
-
-        this->quantize({}, 100, 256, true);
-        loop.exec(); // Block here until quantization completes
-
-        if (!m_data.quantized) {
-            qWarning() << "Automatic quantization failed, cannot export PCX frames.";
-        }
-    }
-    if (fmt == ImageFormat::Dds) {
-        auto width = m_data.originalSize.width();
-        auto height = m_data.originalSize.height();
-        if (width % 4 != 0 || height % 4 != 0) {
-            emit errorOccurred("Export Failed", "DDS format requires dimensions to be multiples of 4.");
-            return;
+        if (!wasQuantized && data->quantized && !m_data.quantized && generation == m_frameGeneration) {
+            m_data.quantizedFrames = data->quantizedFrames;
+            m_data.quantizedPalette = data->quantizedPalette;
+            m_data.quantized = true;
+            m_showQuantized = true;
+            emit metadataChanged(m_data);
+            emit quantizationFinished(true);
         }
-    }
-    auto* watcher = new QFutureWatcher<ExportResult>(this);
-
-    QFuture<ExportResult> future = QtConcurrent::run([=]() -> ExportResult {
-        RawExporter exporter;
-        exporter.setProgressCallback([this](float p) {
-            QMetaObject::invokeMethod(this, "exportProgress", Qt::QueuedConnection, Q_ARG(float, p));
-        });
 
-        return exporter.exportAllFrames(m_data, dir, fmt, cFormat);
-     });
-
-    connect(watcher, &QFutureWatcher<ExportResult>::finished, this, [=]() {
-        ExportResult result = watcher->result();
         if (!result.success) {
-            QString msg = result.errorMessage.isEmpty()
-                ? QString("Could not write frames to \"%1\"").arg(dir)
-                : result.errorMessage;
+            QString msg = result.errorMessage;
+            if (msg.isEmpty()) {
+                msg = options.type == AnimationType::Raw
+                    ? QString("Could not write frames to \"%1\"").arg(options.path)
+                    : QString("An unknown error occurred while exporting.");
+            }
             emit errorOccurred("Export Failed", msg);
         }
-        emit exportFinished(result.success, AnimationType::Raw, fmt, m_data.frameCount);
-        watcher->deleteLater();
+        emit exportFinished(result.success, options.type, options.imageFormat, m_data.frameCount);
     });
 
     watcher->setFuture(future);
@@ -189,26 +107,23 @@ void AnimationController::exportCurrentFrame(const QString& path, ImageFormat fm
 
     const int index = m_currentIndex;
 
-    if (fmt == ImageFormat::Dds) {
-        auto width = m_data.originalSize.width();
-        auto height = m_data.originalSize.height();
-        if (width % 4 != 0 || height % 4 != 0) {
-            emit errorOccurred("Export Failed", "DDS format requires dimensions to be multiples of 4.");
-            return;
-        }
-    }
-
-    auto* watcher = new QFutureWatcher<ExportResult>(this);
-
-    QFuture<ExportResult> future = QtConcurrent::run([=]() -> ExportResult {
-        RawExporter exporter;
-        exporter.setProgressCallback([this](float p) {
+    ExportOptions options;
+    options.type = AnimationType::Raw;
+    options.imageFormat = fmt;
+    options.compression = cFormat;
+    options.dds = m_ddsSettings;
+    options.tgaRle = m_tgaRle;
+
+    const AnimationData data = m_data;
+    QFuture<ExportResult> future = QtConcurrent::run([this, data, index, path, options]() -> ExportResult {
+        ConversionToken token;
+        token.setProgressCallback([this](ConversionStage, float p) {
             QMetaObject::invokeMethod(this, "exportProgress", Qt::QueuedConnection, Q_ARG(float, p));
-            });
-
-        return exporter.exportCurrentFrame(m_data, index, path, fmt, cFormat, true);
+        });
+        return ConversionPipeline(&token).exportFrame(data, index, path, options);
     });
 
+    auto* watcher = new QFutureWatcher<ExportResult>(this);
     connect(watcher, &QFutureWatcher<ExportResult>::finished, this, [=]() {
         ExportResult result = watcher->result();
         if (!result.success) {
@@ -228,115 +143,48 @@ void AnimationController::beginLoad(AnimationType type, const QString& path) {
     // stop current playback
     pause();
     m_currentIndex = 0;
-    QFuture<std::optional<AnimationData>> future;
-    switch (type) {
-        case AnimationType::Raw: {
-            future = QtConcurrent::run([=]() -> std::optional<AnimationData> {
-                RawImporter importer;
-                importer.setProgressCallback([this](float p) {
-                    QMetaObject::invokeMethod(
-                        this, "importProgress",
-                        Qt::QueuedConnection,
-                        Q_ARG(float, p)
-                    );
-                    });
-                AnimationData d = importer.importBlocking(path);
-                return d.frameCount > 0 ? std::make_optional(d) : std::nullopt;
-                });
-            break;
-        }
-        case AnimationType::Ani: {
-            future = QtConcurrent::run([=]() -> std::optional<AnimationData> {
-                AniImporter importer;
-                importer.setProgressCallback([this](float p) {
-                    QMetaObject::invokeMethod(
-                        this, "importProgress",
-                        Qt::QueuedConnection,
-                        Q_ARG(float, p)
-                    );
-                    });
-                return importer.importFromFile(path);
-                });
-            break;
-        }
-        case AnimationType::Eff: {
-            future = QtConcurrent::run([=]() -> std::optional<AnimationData> {
-                EffImporter importer;
-                importer.setProgressCallback([this](float p) {
-                    QMetaObject::invokeMethod(
-                        this, "importProgress",
-                        Qt::QueuedConnection,
-                        Q_ARG(float, p)
-                    );
-                    });
-                return importer.importFromFile(path);
-                });
-            break;
-        }
-        case AnimationType::Apng: {
-            future = QtConcurrent::run([=]() -> std::optional<AnimationData> {
-                ApngImporter importer;
-                importer.setProgressCallback([this](float p) {
-                    QMetaObject::invokeMethod(
-                        this, "importProgress",
-                        Qt::QueuedConnection,
-                        Q_ARG(float, p)
-                    );
-                    });
-                return importer.importFromFile(path);
-                });
-            break;
-        }
-        default:
-            return emit errorOccurred("Import Failed", "Unknown animation type.");
-    }
+    const bool keepCompressed = m_keepCompressed;
+
+    // Loads and settles the data (finishImport) on the loader thread
+    QFuture<std::optional<AnimationData>> future = QtConcurrent::run([=]() -> std::optional<AnimationData> {
+        ConversionToken token;
+        token.setProgressCallback([this](ConversionStage, float p) {
+            QMetaObject::invokeMethod(
+                this, "importProgress",
+                Qt::QueuedConnection,
+                Q_ARG(float, p)
+            );
+            });
+        QString error;
+        return ConversionPipeline(&token).load(type, path, keepCompressed, &error);
+        });
 
     auto* watcher = new QFutureWatcher<std::optional<AnimationData>>(this);
     connect(watcher, &QFutureWatcher<std::optional<AnimationData>>::finished, this, [=]() {
         auto result = watcher->result();
         watcher->deleteLater();
-        finishLoad(result, result.has_value() ? QString() : "Failed to load animation");
+        const bool ok = result.has_value();
+        finishLoad(std::move(result), ok ? QString() : "Failed to load animation");
         });
     watcher->setFuture(future);
 }
 
-void AnimationController::finishLoad(const std::optional<AnimationData>& data, const QString& error) {
+void AnimationController::finishLoad(std::optional<AnimationData> data, const QString& error) {
     if (!data) {
         emit importFinished(false, AnimationType::Ani, ImageFormat::Png, 0);
         emit errorOccurred("Import Failed", error);
         return;
     }
-    m_data = *data;
-    m_data.originalSize = m_data.frames.isEmpty() ? QSize() : m_data.frames[0].image.size();
-    if (!m_data.keyframeIndices.empty()) {
-        m_data.loopPoint = m_data.keyframeIndices[0];
-    }
-
-    if (m_data.animationType == AnimationType::Ani) {
-        m_data.quantized = true;
-        m_data.quantizedFrames = m_data.frames;
-        // ANI loop keyframe is the LAST frame of the non loop vs the first frame of the loop. Wierd, but that’s how it is.
-        // Unless it's frame 0...
-        if (m_data.loopPoint > 0) {
-            m_data.loopPoint = std::min(m_data.loopPoint + 1, m_data.frameCount - 1);
-        }
-    }
-
-    // Convert original frames to ARGB32 so they're not left as Indexed8
-    for (AnimationFrame& f : m_data.frames) {
-        if (f.image.format() != QImage::Format_ARGB32) {
-            f.image = f.image.convertToFormat(QImage::Format_ARGB32);
-        }
-    }
-
-    m_data.totalLength = float(m_data.frameCount - 1) / m_data.fps;
+    // Frames were settled on the loader thread, so this just takes over the shared buffers
+    m_data = std::move(*data);
+    newFrameGeneration();
     m_loaded = true;
     emit importFinished(true, m_data.animationType, m_data.type.has_value() ? m_data.type.value() : ImageFormat::Png, m_data.frameCount);
     emit animationLoaded();
     emit metadataChanged(m_data);
     // immediately show first frame
     if (!m_data.frames.isEmpty()) {
-        emit frameReady(m_data.frames[0].image, 0);
+        emit frameReady(m_data.frames[0].image.decoded(), 0);
         play();
     }
 }
@@ -384,11 +232,19 @@ void AnimationController::advanceFrame() {
 
     m_currentIndex = next;
     const AnimationFrame& f = frames[m_currentIndex];
-    emit frameReady(f.image, m_currentIndex);
+    emit frameReady(f.image.decoded(), m_currentIndex);
+
+    // Frames with their own duration hold the timer for that long
+    if (hasVariableTiming(m_data))
+        m_timer.setInterval(frameInterval(m_currentIndex));
+}
+
+int AnimationController::frameInterval(int index) const {
+    return std::max(1, int(std::lround(frameDuration(m_data, index) * 1000.0)));
 }
 
 void AnimationController::play() {
-    m_timer.start(1000 / m_data.fps);
+    m_timer.start(frameInterval(m_currentIndex));
     emit playStateChanged(true);
 }
 void AnimationController::pause() {
@@ -397,11 +253,16 @@ void AnimationController::pause() {
 }
 void AnimationController::setFps(int fps) {
     if (fps > 0) {
+        // Picking a new rate replaces any per-frame durations. Re-applying the current value
+        // (e.g. the spin box syncing to metadata) leaves them alone.
+        if (fps != m_data.fps)
+            clearFrameTimings(m_data);
+
         m_data.fps = fps;
         if (m_timer.isActive())
-            m_timer.start(1000 / fps);
+            m_timer.start(frameInterval(m_currentIndex));
 
-        m_data.totalLength = float(m_data.frameCount - 1) / m_data.fps;
+        m_data.totalLength = float(frameStartTime(m_data, m_data.frameCount - 1));
         emit metadataChanged(m_data);
     }
 }
@@ -412,7 +273,7 @@ void AnimationController::seekFrame(int idx) {
 
     m_currentIndex = idx;
     const AnimationFrame& f = frames[m_currentIndex];
-    emit frameReady(f.image, m_currentIndex);
+    emit frameReady(f.image.decoded(), m_currentIndex);
 }
 
 bool AnimationController::isPlaying() const {
@@ -451,54 +312,37 @@ bool AnimationController::getAllKeyframesActive() const {
 }
 
 void AnimationController::quantize(const QVector<QRgb>& palette, const int quality, const int maxColors, const bool enforceTransparency) {
-    // reset any previous quantized data
-    m_data.quantizedFrames = m_data.frames;
+    // reset any previous quantized data. Playback falls back to the source frames meanwhile.
+    m_data.quantizedFrames.clear();
     m_data.quantized = false;
 
-    QVector<QRgb> l_palette;
-    if (!palette.empty()) {
-        l_palette = palette;
-        Palette::padTo256(l_palette);
-
-        if (enforceTransparency) {
-            Palette::setupAniTransparency(l_palette);
-        }
-    }
+    QuantizeOptions options;
+    options.palette = palette;
+    options.quality = quality;
+    options.maxColors = maxColors;
+    options.enforceTransparency = enforceTransparency;
+    options.sourceGeneration = m_frameGeneration; // Same frames as last time reuse the histogram
 
-    // make a **local copy** of the frames so clear() can't stomp them
+    // make a **local copy** of the frames so clear() can't stomp them. This shares the pixel buffers.
     QVector<AnimationFrame> framesCopy = m_data.frames;
 
     // 1) Launch async quantization with progress callback
-    auto future = QtConcurrent::run([this, framesCopy, l_palette, quality, maxColors, enforceTransparency]() -> std::optional<QuantResult> {
-        m_quantizer.reset();
-
-        // Build and configure our Quantizer
-        if (!l_palette.isEmpty()) {
-            m_quantizer.setCustomPalette(l_palette);
-        }
-        if (quality >= 0 && quality <= 100) {
-            m_quantizer.setQualityRange(0, quality);
-        }
-        if (maxColors > 0 && maxColors <= 256) {
-            m_quantizer.setMaxColors(maxColors);
-        }
+    auto future = QtConcurrent::run([this, framesCopy, options]() -> std::optional<QuantResult> {
+        ConversionToken token;
+        token.setProgressCallback([this](ConversionStage, float fraction) {
+            // marshal back to GUI thread
+            QMetaObject::invokeMethod(
+                this,
+                "quantizationProgress",
+                Qt::QueuedConnection,
+                Q_ARG(int, int(fraction * 100.0f))
+            );
+            });
 
-        m_quantizer.setEnforcedTransparency(enforceTransparency);
-
-        // Run the quantization
-        return m_quantizer.quantize(
-            framesCopy,
-            [this](float fraction) {
-                // marshal back to GUI thread
-                QMetaObject::invokeMethod(
-                    this,
-                    "quantizationProgress",
-                    Qt::QueuedConnection,
-                    Q_ARG(int, int(fraction))
-                );
-                return true; // return false to abort early
-            }
-        );
+        ConversionPipeline pipeline(&token);
+        pipeline.setQuantizer(&m_quantizer); // cancelQuantization() goes straight to it
+        QString error;
+        return pipeline.quantizeFrames(framesCopy, options, &error);
     });
 
     // 2) Watch for completion
@@ -547,7 +391,7 @@ void AnimationController::toggleShowQuantized(bool show) {
     const auto& frames = getCurrentFrames();
     if (!frames.isEmpty() && m_currentIndex >= 0 && m_currentIndex < frames.size()) {
         const AnimationFrame& f = frames[m_currentIndex];
-        emit frameReady(f.image, m_currentIndex);
+        emit frameReady(f.image.decoded(), m_currentIndex);
     }
 }
 
@@ -555,6 +399,15 @@ bool AnimationController::isShowingQuantized() const {
     return m_showQuantized;
 }
 
+void AnimationController::newFrameGeneration() {
+    ++m_frameGeneration;
+
+    // The old histogram can never be reused now. If a run is still using it, it gets replaced next time.
+    if (!m_quantizer.isRunning()) {
+        m_quantizer.releaseHistogram();
+    }
+}
+
 bool AnimationController::isQuantizeRunning() const {
     return m_quantizer.isRunning();
 }
@@ -588,6 +441,10 @@ int AnimationController::getFPS() const {
     return m_data.fps;
 }
 
+double AnimationController::getFrameTime(int index) const {
+    return frameStartTime(m_data, index);
+}
+
 AnimationType AnimationController::getType() const {
     return m_data.animationType;
 }
@@ -600,5 +457,6 @@ void AnimationController::clear() {
     pause();
     m_loaded = false;
     m_data = AnimationData{};
+    newFrameGeneration();
     emit metadataChanged(m_data);
 }
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include <QSize>
 
 #include "AnimationData.h"
+#include "ConversionPipeline.h"
 #include "Quantizer.h"
 #include "Formats/ImageFormats.h"
 
@@ -23,13 +24,20 @@ public:
     void loadApngFile(const QString& path);
 
     // exporting
-    void exportAnimation(const QString& path, AnimationType type, ImageFormat fmt, CompressionFormat cFormat, QString name);
+    void exportAnimation(const QString& path, AnimationType type, ImageFormat fmt, CompressionFormat cFormat, QString name, ApngPreset apngPreset = ApngPreset::Balanced);
     void exportAllFrames(const QString& dir, ImageFormat fmt, CompressionFormat cFormat);
     void exportCurrentFrame(const QString& path, ImageFormat fmt, CompressionFormat cFormat);
+    void setDdsSettings(const DdsSettings& settings) { m_ddsSettings = settings; }
+    void setTgaRle(bool rle) { m_tgaRle = rle; }
 
     // status
     bool isLoaded() const { return m_loaded; }
 
+    // Keep BC1/BC3/BC7 DDS frames compressed in memory and decode them when shown or
+    // exported. Applies to the next load.
+    void setKeepFramesCompressed(bool keep) { m_keepCompressed = keep; }
+    bool keepFramesCompressed() const { return m_keepCompressed; }
+
     // playback control
     void play();
     void pause();
@@ -58,6 +66,7 @@ public:
     QSize getResolution() const;
     int getFrameCount() const;
     int getFPS() const;
+    double getFrameTime(int index) const; // seconds from the start to this frame
     AnimationType getType() const;
 
     // clean up
@@ -93,9 +102,12 @@ private slots:
 
 private:
     void beginLoad(AnimationType type, const QString& path);
-    void finishLoad(const std::optional<AnimationData>& data, const QString& error);
+    void startExport(const ExportOptions& options);
+    void finishLoad(std::optional<AnimationData> data, const QString& error);
 
     const QVector<AnimationFrame>& getCurrentFrames() const;
+    int frameInterval(int index) const; // timer interval in ms for a frame
+    void newFrameGeneration();          // call after replacing m_data.frames
 
     AnimationData         m_data;
     QTimer                m_timer;
@@ -103,6 +115,10 @@ private:
     bool                  m_showQuantized = false;
     bool                  m_loaded = false;
     bool                  m_forward = true;
+    bool                  m_keepCompressed = false;
 
     Quantizer             m_quantizer;
+    DdsSettings           m_ddsSettings;           // Quality, mips and backend for DDS exports
+    bool                  m_tgaRle = false;        // Run-length encode TGA exports
+    quint64               m_frameGeneration = 0; // Bumped whenever the source frames are replaced
 };
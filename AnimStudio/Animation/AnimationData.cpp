@@ -1,4 +1,10 @@
 #include "AnimationData.h"
+#include "StagePool.h"
+#include <QJsonArray>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
 
 QVector<AnimationTypeData> AnimationTypes = {
         { AnimationType::Ani,  true,  "Ani"  },
@@ -22,4 +28,209 @@ QVector<AnimationType> getExportableTypes() {
             types.append(t.type);
     }
     return types;
-}
\ No newline at end of file
+}
+
+// Tick rate expanded animations are clamped to when the exact LCM of all frame rates gets silly
+#define MAX_EXPANDED_FPS 1000
+
+bool hasVariableTiming(const AnimationData& data) {
+    for (const auto& f : data.frames) {
+        if (f.delayDen > 0)
+            return true;
+    }
+    return false;
+}
+
+double frameDuration(const AnimationData& data, int index) {
+    if (index >= 0 && index < data.frames.size()) {
+        const AnimationFrame& f = data.frames[index];
+        if (f.delayDen > 0)
+            return double(f.delayNum) / double(f.delayDen);
+    }
+    return data.fps > 0 ? 1.0 / data.fps : 0.0;
+}
+
+double frameStartTime(const AnimationData& data, int index) {
+    if (!hasVariableTiming(data))
+        return data.fps > 0 ? double(index) / data.fps : 0.0;
+
+    double t = 0.0;
+    for (int i = 0; i < index && i < data.frames.size(); ++i) {
+        t += frameDuration(data, i);
+    }
+    return t;
+}
+
+void clearFrameTimings(AnimationData& data) {
+    for (auto& f : data.frames) {
+        f.delayNum = 0;
+        f.delayDen = 0;
+    }
+    for (auto& f : data.quantizedFrames) {
+        f.delayNum = 0;
+        f.delayDen = 0;
+    }
+}
+
+AnimationData expandToFixedRate(const AnimationData& data) {
+    if (!hasVariableTiming(data))
+        return data;
+
+    // Reduce each duration and find the tick rate that represents all of them exactly
+    QVector<qint64> nums(data.frames.size());
+    QVector<qint64> dens(data.frames.size());
+    qint64 rate = 1;
+    for (int i = 0; i < data.frames.size(); ++i) {
+        const AnimationFrame& f = data.frames[i];
+        qint64 num = f.delayDen > 0 ? std::max(f.delayNum, 1) : 1;
+        qint64 den = f.delayDen > 0 ? f.delayDen : std::max(data.fps, 1);
+        qint64 g = std::gcd(num, den);
+        nums[i] = num / g;
+        dens[i] = den / g;
+        if (rate <= MAX_EXPANDED_FPS)
+            rate = std::lcm(rate, dens[i]);
+    }
+
+    const bool exact = rate <= MAX_EXPANDED_FPS;
+    if (!exact)
+        rate = MAX_EXPANDED_FPS;
+
+    AnimationData out = data;
+    out.fps = int(rate);
+    out.frames.clear();
+    out.quantizedFrames.clear();
+    out.keyframeIndices.clear();
+
+    const bool hasQuantized = data.quantizedFrames.size() == data.frames.size();
+    QVector<int> startTicks;
+    startTicks.reserve(data.frames.size());
+
+    for (int i = 0; i < data.frames.size(); ++i) {
+        int ticks = exact
+            ? int(nums[i] * (rate / dens[i]))
+            : std::max(1, int(std::lround(double(nums[i]) * rate / dens[i])));
+
+        startTicks.append(out.frames.size());
+        for (int t = 0; t < ticks; ++t) {
+            AnimationFrame af = data.frames[i];
+            af.index = out.frames.size();
+            af.delayNum = 0;
+            af.delayDen = 0;
+            out.frames.append(af);
+
+            if (hasQuantized) {
+                AnimationFrame qf = data.quantizedFrames[i];
+                qf.index = af.index;
+                qf.delayNum = 0;
+                qf.delayDen = 0;
+                out.quantizedFrames.append(qf);
+            }
+        }
+    }
+
+    for (int k : data.keyframeIndices) {
+        if (k >= 0 && k < startTicks.size())
+            out.keyframeIndices.append(startTicks[k]);
+    }
+    if (data.loopPoint >= 0 && data.loopPoint < startTicks.size())
+        out.loopPoint = startTicks[data.loopPoint];
+
+    out.frameCount = out.frames.size();
+    out.totalLength = float(out.frameCount - 1) / out.fps;
+    return out;
+}
+
+bool hasCompressedFrames(const AnimationData& data) {
+    for (const auto& f : data.frames) {
+        if (f.image.isCompressed())
+            return true;
+    }
+    return false;
+}
+
+QVector<AnimationFrame> decodeFrames(const QVector<AnimationFrame>& frames, int workers, QThreadPool* pool) {
+    QVector<AnimationFrame> out = frames;
+
+    QVector<int> indices;
+    for (int i = 0; i < frames.size(); ++i) {
+        if (frames[i].image.isCompressed())
+            indices.append(i);
+    }
+    if (indices.isEmpty())
+        return out;
+
+    StagePool stagePool(pool, workers > 0 ? workers : std::max(1, QThread::idealThreadCount()));
+
+    // Detach once up front, the workers each write their own element
+    AnimationFrame* dst = out.data();
+    QtConcurrent::blockingMap(stagePool.get(), indices, [&](int i) {
+        dst[i].image = frames[i].image.decoded();
+    });
+    return out;
+}
+
+AnimationData withDecodedFrames(const AnimationData& data, int workers, QThreadPool* pool) {
+    if (!hasCompressedFrames(data))
+        return data;
+
+    AnimationData out = data;
+    out.frames = decodeFrames(data.frames, workers, pool);
+    return out;
+}
+
+void finishImport(AnimationData& data) {
+    if (data.animationType == AnimationType::Ani) {
+        // ANI frames are already indexed; keep them as the quantized set before converting
+        data.quantized = true;
+        data.quantizedFrames = data.frames;
+    }
+
+    // Compressed frames report FRAME_STORAGE_FORMAT and are left as they are
+    for (AnimationFrame& f : data.frames) {
+        if (f.image.format() != FRAME_STORAGE_FORMAT) {
+            f.image = f.image.view(FRAME_STORAGE_FORMAT);
+        }
+    }
+
+    data.originalSize = data.frames.isEmpty() ? QSize() : data.frames[0].image.size();
+    if (!data.keyframeIndices.empty()) {
+        data.loopPoint = data.keyframeIndices[0];
+    }
+
+    if (data.animationType == AnimationType::Ani) {
+        // ANI loop keyframe is the LAST frame of the non loop vs the first frame of the loop. Wierd, but that's how it is.
+        // Unless it's frame 0...
+        if (data.loopPoint > 0) {
+            data.loopPoint = std::min(data.loopPoint + 1, data.frameCount - 1);
+        }
+    }
+
+    data.totalLength = float(frameStartTime(data, data.frameCount - 1));
+}
+
+QJsonObject toJson(const AnimationInfo& info) {
+    QJsonObject obj;
+    obj["animationType"] = getTypeString(info.animationType);
+    obj["baseName"] = info.baseName;
+    if (info.type) {
+        obj["imageFormat"] = extensionForFormat(*info.type).mid(1);
+    }
+    obj["width"] = info.size.width();
+    obj["height"] = info.size.height();
+    obj["frameCount"] = info.frameCount;
+    obj["fps"] = info.fps;
+    obj["variableTiming"] = info.variableTiming;
+
+    QJsonArray keyframes;
+    for (int k : info.keyframeIndices) {
+        keyframes.append(k);
+    }
+    obj["keyframes"] = keyframes;
+
+    if (info.loopPoint >= 0) {
+        obj["loopPoint"] = info.loopPoint;
+    }
+    obj["pixelFormat"] = info.pixelFormat;
+    obj["warnings"] = QJsonArray::fromStringList(info.warnings);
+    return obj;
+}
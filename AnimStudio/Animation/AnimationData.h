@@ -2,6 +2,7 @@
 #pragma once
 
 #include "Formats/ImageFormats.h"
+#include "FrameBuffer.h"
 
 #include <QString>
 #include <QStringList>
@@ -9,9 +10,12 @@
 #include <QVector>
 #include <QSize>
 #include <QRgb>
+#include <QJsonObject>
 
 #include <optional>
 
+class QThreadPool;
+
 #define TRANSPARENT_COLOR_INDEX     255     // As per ani documentation, 255 is transparent pixel
 
 enum class AnimationType {
@@ -29,10 +33,18 @@ struct AnimationTypeData {
 
 extern QVector<AnimationTypeData> animationTypes;
 
+// Pixel format frames are kept in once loaded. Everything downstream (quantizer, APNG, DDS and
+// TGA writers) wants RGBA8888, so storing it once lets them all share the same buffer.
+#define FRAME_STORAGE_FORMAT        QImage::Format_RGBA8888
+
 struct AnimationFrame {
-    QImage image;
+    FrameBuffer image;
     int index;
     QString filename;
+    // How long this frame is shown, in seconds (delayNum / delayDen).
+    // A delayDen of 0 means the frame uses the animation's fps.
+    int delayNum = 0;
+    int delayDen = 0;
 };
 
 struct AnimationData {
@@ -55,10 +67,59 @@ struct AnimationData {
     QStringList importWarnings;
 };
 
+// What an importer's probe() reads from headers alone, without decoding any frame
+struct AnimationInfo {
+    QString baseName;
+    std::optional<ImageFormat> type;    // Frame file format for EFF and sequences
+    AnimationType animationType = AnimationType::Raw;
+    QSize size;
+    int frameCount = 0;
+    int fps = 15;
+    bool variableTiming = false;        // Frames carry their own durations (APNG)
+    QVector<int> keyframeIndices;
+    int loopPoint = -1;                 // -1 if the animation has none
+    QString pixelFormat;                // As stored in the file: "indexed8", "rgba8", "bc7"...
+    QStringList warnings;
+};
+
+QJsonObject toJson(const AnimationInfo& info);
+
 QString getTypeString(AnimationType type);
 
 QVector<AnimationType> getExportableTypes();
 
+// True if any frame carries its own duration instead of using data.fps
+bool hasVariableTiming(const AnimationData& data);
+
+// Display duration of a frame in seconds
+double frameDuration(const AnimationData& data, int index);
+
+// Time in seconds at which a frame starts
+double frameStartTime(const AnimationData& data, int index);
+
+// Drop per-frame durations so every frame plays at data.fps
+void clearFrameTimings(AnimationData& data);
+
+// Expand variable frame durations into a fixed tick rate for formats that only store an fps
+// (ANI, EFF). Frames shown for several ticks share their image data. Loop point and keyframes
+// are moved to the tick where their frame starts.
+AnimationData expandToFixedRate(const AnimationData& data);
+
+// True if any source frame is still block-compressed (FrameBuffer::isCompressed)
+bool hasCompressedFrames(const AnimationData& data);
+
+// Copies of the frames with every compressed frame decoded, in parallel on workers threads
+// (0 for one per core), or on pool if given (see StagePool). Others are shared.
+QVector<AnimationFrame> decodeFrames(const QVector<AnimationFrame>& frames, int workers = 0, QThreadPool* pool = nullptr);
+
+// The animation with decodeFrames() applied, for the quantizer and the exporters
+AnimationData withDecodedFrames(const AnimationData& data, int workers = 0, QThreadPool* pool = nullptr);
+
+// Settle freshly imported data: frames into FRAME_STORAGE_FORMAT once so the quantizer and
+// exporters share the buffers, ANI frames kept as the quantized set, then the size, loop point
+// and length filled in. Every load path (controller, batch runner) calls this on its worker.
+void finishImport(AnimationData& data);
+
 struct ExportResult {
     bool success = false;
     QString errorMessage;
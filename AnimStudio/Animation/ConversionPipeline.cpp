@@ -0,0 +1,273 @@
+#include "ConversionPipeline.h"
+#include "Palette.h"
+#include "Formats/Export/AniExporter.h"
+#include "Formats/Export/ApngExporter.h"
+#include "Formats/Export/EffExporter.h"
+#include "Formats/Export/RawExporter.h"
+#include "Formats/Import/AniImporter.h"
+#include "Formats/Import/ApngImporter.h"
+#include "Formats/Import/EffImporter.h"
+#include "Formats/Import/RawImporter.h"
+
+#include <QDebug>
+#include <QFileInfo>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+ConversionPipeline::ConversionPipeline(ConversionToken* token)
+    : m_token(token)
+{
+}
+
+ConversionPipeline::~ConversionPipeline() = default;
+
+std::function<void(float)> ConversionPipeline::progressFor(ConversionStage stage) const {
+    if (!m_token) {
+        return nullptr;
+    }
+    ConversionToken* token = m_token;
+    return [token, stage](float p) { token->reportProgress(stage, p); };
+}
+
+std::optional<AnimationData> ConversionPipeline::load(AnimationType type, const QString& path, bool keepCompressed, QString* error) {
+    std::optional<AnimationData> data;
+    switch (type) {
+    case AnimationType::Raw: {
+        RawImporter importer;
+        importer.setKeepCompressed(keepCompressed);
+        importer.setWorkerCount(m_workerCount);
+        importer.setThreadPool(m_threadPool);
+        importer.setProgressCallback(progressFor(ConversionStage::Import));
+        AnimationData d = importer.importBlocking(path);
+        if (d.frameCount > 0) {
+            data = std::move(d);
+        }
+        break;
+    }
+    case AnimationType::Ani: {
+        AniImporter importer;
+        importer.setWorkerCount(m_workerCount);
+        importer.setThreadPool(m_threadPool);
+        importer.setProgressCallback(progressFor(ConversionStage::Import));
+        data = importer.importFromFile(path);
+        break;
+    }
+    case AnimationType::Eff: {
+        EffImporter importer;
+        importer.setKeepCompressed(keepCompressed);
+        importer.setWorkerCount(m_workerCount);
+        importer.setThreadPool(m_threadPool);
+        importer.setProgressCallback(progressFor(ConversionStage::Import));
+        data = importer.importFromFile(path);
+        break;
+    }
+    case AnimationType::Apng: {
+        ApngImporter importer;
+        importer.setProgressCallback(progressFor(ConversionStage::Import));
+        data = importer.importFromFile(path);
+        break;
+    }
+    }
+
+    if (!data) {
+        *error = "Failed to load animation";
+        return std::nullopt;
+    }
+    if (cancelled()) {
+        *error = "Cancelled";
+        return std::nullopt;
+    }
+
+    finishImport(*data);
+    return data;
+}
+
+std::optional<QuantResult> ConversionPipeline::quantizeFrames(const QVector<AnimationFrame>& frames, const QuantizeOptions& options, QString* error) {
+    if (cancelled()) {
+        *error = "Cancelled";
+        return std::nullopt;
+    }
+
+    QVector<QRgb> l_palette;
+    if (!options.palette.empty()) {
+        l_palette = options.palette;
+        Palette::padTo256(l_palette);
+
+        if (options.enforceTransparency) {
+            Palette::setupAniTransparency(l_palette);
+        }
+    }
+
+    if (!m_quantizer) {
+        m_ownQuantizer = std::make_unique<Quantizer>();
+        m_quantizer = m_ownQuantizer.get();
+    }
+    Quantizer* quantizer = m_quantizer;
+
+    quantizer->reset();
+    quantizer->setSourceGeneration(options.sourceGeneration); // Same frames as last time reuse the histogram
+    if (!l_palette.isEmpty()) {
+        quantizer->setCustomPalette(l_palette);
+    }
+    if (options.quality >= 0 && options.quality <= 100) {
+        quantizer->setQualityRange(0, options.quality);
+    }
+    if (options.maxColors > 0 && options.maxColors <= 256) {
+        quantizer->setMaxColors(options.maxColors);
+    }
+    quantizer->setEnforcedTransparency(options.enforceTransparency);
+    quantizer->setWorkerCount(m_workerCount);
+    quantizer->setThreadPool(m_threadPool);
+
+    ConversionToken* token = m_token;
+    std::optional<QuantResult> result = quantizer->quantize(
+        decodeFrames(frames, m_workerCount, m_threadPool),
+        [token, quantizer](float percent) {
+            if (token) {
+                token->reportProgress(ConversionStage::Quantize, percent / 100.0f);
+                if (token->isCancelled()) {
+                    quantizer->cancel();
+                }
+            }
+            return true;
+        }
+    );
+
+    if (!result) {
+        *error = quantizer->isCancelRequested()
+            ? QString("Cancelled")
+            : QString("Color reduction task failed to complete successfully.");
+    }
+    return result;
+}
+
+bool ConversionPipeline::quantize(AnimationData& data, const QuantizeOptions& options, QString* error) {
+    data.quantizedFrames.clear();
+    data.quantized = false;
+
+    std::optional<QuantResult> result = quantizeFrames(data.frames, options, error);
+    if (!result) {
+        return false;
+    }
+
+    data.quantizedFrames = std::move(result->frames);
+    data.quantizedPalette = std::move(result->palette);
+    Palette::padTo256(data.quantizedPalette);
+    data.quantized = true;
+    return true;
+}
+
+ExportResult ConversionPipeline::exportAnimation(AnimationData& data, const ExportOptions& options) {
+    const bool frameSequence = options.type == AnimationType::Eff || options.type == AnimationType::Raw;
+
+    if (!data.quantized && (options.type == AnimationType::Ani || (frameSequence && options.imageFormat == ImageFormat::Pcx))) {
+        qInfo() << (options.type == AnimationType::Ani ? "ANI" : "PCX") << "export requires quantization. Running with defaults.";
+
+        QString error;
+        if (!quantize(data, QuantizeOptions{}, &error)) {
+            return ExportResult::fail(cancelled() ? error : QString("Automatic quantization failed."));
+        }
+    }
+
+    if (frameSequence && options.imageFormat == ImageFormat::Dds) {
+        auto width = data.originalSize.width();
+        auto height = data.originalSize.height();
+        if (width % 4 != 0 || height % 4 != 0) {
+            return ExportResult::fail("DDS format requires dimensions to be multiples of 4.");
+        }
+    }
+
+    if (cancelled()) {
+        return ExportResult::fail("Cancelled");
+    }
+
+    const QString name = options.baseName.isEmpty()
+        ? data.baseName
+        : QFileInfo(options.baseName).completeBaseName(); // removes the extension, if any
+
+    switch (options.type) {
+    case AnimationType::Ani: {
+        AniExporter exporter;
+        exporter.setProgressCallback(progressFor(ConversionStage::Export));
+        exporter.setWorkerCount(m_workerCount);
+        exporter.setThreadPool(m_threadPool);
+        return exporter.exportAnimation(withDecodedFrames(data, m_workerCount, m_threadPool), options.path, name);
+    }
+    case AnimationType::Eff: {
+        EffExporter exporter;
+        exporter.setProgressCallback(progressFor(ConversionStage::Export));
+        exporter.setDdsSettings(options.dds);
+        exporter.setTgaRle(options.tgaRle);
+        exporter.setWorkerCount(m_workerCount);
+        exporter.setThreadPool(m_threadPool);
+        return exporter.exportAnimation(withDecodedFrames(data, m_workerCount, m_threadPool), options.path, options.imageFormat, options.compression, name);
+    }
+    case AnimationType::Apng: {
+        ApngExporter exporter;
+        exporter.setProgressCallback(progressFor(ConversionStage::Export));
+        exporter.setPreset(options.apngPreset);
+        exporter.setWorkerCount(m_workerCount);
+        return exporter.exportAnimation(withDecodedFrames(data, m_workerCount, m_threadPool), options.path, name);
+    }
+    case AnimationType::Raw: {
+        RawExporter exporter;
+        exporter.setProgressCallback(progressFor(ConversionStage::Export));
+        exporter.setDdsSettings(options.dds);
+        exporter.setTgaRle(options.tgaRle);
+        exporter.setWorkerCount(m_workerCount);
+        exporter.setThreadPool(m_threadPool);
+        return exporter.exportAllFrames(withDecodedFrames(data, m_workerCount, m_threadPool), options.path, options.imageFormat, options.compression);
+    }
+    }
+    return ExportResult::fail("Invalid export type.");
+}
+
+ExportResult ConversionPipeline::exportFrame(const AnimationData& data, int index, const QString& path, const ExportOptions& options) {
+    if (index < 0 || index >= data.frames.size()) {
+        return ExportResult::fail(QString("Frame %1 does not exist.").arg(index));
+    }
+
+    if (options.imageFormat == ImageFormat::Dds) {
+        auto width = data.originalSize.width();
+        auto height = data.originalSize.height();
+        if (width % 4 != 0 || height % 4 != 0) {
+            return ExportResult::fail("DDS format requires dimensions to be multiples of 4.");
+        }
+    }
+
+    // Only the exported frame needs decoding
+    AnimationData frameData = data;
+    if (frameData.frames[index].image.isCompressed()) {
+        frameData.frames[index].image = frameData.frames[index].image.decoded();
+    }
+
+    RawExporter exporter;
+    exporter.setProgressCallback(progressFor(ConversionStage::Export));
+    exporter.setDdsSettings(options.dds);
+    exporter.setTgaRle(options.tgaRle);
+    return exporter.exportCurrentFrame(frameData, index, path, options.imageFormat, options.compression, true);
+}
+
+ExportResult ConversionPipeline::run(AnimationType inputType, const QString& inPath, const ConversionOptions& options) {
+    m_workerCount = options.workerCount;
+    m_threadPool = options.threadPool;
+
+    QString error;
+    std::optional<AnimationData> data = load(inputType, inPath, options.keepCompressed, &error);
+    if (!data) {
+        return ExportResult::fail(error);
+    }
+
+    if (options.quantize && !quantize(*data, *options.quantize, &error)) {
+        return ExportResult::fail(error);
+    }
+
+    return exportAnimation(*data, options.output);
+}
+
+QFuture<ExportResult> ConversionPipeline::runAsync(AnimationType inputType, const QString& inPath, const ConversionOptions& options,
+    ConversionToken* token, QThreadPool* pool) {
+    return QtConcurrent::run(pool ? pool : QThreadPool::globalInstance(), [=]() {
+        return ConversionPipeline(token).run(inputType, inPath, options);
+    });
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "AnimationData.h"
+#include "Quantizer.h"
+#include "Formats/ImageFormats.h"
+
+#include <QFuture>
+#include <QRgb>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <optional>
+
+class QThreadPool;
+
+enum class ConversionStage {
+    Import,
+    Quantize,
+    Export
+};
+
+// Progress and cancellation for pipeline runs, shared between the thread doing the work and
+// whoever watches it. Progress (0.0 to 1.0 per stage) is reported on the thread doing the
+// work, which for some stages is one of their pool threads.
+// A cancelled run stops as soon as it can: quantization right away, import and export at the
+// end of the stage.
+class ConversionToken {
+public:
+    void setProgressCallback(std::function<void(ConversionStage, float)> cb) { m_progressCallback = std::move(cb); }
+    void reportProgress(ConversionStage stage, float fraction) const {
+        if (m_progressCallback) m_progressCallback(stage, fraction);
+    }
+
+    // Thread-safe
+    void cancel() { m_cancelled.store(true); }
+    bool isCancelled() const { return m_cancelled.load(); }
+
+private:
+    std::function<void(ConversionStage, float)> m_progressCallback;
+    std::atomic<bool> m_cancelled{ false };
+};
+
+struct QuantizeOptions {
+    QVector<QRgb> palette;              // Palette to map onto, empty to generate one
+    int quality = 100;
+    int maxColors = 256;
+    bool enforceTransparency = true;
+    quint64 sourceGeneration = 0;       // See Quantizer::setSourceGeneration
+};
+
+struct ExportOptions {
+    AnimationType type = AnimationType::Apng;
+    QString path;                       // Output folder
+    ImageFormat imageFormat = ImageFormat::Png; // Frame format for eff and raw exports
+    CompressionFormat compression = CompressionFormat::BC7;
+    ApngPreset apngPreset = ApngPreset::Balanced;
+    DdsSettings dds;
+    bool tgaRle = false;
+    QString baseName;                   // Empty keeps the animation's name
+};
+
+struct ConversionOptions {
+    bool keepCompressed = false;        // See FrameBuffer
+    int workerCount = 0;                // Threads for each stage's pool, 0 for one per core
+    QThreadPool* threadPool = nullptr;  // Pool every stage runs on, null for private ones (see StagePool)
+    std::optional<QuantizeOptions> quantize; // Quantize before exporting
+    ExportOptions output;
+};
+
+// Load, quantize and export without signals or an event loop. Every step runs on the calling
+// thread and returns its result directly, so it can be used from any thread and from tools
+// that have no Qt event loop. AnimationController and the command line are built on it.
+class ConversionPipeline {
+public:
+    explicit ConversionPipeline(ConversionToken* token = nullptr);
+    ~ConversionPipeline();
+
+    // Quantize with this quantizer instead of a private one, so repeated runs on the same
+    // frames reuse its histogram. It must not be used by anything else meanwhile.
+    void setQuantizer(Quantizer* quantizer) { m_quantizer = quantizer; }
+
+    // Threads the importers, quantizer and exporters may each use, 0 (the default) for one per
+    // core. Lower it when several conversions run at once, so together they don't start far
+    // more threads than there are cores.
+    void setWorkerCount(int workers) { m_workerCount = workers; }
+
+    // Have every stage run on this pool instead of creating its own, see StagePool. The worker
+    // count still caps how much of it one stage uses.
+    void setThreadPool(QThreadPool* pool) { m_threadPool = pool; }
+
+    // Import and finishImport(). Nullopt on failure, with error set.
+    std::optional<AnimationData> load(AnimationType type, const QString& path, bool keepCompressed, QString* error);
+
+    // Quantize the frames. The palette, if any, is padded to 256 entries first.
+    std::optional<QuantResult> quantizeFrames(const QVector<AnimationFrame>& frames, const QuantizeOptions& options, QString* error);
+
+    // quantizeFrames() and store the result as the data's quantized set
+    bool quantize(AnimationData& data, const QuantizeOptions& options, QString* error);
+
+    // Export the animation. ANI and PCX frames need a quantized set; if data has none it is
+    // quantized with the defaults first, and keeps the result.
+    ExportResult exportAnimation(AnimationData& data, const ExportOptions& options);
+
+    // Export one frame to a file. Only the frame's type and DDS/TGA options are used.
+    ExportResult exportFrame(const AnimationData& data, int index, const QString& path, const ExportOptions& options);
+
+    // The whole conversion: load, quantize if asked, export. Uses the options' worker count and pool.
+    ExportResult run(AnimationType inputType, const QString& inPath, const ConversionOptions& options);
+
+    // run() on a pool (the global one if null). The token, if any, must outlive the run.
+    static QFuture<ExportResult> runAsync(AnimationType inputType, const QString& inPath, const ConversionOptions& options,
+        ConversionToken* token = nullptr, QThreadPool* pool = nullptr);
+
+private:
+    bool cancelled() const { return m_token && m_token->isCancelled(); }
+    std::function<void(float)> progressFor(ConversionStage stage) const;
+
+    ConversionToken* m_token;
+    Quantizer* m_quantizer = nullptr;
+    int m_workerCount = 0;
+    QThreadPool* m_threadPool = nullptr;
+    std::unique_ptr<Quantizer> m_ownQuantizer;
+};
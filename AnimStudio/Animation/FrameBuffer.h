@@ -0,0 +1,68 @@
+// FrameBuffer.h
+#pragma once
+
+#include "Formats/BcnDecoder.h"
+#include <QImage>
+#include <QSize>
+#include <QVector>
+#include <QRgb>
+
+// Immutable, reference-counted pixels for a single frame.
+//
+// Ownership rules:
+//  - A FrameBuffer never changes once constructed. Copies share one pixel buffer
+//    (QImage implicit sharing), so handing frames between AnimationData, the
+//    Quantizer and the exporters only bumps a reference count.
+//  - There is no non-const access to the pixels, so nothing can detach the shared
+//    buffer by accident. Read through image(), constBits() or constScanLine().
+//  - To change pixels, build a new QImage (mutableCopy() is a deep copy) and assign
+//    it back. The old buffer is freed when its last holder lets go.
+//  - view(format) hands back the pixels in a given format, sharing the buffer when
+//    it is already in that format. Frames are stored as Format_RGBA8888 (or
+//    Format_Indexed8 for quantized frames) so the common views are free.
+//  - A frame loaded from a BC1/BC3/BC7 DDS can instead hold the file's compressed blocks
+//    (isCompressed()). It has no QImage then: image() is null and decoded() or view()
+//    decode a fresh copy on every call. Size queries work without decoding.
+class FrameBuffer {
+public:
+    FrameBuffer() = default;
+    FrameBuffer(QImage image) : m_image(std::move(image)) {}
+    FrameBuffer(BcnImage compressed) : m_compressed(std::move(compressed)) {}
+
+    const QImage& image() const { return m_image; }
+    operator const QImage& () const { return m_image; }
+
+    bool isCompressed() const { return !m_compressed.isNull(); }
+    const BcnImage& compressed() const { return m_compressed; }
+
+    // The pixels as an image. Shared for normal frames, decoded on each call for compressed ones.
+    QImage decoded() const { return isCompressed() ? m_compressed.decode() : m_image; }
+
+    bool isNull() const { return m_image.isNull() && m_compressed.isNull(); }
+    QSize size() const { return isCompressed() ? QSize(m_compressed.width, m_compressed.height) : m_image.size(); }
+    int width() const { return isCompressed() ? m_compressed.width : m_image.width(); }
+    int height() const { return isCompressed() ? m_compressed.height : m_image.height(); }
+    QImage::Format format() const { return isCompressed() ? QImage::Format_RGBA8888 : m_image.format(); }
+    bool hasAlphaChannel() const { return isCompressed() || m_image.hasAlphaChannel(); }
+    QVector<QRgb> colorTable() const { return m_image.colorTable(); }
+    qsizetype bytesPerLine() const { return m_image.bytesPerLine(); }
+    qsizetype sizeInBytes() const { return m_image.sizeInBytes(); }
+    const uchar* constBits() const { return m_image.constBits(); }
+    const uchar* constScanLine(int y) const { return m_image.constScanLine(y); }
+
+    // Pixels in the requested format, shared if no conversion is needed
+    QImage view(QImage::Format format) const {
+        if (isCompressed()) {
+            QImage image = m_compressed.decode();
+            return image.format() == format ? image : image.convertToFormat(format);
+        }
+        return m_image.format() == format ? m_image : m_image.convertToFormat(format);
+    }
+
+    // Private, writable copy of the pixels
+    QImage mutableCopy() const { return isCompressed() ? m_compressed.decode() : m_image.copy(); }
+
+private:
+    QImage m_image;
+    BcnImage m_compressed;
+};
@@ -0,0 +1,221 @@
+// PaletteMapper.cpp
+#include "PaletteMapper.h"
+#include "AnimationData.h"
+
+#include <QMutex>
+#include <algorithm>
+#include <climits>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PALETTE_MAPPER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#define CELL_BITS           4       // Each cell covers 16 levels per channel
+#define CELLS_PER_SIDE      (256 >> CELL_BITS)
+#define FAR_COMPONENT       16384   // Padding entries: farther than any color, still safe for int32 sums
+#define LOOKUP_CACHE_BITS   12      // Direct-mapped cache of recently seen colors, per mapImage call
+#define ALPHA_THRESHOLD     128     // Below this a pixel counts as transparent when transparency is enforced
+#define SHARED_MAPPERS      8       // Mappers kept by shared(), least recently used dropped first
+
+static inline int sq(int v) {
+    return v * v;
+}
+
+// Squared distance from v to the closest / farthest point of [lo, hi]
+static inline int axisMinDist(int v, int lo, int hi) {
+    return v < lo ? sq(lo - v) : (v > hi ? sq(v - hi) : 0);
+}
+
+static inline int axisMaxDist(int v, int lo, int hi) {
+    return std::max(sq(v - lo), sq(v - hi));
+}
+
+PaletteMapper::PaletteMapper(const QVector<QRgb>& palette, bool enforceTransparency)
+    : m_palette(palette)
+    , m_enforceTransparency(enforceTransparency)
+{
+    // Entries a pixel is allowed to land on, in palette order
+    struct Entry {
+        int r, g, b;
+        uchar index;
+    };
+    std::vector<Entry> entries;
+    const int count = std::min(static_cast<int>(palette.size()), 256);
+    for (int i = 0; i < count; ++i) {
+        QRgb c = palette[i];
+        if (enforceTransparency && (i == TRANSPARENT_COLOR_INDEX || qAlpha(c) == 0))
+            continue;
+        entries.push_back({ qRed(c), qGreen(c), qBlue(c), static_cast<uchar>(i) });
+    }
+    if (entries.empty())
+        entries.push_back({ 0, 0, 0, 0 });
+
+    const int cellSize = 1 << CELL_BITS;
+    m_cells.resize(CELLS_PER_SIDE * CELLS_PER_SIDE * CELLS_PER_SIDE);
+
+    std::vector<std::pair<int, int>> candidates; // (distance to cell, entry)
+    for (int cr = 0; cr < CELLS_PER_SIDE; ++cr) {
+        for (int cg = 0; cg < CELLS_PER_SIDE; ++cg) {
+            for (int cb = 0; cb < CELLS_PER_SIDE; ++cb) {
+                const int rLo = cr * cellSize, rHi = rLo + cellSize - 1;
+                const int gLo = cg * cellSize, gHi = gLo + cellSize - 1;
+                const int bLo = cb * cellSize, bHi = bLo + cellSize - 1;
+
+                // No point in the cell is farther than this from its nearest entry...
+                int bound = INT_MAX;
+                for (const Entry& e : entries) {
+                    int d = axisMaxDist(e.r, rLo, rHi) + axisMaxDist(e.g, gLo, gHi) + axisMaxDist(e.b, bLo, bHi);
+                    bound = std::min(bound, d);
+                }
+
+                // ...so only entries at least that close to the cell can ever win in it
+                candidates.clear();
+                for (int i = 0; i < static_cast<int>(entries.size()); ++i) {
+                    const Entry& e = entries[i];
+                    int d = axisMinDist(e.r, rLo, rHi) + axisMinDist(e.g, gLo, gHi) + axisMinDist(e.b, bLo, bHi);
+                    if (d <= bound)
+                        candidates.push_back({ d, i });
+                }
+                std::stable_sort(candidates.begin(), candidates.end(),
+                    [](const std::pair<int, int>& a, const std::pair<int, int>& b) { return a.first < b.first; });
+
+                Cell& cell = m_cells[(cr * CELLS_PER_SIDE + cg) * CELLS_PER_SIDE + cb];
+                cell.first = static_cast<int>(m_blockMinDist.size());
+                cell.count = static_cast<int>((candidates.size() + 3) / 4);
+
+                for (int k = 0; k < cell.count * 4; ++k) {
+                    if (k < static_cast<int>(candidates.size())) {
+                        const Entry& e = entries[candidates[k].second];
+                        m_rg << int16_t(e.r) << int16_t(e.g);
+                        m_b << int16_t(e.b) << int16_t(0);
+                        m_index << e.index;
+                    } else {
+                        m_rg << int16_t(FAR_COMPONENT) << int16_t(FAR_COMPONENT);
+                        m_b << int16_t(FAR_COMPONENT) << int16_t(0);
+                        m_index << uchar(0);
+                    }
+                    if (k % 4 == 0)
+                        m_blockMinDist << candidates[k].first;
+                }
+            }
+        }
+    }
+}
+
+uchar PaletteMapper::nearest(int r, int g, int b) const {
+    const Cell& cell = m_cells[((r >> CELL_BITS) * CELLS_PER_SIDE + (g >> CELL_BITS)) * CELLS_PER_SIDE + (b >> CELL_BITS)];
+
+    int bestDist = INT_MAX;
+    uchar best = 0;
+
+#ifdef PALETTE_MAPPER_SSE2
+    const __m128i pixelRg = _mm_set1_epi32((g << 16) | r);
+    const __m128i pixelB = _mm_set1_epi32(b);
+#endif
+
+    for (int block = cell.first; block < cell.first + cell.count; ++block) {
+        // Candidates are sorted by distance to the cell, nothing further on can do better
+        if (m_blockMinDist[block] > bestDist)
+            break;
+
+        int dist[4];
+#ifdef PALETTE_MAPPER_SSE2
+        __m128i drg = _mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(m_rg.constData() + block * 8)), pixelRg);
+        __m128i db = _mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(m_b.constData() + block * 8)), pixelB);
+        __m128i d = _mm_add_epi32(_mm_madd_epi16(drg, drg), _mm_madd_epi16(db, db));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dist), d);
+#else
+        for (int k = 0; k < 4; ++k) {
+            const int16_t* rg = m_rg.constData() + block * 8 + k * 2;
+            dist[k] = sq(rg[0] - r) + sq(rg[1] - g) + sq(m_b[block * 8 + k * 2] - b);
+        }
+#endif
+
+        for (int k = 0; k < 4; ++k) {
+            uchar index = m_index[block * 4 + k];
+            if (dist[k] < bestDist || (dist[k] == bestDist && index < best)) {
+                bestDist = dist[k];
+                best = index;
+            }
+        }
+    }
+
+    return best;
+}
+
+std::shared_ptr<const PaletteMapper> PaletteMapper::shared(const QVector<QRgb>& palette, bool enforceTransparency) {
+    static QMutex mutex;
+    static std::vector<std::shared_ptr<const PaletteMapper>> cache; // Most recently used first
+
+    auto matches = [&](const std::shared_ptr<const PaletteMapper>& m) {
+        return m->m_enforceTransparency == enforceTransparency && m->m_palette == palette;
+    };
+
+    {
+        QMutexLocker lock(&mutex);
+        auto it = std::find_if(cache.begin(), cache.end(), matches);
+        if (it != cache.end()) {
+            std::rotate(cache.begin(), it, it + 1);
+            return cache.front();
+        }
+    }
+
+    // Built outside the lock so other palettes aren't held up. Two threads missing on the same
+    // palette at once both build it and the second one's copy is dropped.
+    auto mapper = std::make_shared<const PaletteMapper>(palette, enforceTransparency);
+
+    QMutexLocker lock(&mutex);
+    auto it = std::find_if(cache.begin(), cache.end(), matches);
+    if (it != cache.end()) {
+        std::rotate(cache.begin(), it, it + 1);
+        return cache.front();
+    }
+    cache.insert(cache.begin(), mapper);
+    if (cache.size() > SHARED_MAPPERS) {
+        cache.pop_back();
+    }
+    return mapper;
+}
+
+void PaletteMapper::mapImage(const QImage& source, QImage& target) const {
+    const int w = source.width();
+    const int h = source.height();
+
+    // Animation frames reuse the same colors over and over, so remember recent answers
+    const int cacheSize = 1 << LOOKUP_CACHE_BITS;
+    std::vector<quint32> cacheKeys(cacheSize, 0xFFFFFFFFu); // Never a valid 24-bit key
+    std::vector<uchar> cacheValues(cacheSize, 0);
+
+    for (int y = 0; y < h; ++y) {
+        const uchar* in = source.constScanLine(y);
+        uchar* out = target.scanLine(y);
+
+        for (int x = 0; x < w; ++x, in += 4) {
+            int r = in[0], g = in[1], b = in[2], a = in[3];
+
+            if (m_enforceTransparency) {
+                if (a < ALPHA_THRESHOLD) {
+                    out[x] = TRANSPARENT_COLOR_INDEX;
+                    continue;
+                }
+            } else if (a != 255) {
+                // Flatten onto black, same as the libimagequant path
+                QRgb p = qPremultiply(qRgba(r, g, b, a));
+                r = qRed(p);
+                g = qGreen(p);
+                b = qBlue(p);
+            }
+
+            const quint32 key = (quint32(r) << 16) | (quint32(g) << 8) | quint32(b);
+            const quint32 slot = (key * 2654435761u) >> (32 - LOOKUP_CACHE_BITS);
+            if (cacheKeys[slot] != key) {
+                cacheKeys[slot] = key;
+                cacheValues[slot] = nearest(r, g, b);
+            }
+            out[x] = cacheValues[slot];
+        }
+    }
+}
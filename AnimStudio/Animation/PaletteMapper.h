@@ -0,0 +1,52 @@
+// PaletteMapper.h
+#pragma once
+
+#include <QImage>
+#include <QRgb>
+#include <QVector>
+#include <cstdint>
+#include <memory>
+
+// Maps RGBA pixels straight onto a fixed palette, keeping the palette's own index order.
+// Used instead of libimagequant when the user picks a built-in or loaded palette: there is
+// nothing to generate, only a nearest-color lookup per pixel.
+//
+// The RGB cube is split into 16x16x16 cells. For every cell we keep only the palette entries
+// that can be the nearest color for some point inside it, sorted by their distance to the cell,
+// so a lookup checks a handful of entries instead of 256. Results are exact (squared RGB
+// distance, ties go to the lowest index) and the candidate distances are computed four at a
+// time with SSE2 where available.
+class PaletteMapper {
+public:
+    // With enforceTransparency, pixels with alpha below 128 map to TRANSPARENT_COLOR_INDEX and
+    // every other pixel maps to an opaque entry other than that index. Without it, pixels are
+    // flattened onto black and may map to any entry.
+    PaletteMapper(const QVector<QRgb>& palette, bool enforceTransparency);
+
+    // A mapper for the palette from a small process-wide cache, built on first use. Building
+    // the cell table is the expensive part, so jobs mapping onto the same palette (a batch of
+    // conversions to one built-in palette) share one instead of building their own.
+    static std::shared_ptr<const PaletteMapper> shared(const QVector<QRgb>& palette, bool enforceTransparency);
+
+    // Map an RGBA8888 image into a same-sized Indexed8 image
+    void mapImage(const QImage& source, QImage& target) const;
+
+private:
+    struct Cell {
+        int first; // Offset of the cell's first candidate block
+        int count; // Number of 4-wide candidate blocks
+    };
+
+    uchar nearest(int r, int g, int b) const;
+
+    QVector<QRgb> m_palette; // As given, the cache key for shared()
+    bool m_enforceTransparency;
+
+    QVector<Cell> m_cells;
+    // Candidates, grouped in blocks of four: (r,g) pairs and (b,0) pairs as int16 so SSE2 can
+    // square and sum them with one madd each. Short blocks are padded with far-away entries.
+    QVector<int16_t> m_rg;
+    QVector<int16_t> m_b;
+    QVector<uchar> m_index;
+    QVector<int> m_blockMinDist; // Lower bound on the distance to anything in the block
+};
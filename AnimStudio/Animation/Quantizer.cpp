@@ -1,11 +1,18 @@
 // quantizer.cpp
 #include "Quantizer.h"
+#include "StagePool.h"
 #include <QImage>
 #include <QByteArray>
 #include <QDebug>
-#include <QPainter>
+#include <QMutex>
+#include <QThread>
+#include <QtConcurrent>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 
 #include "Animation/Palette.h"
+#include "Animation/PaletteMapper.h"
 
 // C-callback shim for libimagequant progress callback
 static int liqProgressShim(float fraction, void* userInfo) {
@@ -13,8 +20,38 @@ static int liqProgressShim(float fraction, void* userInfo) {
     return (*fn)(fraction) ? 1 : 0;
 }
 
+// Feeds one frame to libimagequant a row at a time. Nothing but the source frame has to be
+// resident, so both passes stream: each liq_image lives only while its frame is processed.
+struct FrameRowSource {
+    QImage pixels; // RGBA8888, shares the source frame's buffer
+    bool flatten;  // composite onto black when transparency isn't enforced
+};
+
+static void frameRowCallback(liq_color rowOut[], int row, int width, void* userInfo) {
+    const auto* source = static_cast<const FrameRowSource*>(userInfo);
+    std::memcpy(rowOut, source->pixels.constScanLine(row), size_t(width) * sizeof(liq_color));
+
+    if (source->flatten) {
+        for (int x = 0; x < width; ++x) {
+            liq_color& c = rowOut[x];
+            if (c.a != 255) {
+                // Same result as QPainter SourceOver onto opaque black
+                QRgb p = qPremultiply(qRgba(c.r, c.g, c.b, c.a));
+                c.r = static_cast<unsigned char>(qRed(p));
+                c.g = static_cast<unsigned char>(qGreen(p));
+                c.b = static_cast<unsigned char>(qBlue(p));
+                c.a = 255;
+            }
+        }
+    }
+}
+
 Quantizer::Quantizer() = default;
 
+Quantizer::~Quantizer() {
+    releaseHistogram();
+}
+
 Quantizer& Quantizer::setQualityRange(int min, int max) {
     qualityMin_ = min;
     qualityMax_ = max;
@@ -41,6 +78,21 @@ Quantizer& Quantizer::setCustomPalette(const QVector<QRgb>& palette) {
     return *this;
 }
 
+Quantizer& Quantizer::setSourceGeneration(quint64 generation) {
+    sourceGeneration_ = generation;
+    return *this;
+}
+
+Quantizer& Quantizer::setWorkerCount(int workers) {
+    workerCount_ = workers;
+    return *this;
+}
+
+Quantizer& Quantizer::setThreadPool(QThreadPool* pool) {
+    threadPool_ = pool;
+    return *this;
+}
+
 void Quantizer::reset() {
     cancelRequested_.store(false);
     qualityMin_ = 0;
@@ -48,6 +100,16 @@ void Quantizer::reset() {
     ditheringLevel_ = 0.0f;
     maxColors_ = 256;
     customPalette_.clear();
+    sourceGeneration_ = 0;
+    workerCount_ = 0;
+}
+
+void Quantizer::releaseHistogram() {
+    if (cachedHist_) {
+        liq_histogram_destroy(cachedHist_);
+        cachedHist_ = nullptr;
+    }
+    cachedGeneration_ = 0;
 }
 
 void Quantizer::cancel() {
@@ -62,12 +124,16 @@ std::optional<QuantResult> Quantizer::quantize(const QVector<AnimationFrame>& sr
 
     running_ = true;
 
+    // A fixed palette has nothing to generate, so skip libimagequant entirely
+    if (!customPalette_.isEmpty()) {
+        return mapToCustomPalette(src, progressCb);
+    }
+
     // Resource handles
     liq_attr* attr = nullptr;
     liq_histogram* hist = nullptr;
     liq_result* resultPal = nullptr;
-    QVector<liq_image*> liqImages;
-    liqImages.reserve(src.size());
+    QVector<liq_result*> workerResults; // one per remap thread
     int w = src[0].image.width();
     int h = src[0].image.height();
     const size_t total = src.size();
@@ -78,16 +144,14 @@ std::optional<QuantResult> Quantizer::quantize(const QVector<AnimationFrame>& sr
     // Cleanup & early-return helper
     auto quit = [&](const char* message) -> std::optional<QuantResult> {
         qDebug() << message;
+        for (auto* r : workerResults) liq_result_destroy(r);
         if (resultPal)    liq_result_destroy(resultPal);
-        for (auto* img : liqImages) liq_image_destroy(img);
         if (hist)         liq_histogram_destroy(hist);
         if (attr)         liq_attr_destroy(attr);
         running_ = false;
         return std::nullopt;
     };
 
-    bool usingCustomPalette = !customPalette_.isEmpty();
-
     // Initialize attributes
     attr = liq_attr_create();
     if (!attr) return quit("Quantize: liq_attr_create failed");
@@ -96,90 +160,39 @@ std::optional<QuantResult> Quantizer::quantize(const QVector<AnimationFrame>& sr
     //TODO liq_image_set_background
     //TODO liq_set_output_gamma
 
-    hist = liq_histogram_create(attr);
-    if (!hist) return quit("Quantize: liq_histogram_create failed");
-
-    // Create the histogram from palette if set
-    if (usingCustomPalette) {
-        int numColors = fmin(256, static_cast<int>(customPalette_.size()));
-        liq_set_max_colors(attr, numColors);
-
-        // Build an array of histogram entries from your palette
-        std::vector<liq_histogram_entry> entries;
-        entries.reserve(customPalette_.size());
-
-        int colorCount = 0;
-        for (QRgb qc : customPalette_) {
-            if (cancelRequested_.load()) return quit("Quantize: cancelled by user");
-
-            if (colorCount >= numColors) {
-                qWarning() << "Quantize: custom palette exceeds max colors, truncating";
-                break; // Limit to max colors
-            }
-
-            liq_color col = {
-                static_cast<unsigned char>(qRed(qc)),
-                static_cast<unsigned char>(qGreen(qc)),
-                static_cast<unsigned char>(qBlue(qc)),
-                static_cast<unsigned char>(qAlpha(qc))
-            };
-
-            if (colorCount == 255 && enforceTransparency_) {
-                col.a = 0;
-
-                // Also adjust our source palette just to be sure
-                customPalette_[colorCount] = qRgba(qRed(qc), qGreen(qc), qBlue(qc), 0);
-            }
-            
-            entries.push_back({ col, 1u }); // count=1.0f
-
-            // Feed them into the histogram
-            if (LIQ_OK != liq_histogram_add_fixed_color(
-                hist,
-                col,
-                /*gamma=*/0.0
-            ))
-            {
-                qWarning() << "Quantize: liq_histogram_add_colors failed";
-            }
-
-            colorCount++;
-        }
+    liq_set_max_colors(attr, maxColors_);
 
-        
+    // The histogram only depends on the frames and how they're read, not on quality,
+    // max colors or dithering, so a re-run on the same frames can skip straight to the palette
+    const bool flatten = !enforceTransparency_;
+    const bool reuseHistogram = cachedHist_ && sourceGeneration_ != 0 &&
+        cachedGeneration_ == sourceGeneration_ && cachedFlatten_ == flatten;
+    if (reuseHistogram) {
+        if (cbPtr) (*cbPtr)(20.0f);
     } else {
-        liq_set_max_colors(attr, maxColors_); // Default max colors if no custom palette
+        releaseHistogram();
+
+        hist = liq_histogram_create(attr);
+        if (!hist) return quit("Quantize: liq_histogram_create failed");
+        liq_histogram_set_reusable(hist, 1);
     }
 
     // Process each frame to add to histogram for palette generation
-    for (int i = 0; i < total; ++i) {
+    for (int i = 0; i < total && !reuseHistogram; ++i) {
         if (cancelRequested_.load()) return quit("Quantize: cancelled by user");
 
-        const auto& frame = src[i];
-        QImage img = frame.image;
-        if (img.format() != QImage::Format_RGBA8888) {
-            img = img.convertToFormat(QImage::Format_RGBA8888);
-        }
-        // If transparency is NOT enforced, flatten the frame onto a black background
-        if (!enforceTransparency_ && img.hasAlphaChannel()) {
-            QImage flattened(w, h, QImage::Format_RGBA8888);
-            flattened.fill(Qt::black); // background color to flatten onto
-            QPainter p(&flattened);
-            p.setCompositionMode(QPainter::CompositionMode_SourceOver);
-            p.drawImage(0, 0, img);
-            p.end();
-            img = std::move(flattened);
-        }
-        if (img.width() != w || img.height() != h) {
+        // Shares the frame's buffer unless it isn't stored as RGBA8888.
+        // If transparency is NOT enforced, rows are flattened onto a black background as they're read.
+        FrameRowSource source{ src[i].image.view(QImage::Format_RGBA8888), flatten };
+        if (source.pixels.width() != w || source.pixels.height() != h) {
             return quit("Quantize: frame sizes differ, cannot global-quantize");
         }
-        liq_image* liqimg = liq_image_create_rgba(attr,
-            img.bits(), w, h, 0.0f);
+        liq_image* liqimg = liq_image_create_custom(attr, frameRowCallback, &source, w, h, 0.0);
         if (!liqimg) {
-            return quit("Quantize: liq_image_create_rgba failed");
+            return quit("Quantize: liq_image_create_custom failed");
         }
         liq_histogram_add_image(hist, attr, liqimg);
-        liqImages.push_back(liqimg); // Still need these for remapping later
+        liq_image_destroy(liqimg); // Recreated for remapping, so nothing per-frame stays alive
 
         // Track progress adding each frame to the histogram. 0% -> 20%
         if (cbPtr) {
@@ -188,13 +201,24 @@ std::optional<QuantResult> Quantizer::quantize(const QVector<AnimationFrame>& sr
         }
     }
 
+    // Keep a freshly built histogram for the next run on the same frames
+    if (hist && sourceGeneration_ != 0) {
+        cachedHist_ = hist;
+        cachedGeneration_ = sourceGeneration_;
+        cachedFlatten_ = flatten;
+        hist = nullptr;
+    }
+
     // Generate global palette from histogram
-    if (LIQ_OK != liq_histogram_quantize(hist, attr, &resultPal) || !resultPal) {
+    if (LIQ_OK != liq_histogram_quantize(hist ? hist : cachedHist_, attr, &resultPal) || !resultPal) {
         return quit("Quantize: liq_histogram_quantize failed");
     }
 
-    // histogram no longer needed
-    liq_histogram_destroy(hist);
+    // An uncached histogram is no longer needed
+    if (hist) {
+        liq_histogram_destroy(hist);
+        hist = nullptr;
+    }
 
     // If the user requested cancellation, we can stop here
     if (cancelRequested_.load()) return quit("Quantize: cancelled by user");
@@ -215,107 +239,203 @@ std::optional<QuantResult> Quantizer::quantize(const QVector<AnimationFrame>& sr
     }
 
     out.palette = table;
+    QVector<QRgb> colorTable = table;
 
-    // Remap each frame with the same palette
-    size_t bufSize = static_cast<size_t>(w) * static_cast<size_t>(h);
-    QByteArray buffer(static_cast<int>(bufSize), 0);
-    for (int i = 0; i < liqImages.size(); i++) {
-        if (cancelRequested_.load()) return quit("Quantize: cancelled by user");
-
-        liq_image* liqimg = liqImages[i];
+    // Work out the final index for every quantized index up front, so the
+    // transparency rule is applied while each frame is written.
+    uchar indexMap[256];
+    for (int i = 0; i < 256; ++i) {
+        indexMap[i] = static_cast<uchar>(i);
+    }
 
-        QImage outImg(w, h, QImage::Format_Indexed8);
-        outImg.setColorTable(table);
+    if (enforceTransparency_) {
+        Palette::setupAniTransparency(out.palette);
 
-        if (LIQ_OK != liq_write_remapped_image(resultPal, liqimg,
-            reinterpret_cast<unsigned char*>(buffer.data()),
-            bufSize)) {
-            qDebug() << "Quantize: remapping frame failed";
+        // Force use of index 255 for transparent pixels
+        for (int i = 0; i < 256; ++i) {
+            if (qAlpha(out.palette[indexMap[i]]) == 0) {
+                indexMap[i] = 255;
+            }
         }
-        // copy buffer
-        for (int y = 0; y < h; ++y) memcpy(
-            outImg.scanLine(y),
-            buffer.constData() + y * w, w);
+    } else {
+        Palette::padTo256(out.palette);
+    }
 
-        AnimationFrame qf;
-        qf.image = std::move(outImg);
-        out.frames.push_back(std::move(qf));
+    bool identityMap = true;
+    for (int i = 0; i < 256; ++i) {
+        identityMap = identityMap && indexMap[i] == i;
+    }
 
-        liq_image_destroy(liqimg);
+    // Remap frames on all cores. liq_write_remapped_image_rows keeps per-call state in the
+    // liq_result, so each worker remaps through its own copy. A frame's indices depend only on
+    // the palette and that frame, so the output is the same as remapping them one by one.
+    const int frameTotal = static_cast<int>(total);
+    const int cores = workerCount_ > 0 ? workerCount_ : QThread::idealThreadCount();
+    const int workerCount = std::max(1, std::min(cores, frameTotal));
+    for (int i = 0; i < workerCount; ++i) {
+        liq_result* copy = liq_result_copy(resultPal);
+        if (!copy) return quit("Quantize: liq_result_copy failed");
+        workerResults.push_back(copy);
+    }
 
-        // update progress for each frame 20% -> 100%
-        if (cbPtr) {
-            float pct = 20.0f + float(i + 1) / float(total) * 80.0f;
-            (*cbPtr)(pct);
+    // Output pixels are finished here before being handed to the (immutable) frames
+    QVector<QImage> outImages(frameTotal);
+    QImage* outData = outImages.data();
+    std::atomic<int> nextFrame{ 0 };
+    std::atomic<bool> failed{ false };
+    QMutex progressMutex;
+    int completed = 0;
+
+    auto remapFrames = [&](liq_result* workerResult) {
+        QVector<unsigned char*> rows(h);
+        for (int i = nextFrame++; i < frameTotal; i = nextFrame++) {
+            if (cancelRequested_.load() || failed.load()) return;
+
+            // Fetch the frame again and write indices straight into the output scanlines
+            FrameRowSource source{ src[i].image.view(QImage::Format_RGBA8888), flatten };
+            liq_image* liqimg = liq_image_create_custom(attr, frameRowCallback, &source, w, h, 0.0);
+            if (!liqimg) {
+                failed = true;
+                return;
+            }
+
+            QImage outImg(w, h, QImage::Format_Indexed8);
+            outImg.setColorTable(colorTable);
+            for (int y = 0; y < h; ++y) {
+                rows[y] = outImg.scanLine(y);
+            }
+
+            if (LIQ_OK != liq_write_remapped_image_rows(workerResult, liqimg, rows.data())) {
+                qDebug() << "Quantize: remapping frame failed";
+            }
+            liq_image_destroy(liqimg);
+
+            if (!identityMap) {
+                for (int y = 0; y < h; ++y) {
+                    unsigned char* line = rows[y];
+                    for (int x = 0; x < w; ++x) {
+                        line[x] = indexMap[line[x]];
+                    }
+                }
+            }
+
+            outData[i] = std::move(outImg);
+
+            // update progress for each frame 20% -> 100%
+            if (cbPtr) {
+                QMutexLocker lock(&progressMutex);
+                float pct = 20.0f + float(++completed) / float(total) * 80.0f;
+                (*cbPtr)(pct);
+            }
         }
+    };
+
+    StagePool pool(threadPool_, workerCount);
+    QVector<QFuture<void>> workers;
+    for (liq_result* workerResult : workerResults) {
+        workers.append(QtConcurrent::run(pool.get(), remapFrames, workerResult));
+    }
+    for (QFuture<void>& worker : workers) {
+        worker.waitForFinished();
     }
 
+    if (cancelRequested_.load()) return quit("Quantize: cancelled by user");
+    if (failed.load()) return quit("Quantize: liq_image_create_custom failed");
+
     // Clean up quantization result & attributes
+    for (liq_result* workerResult : workerResults) {
+        liq_result_destroy(workerResult);
+    }
+    workerResults.clear();
     liq_result_destroy(resultPal);
+    resultPal = nullptr;
     liq_attr_destroy(attr);
+    attr = nullptr;
 
-    // This sucks but now that the quantization is done, we need
-    // to make sure the palette order is the same as the input if provided...
-    // So we gotta do a little remapping again here. But we can hash map it and
-    // be faster about it.
-    if (usingCustomPalette) {
-        // Create a hash map of the original palette for fast lookup
-        QHash<QRgb, int> colorMap;
-        for (int i = 0; i < customPalette_.size(); ++i) {
-            colorMap[customPalette_[i]] = i;
-        }
-        // Now create a mapping from the quantized palette back to the original indices
-        QVector<int> remap(table.size(), -1);
-        for (int i = 0; i < table.size(); ++i) {
-            auto it = colorMap.find(table[i]);
-            if (it != colorMap.end()) {
-                remap[i] = it.value(); // original index
-            } else {
-                qDebug() << "Quantize: color not found in custom palette, using fallback for index" << i;
-                remap[i] = i; // fallback to self if no match found
-            }
-        }
+    for (int i = 0; i < outImages.size(); ++i) {
+        AnimationFrame qf = src[i]; // keep index, name and timing
+        qf.image = std::move(outImages[i]);
+        out.frames.push_back(std::move(qf));
+    }
 
-        // Now remap each frame's image data to use the custom palette
-        for (AnimationFrame& frame : out.frames) {
-            QImage& img = frame.image;
-            if (img.format() != QImage::Format_Indexed8)
-                continue;
+    running_ = false;
 
-            frame.image.setColorTable(customPalette_);
+    return out;
+}
 
-            uchar* bits = img.bits();
-            int size = img.width() * img.height();
+std::optional<QuantResult> Quantizer::mapToCustomPalette(const QVector<AnimationFrame>& src, const ProgressFn& progressCb) {
+    auto quit = [&](const char* message) -> std::optional<QuantResult> {
+        qDebug() << message;
+        running_ = false;
+        return std::nullopt;
+    };
 
-            for (int i = 0; i < size; ++i) {
-                bits[i] = remap[bits[i]];
-            }
-        }
+    const int w = src[0].image.width();
+    const int h = src[0].image.height();
+    const int frameTotal = static_cast<int>(src.size());
+
+    if (customPalette_.size() > 256) {
+        qWarning() << "Quantize: custom palette exceeds max colors, truncating";
+        customPalette_.resize(256);
+    }
 
-        out.palette = customPalette_;
+    // Index 255 is reserved for FSO's transparent color
+    if (enforceTransparency_ && customPalette_.size() == 256) {
+        QRgb c = customPalette_[255];
+        customPalette_[255] = qRgba(qRed(c), qGreen(c), qBlue(c), 0);
     }
 
+    const std::shared_ptr<const PaletteMapper> mapper = PaletteMapper::shared(customPalette_, enforceTransparency_);
+
+    QuantResult out;
+    out.palette = customPalette_;
     if (enforceTransparency_) {
         Palette::setupAniTransparency(out.palette);
+    } else {
+        Palette::padTo256(out.palette);
+    }
+
+    QVector<QImage> outImages(frameTotal);
+    QImage* outData = outImages.data();
+    std::atomic<bool> sizeMismatch{ false };
+    QMutex progressMutex;
+    int completed = 0;
 
-        // Double check transparency handling
-        for (AnimationFrame& frame : out.frames) {
-            QImage& img = frame.image;
-            if (img.format() != QImage::Format_Indexed8)
-                continue;
+    QVector<int> indices(frameTotal);
+    for (int i = 0; i < frameTotal; ++i) {
+        indices[i] = i;
+    }
 
-            uchar* bits = img.bits();
-            int size = img.width() * img.height();
+    const int cores = workerCount_ > 0 ? workerCount_ : QThread::idealThreadCount();
+    StagePool pool(threadPool_, std::max(1, std::min(cores, frameTotal)));
+    QtConcurrent::blockingMap(pool.get(), indices, [&](int i) {
+        if (cancelRequested_.load() || sizeMismatch.load()) return;
 
-            for (int i = 0; i < size; ++i) {
-                QRgb originalColor = out.palette[bits[i]];
-                if (qAlpha(originalColor) == 0) {
-                    bits[i] = 255; // Force use of index 255 for transparent pixels
-                }
-            }
+        QImage pixels = src[i].image.view(QImage::Format_RGBA8888);
+        if (pixels.width() != w || pixels.height() != h) {
+            sizeMismatch = true;
+            return;
         }
-    } else {
-        Palette::padTo256(out.palette);
+
+        QImage outImg(w, h, QImage::Format_Indexed8);
+        outImg.setColorTable(customPalette_);
+        mapper->mapImage(pixels, outImg);
+        outData[i] = std::move(outImg);
+
+        if (progressCb) {
+            QMutexLocker lock(&progressMutex);
+            progressCb(float(++completed) / float(frameTotal) * 100.0f);
+        }
+    });
+
+    if (cancelRequested_.load()) return quit("Quantize: cancelled by user");
+    if (sizeMismatch.load()) return quit("Quantize: frame sizes differ, cannot global-quantize");
+
+    out.frames.reserve(frameTotal);
+    for (int i = 0; i < frameTotal; ++i) {
+        AnimationFrame qf = src[i]; // keep index, name and timing
+        qf.image = std::move(outImages[i]);
+        out.frames.push_back(std::move(qf));
     }
 
     running_ = false;
@@ -21,6 +21,7 @@ using ProgressFn = std::function<bool(float /*fraction*/)>;
 class Quantizer {
 public:
     Quantizer();
+    ~Quantizer();
 
     /// Set the quality range [min, max] passed to libimagequant
     Quantizer& setQualityRange(int min, int max);
@@ -30,16 +31,26 @@ public:
     Quantizer& setMaxColors(int maxColors);
     /// Set transparency setting (ignored if automatic palette)
     Quantizer& setEnforcedTransparency(bool enforceTransparency);
-    /// Supply a fixed palette to seed quantization
+    /// Supply a fixed palette. Frames are mapped straight onto it, keeping its index order
     Quantizer& setCustomPalette(const QVector<QRgb>& palette);
+    /// Identify the source frames. While it stays the same (and non-zero) the color histogram
+    /// from the previous run is reused, so only palette generation and remapping run again.
+    Quantizer& setSourceGeneration(quint64 generation);
+    /// Threads remapping frames at once, 0 (the default) for one per core
+    Quantizer& setWorkerCount(int workers);
+    /// Remap on this pool instead of a private one, see StagePool
+    Quantizer& setThreadPool(QThreadPool* pool);
 
     /// Perform the quantization. Returns nullopt on failure.
     /// Progress callback receives values 0100 and may abort if returns false.
     std::optional<QuantResult> quantize(const QVector<AnimationFrame>& src, ProgressFn progressCb = nullptr);
 
-    // Reset Quantizer to a blank state
+    // Reset Quantizer settings to a blank state. The cached histogram is kept.
     void reset();
 
+    // Free the cached histogram. Must not be called while quantize() is running.
+    void releaseHistogram();
+
     // Request cancellation of a running quantize() call.
     // Thread-safe: quantize() will notice and abort as soon as it can.
     void cancel();
@@ -53,12 +64,23 @@ public:
     }
 
 private:
+    // Nearest-color mapping onto customPalette_, no palette generation involved
+    std::optional<QuantResult> mapToCustomPalette(const QVector<AnimationFrame>& src, const ProgressFn& progressCb);
+
     int           qualityMin_ = 0;
     int           qualityMax_ = 100;
     float         ditheringLevel_ = 0.0f;
     int           maxColors_ = 256;
     bool          enforceTransparency_ = true;
     QVector<QRgb> customPalette_;
+    quint64       sourceGeneration_ = 0;
+    int           workerCount_ = 0;
+    QThreadPool*  threadPool_ = nullptr;
+
+    // Histogram of the last auto-palette run, and what it was built from
+    liq_histogram* cachedHist_ = nullptr;
+    quint64       cachedGeneration_ = 0;
+    bool          cachedFlatten_ = false;
 
     std::atomic<bool> cancelRequested_{ false };
 
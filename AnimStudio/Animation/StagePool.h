@@ -0,0 +1,30 @@
+// StagePool.h
+#pragma once
+
+#include <QThreadPool>
+#include <memory>
+
+// The thread pool one stage of a conversion (decoding, quantizing, encoding) runs its work on.
+// That is the caller's pool if it handed one down with setThreadPool(), otherwise a private
+// pool with the given number of threads that lives as long as the stage. Never the global
+// pool: callers usually already run on it (QtConcurrent::run), so borrowing it could starve.
+//
+// A shared pool keeps its threads warm between stages and jobs, which is what the conversion
+// server uses it for. Stages only wait for their own work, never waitForDone(), so several
+// jobs can share one pool. It must not be the pool the conversion itself runs on.
+class StagePool {
+public:
+    StagePool(QThreadPool* shared, int threads) : m_pool(shared) {
+        if (!m_pool) {
+            m_ownPool = std::make_unique<QThreadPool>();
+            m_ownPool->setMaxThreadCount(threads);
+            m_pool = m_ownPool.get();
+        }
+    }
+
+    QThreadPool* get() const { return m_pool; }
+
+private:
+    QThreadPool* m_pool;
+    std::unique_ptr<QThreadPool> m_ownPool;
+};
\ No newline at end of file
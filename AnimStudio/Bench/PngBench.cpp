@@ -0,0 +1,77 @@
+#include "Animation/AnimationData.h"
+#include "Formats/ImageLoader.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QImage>
+#include <cstdio>
+#include <functional>
+
+// PngBench <dir>: decodes every PNG in dir through ImageLoader (libpng) and through QImage,
+// both converted to the frame storage format like a loaded sequence, and prints the timings.
+// Single threaded, best of three passes over a warm file cache. Tests/PngHandlerTest checks
+// that both give the same pixels.
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    const QStringList args = QCoreApplication::arguments();
+    if (args.size() != 2) {
+        fprintf(stderr, "Usage: PngBench <directory of PNG frames>\n");
+        return 1;
+    }
+
+    QDir directory(args[1]);
+    QStringList paths;
+    for (const QString& file : directory.entryList({ "*.png" }, QDir::Files, QDir::Name)) {
+        paths.append(directory.filePath(file));
+    }
+    if (paths.isEmpty()) {
+        fprintf(stderr, "No PNG files found in %s\n", qPrintable(args[1]));
+        return 1;
+    }
+
+    for (const QString& path : paths) {
+        QFile file(path);
+        if (file.open(QIODevice::ReadOnly)) {
+            file.readAll();
+        }
+    }
+
+    auto bestOfThree = [&paths](const std::function<QImage(const QString&)>& decode, QVector<QImage>& out) {
+        qint64 best = -1;
+        for (int pass = 0; pass < 3; ++pass) {
+            out.clear();
+            QElapsedTimer timer;
+            timer.start();
+            for (const QString& path : paths) {
+                out.append(decode(path).convertToFormat(FRAME_STORAGE_FORMAT));
+            }
+            const qint64 elapsed = timer.nsecsElapsed();
+            if (best < 0 || elapsed < best) {
+                best = elapsed;
+            }
+        }
+        return best;
+    };
+
+    QVector<QImage> viaQt;
+    QVector<QImage> viaLibpng;
+    const qint64 qtNs = bestOfThree([](const QString& path) { return QImage(path); }, viaQt);
+    const qint64 libpngNs = bestOfThree([](const QString& path) { return ImageLoader::load(path); }, viaLibpng);
+
+    int mismatches = 0;
+    for (int i = 0; i < paths.size(); ++i) {
+        if (viaQt[i] != viaLibpng[i]) {
+            ++mismatches;
+        }
+    }
+
+    const double frames = double(paths.size());
+    printf("%d PNG frame(s)\n", int(paths.size()));
+    printf("  QImage:  %8.3f ms/frame\n", qtNs / 1e6 / frames);
+    printf("  libpng:  %8.3f ms/frame\n", libpngNs / 1e6 / frames);
+    printf("  speedup: %8.2fx\n", libpngNs > 0 ? double(qtNs) / double(libpngNs) : 0.0);
+    printf("  frames with different pixels: %d\n", mismatches);
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include "Formats/RleKernels.h"
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QVector>
+#include <cstdio>
+#include <random>
+
+// Times every RLE kernel implementation the CPU has on a 1024x768 frame, the way each encoder
+// scans it: ANI sanitizes a keyframe, deltas against the previous frame and splits the delta
+// into runs of at most 255; PCX splits the frame itself into runs of at most 63.
+// Tests/RleEncoderTest checks that the results match.
+
+namespace {
+    constexpr int WIDTH = 1024;
+    constexpr int HEIGHT = 768;
+    constexpr uchar HOLDOVER = 0xFE;
+
+    // Runs of 1 to 80 pixels of a few values, like a quantized frame with flat areas
+    QVector<QByteArray> makeFrame(std::mt19937& rng) {
+        QVector<QByteArray> frame;
+        for (int y = 0; y < HEIGHT; ++y) {
+            QByteArray row(WIDTH, '\0');
+            int x = 0;
+            while (x < WIDTH) {
+                const int run = int(rng() % 80) + 1;
+                const uchar value = uchar("\x00\xFE\x07"[rng() % 3]);
+                for (int i = 0; i < run && x < WIDTH; ++i) {
+                    row[x++] = char(value);
+                }
+            }
+            frame.append(row);
+        }
+        return frame;
+    }
+
+    template <typename Pass>
+    qint64 bestOfFive(Pass pass) {
+        qint64 best = -1;
+        for (int i = 0; i < 5; ++i) {
+            QElapsedTimer timer;
+            timer.start();
+            pass();
+            const qint64 elapsed = timer.nsecsElapsed();
+            if (best < 0 || elapsed < best) {
+                best = elapsed;
+            }
+        }
+        return best;
+    }
+}
+
+int main() {
+    std::mt19937 rng(1234);
+    const QVector<QByteArray> frame = makeFrame(rng);
+    const QVector<QByteArray> lastFrame = makeFrame(rng);
+    const QVector<RleKernels::KernelSet> sets = RleKernels::availableKernels();
+
+    printf("1024x768 frame, best of five passes:\n");
+    printf("          %-30s  %s\n", "ANI (delta, runs <= 255)", "PCX (runs <= 63)");
+    qint64 scalarAniNs = 0;
+    qint64 scalarPcxNs = 0;
+    QByteArray delta(WIDTH, '\0');
+    QByteArray keyframe(WIDTH, '\0');
+    for (const RleKernels::KernelSet& set : sets) {
+        int aniRuns = 0;
+        const qint64 aniNs = bestOfFive([&] {
+            aniRuns = 0;
+            for (int y = 0; y < HEIGHT; ++y) {
+                const uchar* in = reinterpret_cast<const uchar*>(frame[y].constData());
+                uchar* out = reinterpret_cast<uchar*>(delta.data());
+                set.substituteUnchanged(in, reinterpret_cast<const uchar*>(lastFrame[y].constData()), out, WIDTH, HOLDOVER);
+                set.replaceValue(in, reinterpret_cast<uchar*>(keyframe.data()), WIDTH, HOLDOVER, 0x00);
+                for (int x = 0; x < WIDTH; ++aniRuns) {
+                    x += set.runLength(out + x, WIDTH - x, 255);
+                }
+            }
+        });
+
+        int pcxRuns = 0;
+        const qint64 pcxNs = bestOfFive([&] {
+            pcxRuns = 0;
+            for (int y = 0; y < HEIGHT; ++y) {
+                const uchar* in = reinterpret_cast<const uchar*>(frame[y].constData());
+                for (int x = 0; x < WIDTH; ++pcxRuns) {
+                    x += set.runLength(in + x, WIDTH - x, 63);
+                }
+            }
+        });
+
+        if (scalarAniNs == 0) {
+            scalarAniNs = aniNs;
+            scalarPcxNs = pcxNs;
+        }
+        printf("  %-7s %7.3f ms %5.2fx (%6d runs)  %7.3f ms %5.2fx (%6d runs)\n", set.name,
+            aniNs / 1e6, aniNs > 0 ? double(scalarAniNs) / double(aniNs) : 0.0, aniRuns,
+            pcxNs / 1e6, pcxNs > 0 ? double(scalarPcxNs) / double(pcxNs) : 0.0, pcxRuns);
+    }
+    return 0;
+}
@@ -0,0 +1,270 @@
+#include "BatchJob.h"
+#include "Animation/BuiltInPalettes.h"
+#include "Animation/Palette.h"
+#include "Formats/Import/AniImporter.h"
+#include "Formats/Import/ApngImporter.h"
+#include "Formats/Import/EffImporter.h"
+#include "Formats/Import/RawImporter.h"
+
+#include <QFileInfo>
+#include <algorithm>
+
+QList<QCommandLineOption> batchJobOptions() {
+    return {
+        {{"i", "in"}, "Input animation file or directory", "input"},
+        {{"o", "out"}, "Output path or folder", "output"},
+        {{"t", "type"}, "Export type: ani, eff, apng, raw", "type"},
+        {{"e", "ext"}, "Image extension (for raw export)", "ext"},
+        {{"d", "dds"}, "OPTIONAL: Dds export format", "format"},
+        {{"z", "apng-preset"}, "OPTIONAL: Apng export preset: fast, balanced (default) or max", "preset"},
+        {"dds-quality", "OPTIONAL: Dds compression quality (0.05-1.0, default 0.8)", "value"},
+        {"dds-mips", "OPTIONAL: Dds mip levels, 0 for the full chain (default) or 1 for no mips", "count"},
+        {"dds-encoder", "OPTIONAL: Dds encoder backend: cpu (default) or hpc", "backend"},
+        {"tga-rle", "OPTIONAL: Write run-length encoded tga frames"},
+        {{"n", "basename"}, "OPTIONAL: Basename override", "name"},
+        {{"q", "quantize"}, "OPTIONAL: Enable color quantization"},
+        {{"p", "palette"}, "OPTIONAL: Palette to use. Options: \"auto\", a built-in name (quoted if contains spaces), or file:<path>", "name"},
+        {{"v", "quality"}, "OPTIONAL: Quantization quality (1-100)", "value"},
+        {{"c", "maxcolors"}, "OPTIONAL: Max number of colors for quantization (used only in auto mode)", "value"},
+        {{"a", "no-transparency"}, "OPTIONAL: Disable transparency in quantization" },
+    };
+}
+
+JobOptionValues jobOptionValues(const QCommandLineParser& parser) {
+    JobOptionValues values;
+    for (const QCommandLineOption& option : batchJobOptions()) {
+        const QString name = option.names().last();
+        if (parser.isSet(name)) {
+            values[name] = option.valueName().isEmpty() ? QString("true") : parser.value(name);
+        }
+    }
+    return values;
+}
+
+namespace {
+    // Long option name for a key, which may also be a short name. Empty if unknown.
+    QString optionName(const QString& key) {
+        for (const QCommandLineOption& option : batchJobOptions()) {
+            if (option.names().contains(key)) {
+                return option.names().last();
+            }
+        }
+        return {};
+    }
+}
+
+bool jobOptionValuesFromJson(const QJsonObject& obj, JobOptionValues& values, QString* error) {
+    for (auto it = obj.begin(); it != obj.end(); ++it) {
+        const QString name = optionName(it.key());
+        if (name.isEmpty()) {
+            *error = QString("Unknown option: %1").arg(it.key());
+            return false;
+        }
+        const QJsonValue value = it.value();
+        if (value.isBool()) {
+            values[name] = value.toBool() ? "true" : "false";
+        } else if (value.isDouble()) {
+            values[name] = QString::number(value.toDouble());
+        } else if (value.isString()) {
+            values[name] = value.toString();
+        } else {
+            *error = QString("Option %1 must be a string, number or boolean").arg(it.key());
+            return false;
+        }
+    }
+    return true;
+}
+
+QJsonObject toJson(const JobOptionValues& values) {
+    QJsonObject obj;
+    for (auto it = values.begin(); it != values.end(); ++it) {
+        obj[it.key()] = it.value();
+    }
+    return obj;
+}
+
+void resolveJobPaths(JobOptionValues& values, const QDir& base) {
+    for (const char* key : { "in", "out" }) {
+        if (values.contains(key) && !values.value(key).isEmpty()) {
+            values[key] = QDir::cleanPath(base.absoluteFilePath(values.value(key)));
+        }
+    }
+    const QString palette = values.value("palette").trimmed();
+    if (palette.startsWith("file:", Qt::CaseInsensitive)) {
+        values["palette"] = "file:" + QDir::cleanPath(base.absoluteFilePath(palette.mid(5).trimmed()));
+    }
+}
+
+std::optional<AnimationType> inputTypeForPath(const QString& inPath) {
+    if (inPath.endsWith(".ani", Qt::CaseInsensitive)) {
+        return AnimationType::Ani;
+    } else if (inPath.endsWith(".eff")) {
+        return AnimationType::Eff;
+    } else if (inPath.endsWith(".apng") || inPath.endsWith(".png")) {
+        return AnimationType::Apng;
+    } else if (QFileInfo(inPath).isDir()) {
+        return AnimationType::Raw;
+    }
+    return std::nullopt;
+}
+
+std::optional<AnimationInfo> probeInput(AnimationType inputType, const QString& inPath) {
+    switch (inputType) {
+    case AnimationType::Ani:  return AniImporter().probe(inPath);
+    case AnimationType::Eff:  return EffImporter().probe(inPath);
+    case AnimationType::Apng: return ApngImporter().probe(inPath);
+    case AnimationType::Raw:  return RawImporter().probe(inPath);
+    }
+    return std::nullopt;
+}
+
+std::optional<BatchJob> jobFromOptions(const JobOptionValues& values, QString* error) {
+    auto fail = [error](const QString& message) -> std::optional<BatchJob> {
+        *error = message;
+        return std::nullopt;
+    };
+    auto isSet = [&values](const QString& name) {
+        return values.contains(name) && values.value(name) != "false";
+    };
+
+    BatchJob job;
+    job.inPath = values.value("in");
+    job.outPath = values.value("out");
+    job.baseName = values.value("basename");
+
+    const QString typeStr = values.value("type").toLower();
+    if (typeStr == "ani")      job.exportType = AnimationType::Ani;
+    else if (typeStr == "eff") job.exportType = AnimationType::Eff;
+    else if (typeStr == "apng")job.exportType = AnimationType::Apng;
+    else if (typeStr == "raw") job.exportType = AnimationType::Raw;
+    else {
+        return fail(QString("Invalid export type: %1").arg(typeStr));
+    }
+
+    const std::optional<AnimationType> inputType = inputTypeForPath(job.inPath);
+    if (!inputType) {
+        return fail("Could not determine animation type from input.");
+    }
+    job.inputType = *inputType;
+
+    QString extStr = values.value("ext").toLower();
+    if (extStr.isEmpty()) {
+        extStr = "png";
+    }
+    if (!isValidExtension(extStr)) {
+        return fail(QString("Invalid image extension: %1").arg(extStr));
+    }
+    job.imageFormat = formatFromExtension(extStr);
+
+    QString ddsFormat = values.value("dds").toLower();
+    if (ddsFormat.isEmpty()) {
+        ddsFormat = "bc7"; // Default to BC7 if not specified
+    }
+    if (!isValidCompressionFormat(ddsFormat)) {
+        return fail(QString("Invalid DDS compression format: %1").arg(ddsFormat));
+    }
+    job.compression = getCompressionFormatFromDescription(ddsFormat);
+
+    QString apngPreset = values.value("apng-preset").toLower();
+    if (apngPreset.isEmpty()) {
+        apngPreset = "balanced";
+    }
+    if (!isValidApngPreset(apngPreset)) {
+        return fail(QString("Invalid APNG preset: %1").arg(apngPreset));
+    }
+    job.apngPreset = getApngPresetFromDescription(apngPreset);
+
+    if (values.contains("dds-quality")) {
+        bool ok = false;
+        const float quality = values.value("dds-quality").toFloat(&ok);
+        if (!ok || quality < 0.05f || quality > 1.0f) {
+            return fail(QString("Invalid DDS quality: %1").arg(values.value("dds-quality")));
+        }
+        job.dds.quality = quality;
+    }
+
+    if (values.contains("dds-mips")) {
+        bool ok = false;
+        const int mips = values.value("dds-mips").toInt(&ok);
+        if (!ok || mips < 0) {
+            return fail(QString("Invalid DDS mip count: %1").arg(values.value("dds-mips")));
+        }
+        job.dds.mipLevels = mips;
+    }
+
+    QString ddsEncoder = values.value("dds-encoder").toLower();
+    if (ddsEncoder.isEmpty()) {
+        ddsEncoder = "cpu";
+    }
+    if (!isValidDdsBackend(ddsEncoder)) {
+        return fail(QString("Invalid DDS encoder: %1").arg(ddsEncoder));
+    }
+    job.dds.backend = getDdsBackendFromDescription(ddsEncoder);
+
+    job.tgaRle = isSet("tga-rle");
+
+    // Any quantization-related option turns quantization on
+    job.quantize =
+        isSet("quantize") ||
+        values.contains("palette") ||
+        values.contains("quality") ||
+        values.contains("maxcolors") ||
+        isSet("no-transparency");
+    job.palette = values.value("palette").trimmed();
+
+    bool ok = false;
+    job.quality = values.value("quality").toInt(&ok);
+    if (!ok || job.quality < 1 || job.quality > 100) job.quality = 100;
+
+    job.maxColors = values.value("maxcolors").toInt(&ok);
+    if (!ok || job.maxColors < 1 || job.maxColors > 256) job.maxColors = 256;
+
+    job.enforceTransparency = !isSet("no-transparency");
+
+    return job;
+}
+
+bool resolvePalette(const QString& palette, QVector<QRgb>& colors, QString* error) {
+    if (palette.startsWith("file:", Qt::CaseInsensitive)) {
+        const QString filePath = palette.mid(5).trimmed();
+        if (!Palette::loadPaletteAuto(filePath, colors)) {
+            *error = QString("Failed to load custom palette from %1").arg(filePath);
+            return false;
+        }
+        return true;
+    }
+
+    // Built-in palette name
+    const auto& builtins = getBuiltInPalettes();
+    auto it = std::find_if(builtins.begin(), builtins.end(), [&](const BuiltInPalette& bp) {
+        return bp.name.compare(palette, Qt::CaseInsensitive) == 0;
+        });
+    if (it == builtins.end()) {
+        *error = QString("Unknown built-in palette: %1").arg(palette);
+        return false;
+    }
+    colors = it->colors;
+    return true;
+}
+
+ConversionOptions conversionOptions(const BatchJob& job, const QVector<QRgb>& palette) {
+    ConversionOptions options;
+    if (job.quantize && job.exportType == AnimationType::Ani) {
+        QuantizeOptions quantize;
+        quantize.palette = palette;
+        quantize.quality = job.quality;
+        quantize.maxColors = job.maxColors;
+        quantize.enforceTransparency = job.enforceTransparency;
+        options.quantize = quantize;
+    }
+
+    options.output.type = job.exportType;
+    options.output.path = job.outPath;
+    options.output.imageFormat = job.imageFormat;
+    options.output.compression = job.compression;
+    options.output.apngPreset = job.apngPreset;
+    options.output.dds = job.dds;
+    options.output.tgaRle = job.tgaRle;
+    options.output.baseName = job.baseName;
+    return options;
+}
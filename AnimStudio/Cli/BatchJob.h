@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Animation/AnimationData.h"
+#include "Animation/ConversionPipeline.h"
+#include "Formats/ImageFormats.h"
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QJsonObject>
+#include <QList>
+#include <QMap>
+#include <QRgb>
+#include <QString>
+#include <QVector>
+#include <optional>
+
+// Everything one conversion needs, validated. Built from the command line for a single run,
+// or from a manifest entry or glob match for a batch of them.
+struct BatchJob {
+    QString inPath;
+    AnimationType inputType = AnimationType::Raw;
+    QString outPath;
+    AnimationType exportType = AnimationType::Apng;
+    ImageFormat imageFormat = ImageFormat::Png;         // Frame format for eff and raw exports
+    CompressionFormat compression = CompressionFormat::BC7;
+    ApngPreset apngPreset = ApngPreset::Balanced;
+    DdsSettings dds;
+    bool tgaRle = false;
+    QString baseName;                                   // Empty keeps the input's name
+
+    bool quantize = false;                              // Any quantization option was given
+    QString palette;                                    // "", "auto", a built-in name or file:<path>
+    int quality = 100;
+    int maxColors = 256;
+    bool enforceTransparency = true;
+};
+
+// Option values by long name, flags as "true"/"false". Later sources override earlier ones
+// when merged, so manifest entries can override command line defaults.
+using JobOptionValues = QMap<QString, QString>;
+
+// The options that describe a conversion (in, out, type, ext, dds..., quantization)
+QList<QCommandLineOption> batchJobOptions();
+
+// Values of the job options that were set on a parser
+JobOptionValues jobOptionValues(const QCommandLineParser& parser);
+
+// Option values from a JSON object (manifest entries, server requests). Keys are option names,
+// long or short; flags may be booleans and numbers may be numbers.
+bool jobOptionValuesFromJson(const QJsonObject& obj, JobOptionValues& values, QString* error);
+
+// The values as a JSON object of strings, which jobOptionValuesFromJson() reads back
+QJsonObject toJson(const JobOptionValues& values);
+
+// Make relative in, out and file: palette paths absolute, relative to base
+void resolveJobPaths(JobOptionValues& values, const QDir& base);
+
+// Input type from the path, the same rules a batch load uses. Nullopt if it can't be told.
+std::optional<AnimationType> inputTypeForPath(const QString& inPath);
+
+// Read only the input's headers, with the importer for its type. Nullopt if they can't be read.
+std::optional<AnimationInfo> probeInput(AnimationType inputType, const QString& inPath);
+
+// Validate the values and build a job. On failure returns nullopt and sets error.
+std::optional<BatchJob> jobFromOptions(const JobOptionValues& values, QString* error);
+
+// Resolve a non-auto palette argument (a built-in name or file:<path>) to its colors
+bool resolvePalette(const QString& palette, QVector<QRgb>& colors, QString* error);
+
+// Pipeline options for the job, with its palette argument already resolved to colors.
+// Quantization options only apply to ANI exports, others quantize only if they need to.
+ConversionOptions conversionOptions(const BatchJob& job, const QVector<QRgb>& palette);
@@ -0,0 +1,243 @@
+#include "BatchMode.h"
+#include "BatchJob.h"
+#include "BatchRunner.h"
+#include "ConsoleProgress.h"
+#include "ConversionServer.h"
+#include "ResultCache.h"
+#include "Animation/ConversionPipeline.h"
+#include "Animation/BuiltInPalettes.h"
+#include "Formats/ImageFormats.h"
+
+#include <QCommandLineParser>
+#include <QJsonDocument>
+#include <QMutex>
+#include <QTextStream>
+#include <cstdio>
+
+bool isBatchMode(const QStringList& args) {
+    for (int i = 1; i < args.size(); ++i) {
+        const QString& arg = args[i];
+        if (arg.startsWith('-')) {
+            return true;  // CLI flag detected
+        }
+    }
+    return false;  // No flags, treat as GUI launch with optional file
+}
+
+namespace {
+    // Read only the input's headers (no frame is decoded) and print what they say as JSON.
+    // The input type is picked the same way a batch load picks it.
+    int runProbe(const QString& inPath) {
+        const std::optional<AnimationType> type = inputTypeForPath(inPath);
+        if (!type) {
+            qWarning("Could not determine animation type from input.");
+            return 1;
+        }
+
+        const std::optional<AnimationInfo> info = probeInput(*type, inPath);
+        if (!info) {
+            fprintf(stderr, "Could not read headers of %s\n", qPrintable(inPath));
+            return 1;
+        }
+
+        QTextStream(stdout) << QJsonDocument(toJson(*info)).toJson(QJsonDocument::Indented);
+        return 0;
+    }
+}
+
+int runBatchMode(QCoreApplication& app) {
+    QCommandLineParser parser;
+    parser.setApplicationDescription("AnimStudio (batch mode)");
+    parser.addHelpOption();
+    parser.addOptions(batchJobOptions());
+    parser.addOptions(batchRunnerOptions());
+    parser.addOptions(serverOptions());
+    parser.addOptions(resultCacheOptions());
+    parser.addOptions({
+        {"list-palettes", "Print available built-in palettes and exit"},
+        {"list-extensions", "Print available image extensions and exit"},
+        {"list-compression", "Print available dds compression formats and exit"},
+        {"list-apng-presets", "Print available apng export presets and exit"},
+        {"list-dds-encoders", "Print available dds encoder backends and exit"},
+        {"probe", "Print the input's header information (size, frames, timing, keyframes) as JSON and exit. With --manifest or --inputs, one line per input"},
+    });
+
+    parser.process(app);
+
+    if (parser.isSet("help") || QCoreApplication::arguments().size() < 2) {
+        QTextStream(stdout) << parser.helpText();
+        QTextStream(stdout).flush();
+        return 0;
+    }
+
+    if (parser.isSet("list-palettes")) {
+        for (const auto& bp : getBuiltInPalettes()) {
+            QTextStream(stdout) << "\n  " << bp.name;
+        }
+        printf("\n");
+        return 0;
+    }
+
+    if (parser.isSet("list-extensions")) {
+        for (const auto& ext : availableExtensions()) {
+            QTextStream(stdout) << "\n  " << ext;
+        }
+        printf("\n");
+        return 0;
+    }
+
+    if (parser.isSet("list-compression")) {
+        for (const auto& fmt : availableCompressionFormats()) {
+            QTextStream(stdout) << "\n  " << fmt.left(3);
+        }
+        printf("\n");
+        return 0;
+    }
+
+    if (parser.isSet("list-apng-presets")) {
+        for (const auto& preset : availableApngPresets()) {
+            QTextStream(stdout) << "\n  " << preset;
+        }
+        printf("\n");
+        return 0;
+    }
+
+    if (parser.isSet("list-dds-encoders")) {
+        for (const auto& backend : availableDdsBackends()) {
+            QTextStream(stdout) << "\n  " << backend;
+        }
+        printf("\n");
+        return 0;
+    }
+
+    if (parser.isSet("probe")) {
+        return isBatchRun(parser) ? runBatchProbes(parser) : runProbe(parser.value("in"));
+    }
+
+    if (parser.isSet("serve")) {
+        return runServer(parser, app);
+    }
+
+    if (isBatchRun(parser)) {
+        return runBatchJobs(parser);
+    }
+
+    QString error;
+    const std::optional<BatchJob> job = jobFromOptions(jobOptionValues(parser), &error);
+    if (!job) {
+        qWarning("%s", qPrintable(error));
+        return 1;
+    }
+
+    if (parser.isSet("connect")) {
+        const int result = runClient(parser);
+        if (result >= 0) {
+            return result;
+        }
+        fprintf(stderr, "No server listening on %s, converting in-process\n", qPrintable(parser.value("connect")));
+    }
+
+    std::unique_ptr<ResultCache> cache = resultCacheFromOptions(parser, &error);
+    if (!cache && !error.isEmpty()) {
+        fprintf(stderr, "%s\n", qPrintable(error));
+        return 1;
+    }
+
+    // The palette is part of the cache key, so it is resolved before anything is loaded
+    ConversionOptions options = conversionOptions(*job, {});
+    const bool useAutoPalette = job->palette.isEmpty() || job->palette.compare("auto", Qt::CaseInsensitive) == 0;
+    if (options.quantize && !useAutoPalette && !resolvePalette(job->palette, options.quantize->palette, &error)) {
+        fprintf(stderr, "%s\n", qPrintable(error));
+        return 1;
+    }
+
+    ConsoleProgress progress;
+    QMutex progressMutex;
+    ConversionToken token;
+    token.setProgressCallback([&progress, &progressMutex](ConversionStage stage, float p) {
+        QMutexLocker lock(&progressMutex);
+        switch (stage) {
+        case ConversionStage::Import:   progress.update("Import", p); break;
+        case ConversionStage::Quantize: progress.update("Quantize", p); break;
+        case ConversionStage::Export:   progress.update("Export", p); break;
+        }
+        });
+    ConversionPipeline pipeline(&token);
+
+    // Load, quantize and export into exportDir, printing each step. Import and quantization
+    // failures are reported here, the export's result after it.
+    int frameCount = 0;
+    bool exported = false;
+    auto convert = [&](const QString& exportDir) -> ExportResult {
+        std::optional<AnimationData> data = pipeline.load(job->inputType, job->inPath, false, &error);
+        progress.finish();
+        printf("Import %s (%s): %d frame(s)\n",
+            data ? "successful" : "failed",
+            getTypeString(data ? data->animationType : job->inputType).toUtf8().constData(),
+            data ? data->frameCount : 0
+            );
+        fflush(stdout);
+        if (!data) {
+            fprintf(stderr, "Error: Import Failed - %s\n", qPrintable(error));
+            return ExportResult::fail(error);
+        }
+        frameCount = data->frameCount;
+
+        if (options.quantize) {
+            const QuantizeOptions& quantize = *options.quantize;
+
+            if (!useAutoPalette) {
+                if (job->palette.startsWith("file:", Qt::CaseInsensitive)) {
+                    printf("Reducing colors using custom palette from file: %s\n", qPrintable(job->palette.mid(5).trimmed()));
+                } else {
+                    printf("Reducing colors using built-in palette: %s\n", qPrintable(job->palette));
+                }
+            } else {
+                printf("Reducing colors with automatic palette generation\n");
+            }
+
+            // Print quantization settings
+            printf("Reudcing to Max Colors: %d\n", quantize.maxColors);
+            printf("Reducing colors with Quality: %d\n", quantize.quality);
+            printf("Reducing colors with Transparency: %s\n", quantize.enforceTransparency ? "enabled" : "disabled");
+
+            const bool success = pipeline.quantize(*data, quantize, &error);
+            progress.update("Quantize", 1.0f);
+            progress.finish();
+            printf("%s\n", success ? "Quantization complete" : "Quantization failed");
+            if (!success) {
+                fprintf(stderr, "Error: Color Reduction Failed - %s\n", qPrintable(error));
+                return ExportResult::fail(error);
+            }
+        }
+
+        ExportOptions output = options.output;
+        output.path = exportDir;
+        exported = true;
+        const ExportResult result = pipeline.exportAnimation(*data, output);
+        progress.finish();
+        return result;
+    };
+
+    bool hit = false;
+    const ExportResult result = cache
+        ? cache->runWith(job->inputType, job->inPath, options, convert, &hit)
+        : convert(options.output.path);
+    if (hit) {
+        printf("Export complete: reused the cached result\n");
+        fflush(stdout);
+        return 0;
+    }
+    if (!exported) {
+        return 2;
+    }
+
+    if (!result.success) {
+        fprintf(stderr, "Error: Export Failed - %s\n", result.errorMessage.isEmpty()
+            ? "An unknown error occurred while exporting."
+            : qPrintable(result.errorMessage));
+    }
+    printf("Export %s: %d frame(s)\n", result.success ? "complete" : "failed", frameCount);
+    fflush(stdout);
+    return result.success ? 0 : 2;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <QCoreApplication>
+#include <QStringList>
+
+// Command line front end, shared by AnimStudio (when started with flags) and animstudio-cli.
+// Only needs a QCoreApplication: no widgets, no GUI startup and nothing platform specific.
+
+// True if the arguments hold any flag, otherwise AnimStudio starts its GUI
+bool isBatchMode(const QStringList& args);
+
+// Parse the application's arguments and run the conversion, probe or listing they ask for.
+// Returns the process exit code.
+int runBatchMode(QCoreApplication& app);
@@ -0,0 +1,388 @@
+#include "BatchRunner.h"
+#include "BatchJob.h"
+#include "ResultCache.h"
+#include "Animation/ConversionPipeline.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QProcess>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+
+namespace {
+    // One manifest line, manifest job or glob match, before validation
+    struct JobEntry {
+        QString label;          // How the job is named in the output
+        JobOptionValues values;
+        QString error;          // Set if the entry itself could not be read
+    };
+
+    struct JobResult {
+        bool success = false;
+        bool cached = false;    // Reused from the result cache
+        QString error;
+        qint64 elapsedMs = 0;
+    };
+
+    bool readJsonManifest(const QByteArray& bytes, const QDir& base, const JobOptionValues& defaults,
+        QList<JobEntry>& entries, QString* error) {
+        QJsonParseError parseError;
+        const QJsonDocument doc = QJsonDocument::fromJson(bytes, &parseError);
+        if (doc.isNull()) {
+            *error = QString("Invalid JSON: %1").arg(parseError.errorString());
+            return false;
+        }
+
+        JobOptionValues shared = defaults;
+        QJsonArray jobs;
+        if (doc.isArray()) {
+            jobs = doc.array();
+        } else {
+            const QJsonObject root = doc.object();
+            JobOptionValues manifestDefaults;
+            if (!jobOptionValuesFromJson(root.value("defaults").toObject(), manifestDefaults, error)) {
+                return false;
+            }
+            resolveJobPaths(manifestDefaults, base);
+            shared.insert(manifestDefaults);
+            jobs = root.value("jobs").toArray();
+        }
+
+        for (int i = 0; i < jobs.size(); ++i) {
+            JobEntry entry;
+            entry.label = QString("jobs[%1]").arg(i);
+            entry.values = shared;
+
+            JobOptionValues own;
+            if (!jobs[i].isObject()) {
+                entry.error = "Job must be a JSON object";
+            } else if (jobOptionValuesFromJson(jobs[i].toObject(), own, &entry.error)) {
+                resolveJobPaths(own, base);
+                entry.values.insert(own);
+            }
+            if (entry.values.contains("in")) {
+                entry.label = entry.values.value("in");
+            }
+            entries.append(entry);
+        }
+        return true;
+    }
+
+    void readListManifest(const QByteArray& bytes, const QDir& base, const JobOptionValues& defaults,
+        QList<JobEntry>& entries) {
+        QCommandLineParser parser;
+        parser.addOptions(batchJobOptions());
+
+        const QList<QByteArray> lines = bytes.split('\n');
+        for (int i = 0; i < lines.size(); ++i) {
+            const QString line = QString::fromUtf8(lines[i]).trimmed();
+            if (line.isEmpty() || line.startsWith('#')) {
+                continue;
+            }
+
+            JobEntry entry;
+            entry.label = QString("line %1").arg(i + 1);
+            entry.values = defaults;
+
+            // The program name is only there because the parser skips the first argument
+            if (!parser.parse(QStringList{ "animstudio" } + QProcess::splitCommand(line))) {
+                entry.error = parser.errorText();
+            } else {
+                JobOptionValues own = jobOptionValues(parser);
+                const QStringList positional = parser.positionalArguments();
+                if (!own.contains("in") && positional.size() == 1) {
+                    own["in"] = positional[0];
+                } else if (!positional.isEmpty()) {
+                    entry.error = QString("Unexpected argument: %1").arg(positional.join(' '));
+                }
+                resolveJobPaths(own, base);
+                entry.values.insert(own);
+            }
+            if (entry.values.contains("in")) {
+                entry.label = entry.values.value("in");
+            }
+            entries.append(entry);
+        }
+    }
+
+    bool readManifest(const QString& path, const JobOptionValues& defaults, QList<JobEntry>& entries, QString* error) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            *error = QString("Cannot open manifest %1").arg(path);
+            return false;
+        }
+        const QByteArray bytes = file.readAll();
+        const QDir base = QFileInfo(path).absoluteDir();
+
+        const QByteArray start = bytes.trimmed().left(1);
+        if (path.endsWith(".json", Qt::CaseInsensitive) || start == "{" || start == "[") {
+            return readJsonManifest(bytes, base, defaults, entries, error);
+        }
+        readListManifest(bytes, base, defaults, entries);
+        return true;
+    }
+
+    // Files and directories matching the glob's file name part that can be loaded at all
+    void expandInputs(const QString& glob, const JobOptionValues& defaults, QList<JobEntry>& entries) {
+        const QFileInfo info(glob);
+        const QDir dir = info.dir();
+        const QStringList names = dir.entryList({ info.fileName() },
+            QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name);
+        for (const QString& name : names) {
+            const QString path = dir.filePath(name);
+            if (!inputTypeForPath(path)) {
+                continue;
+            }
+            JobEntry entry;
+            entry.label = path;
+            entry.values = defaults;
+            entry.values["in"] = path;
+            entries.append(entry);
+        }
+    }
+
+    // The entries of --manifest and --inputs. False, with the reason printed, if there are none.
+    bool collectEntries(const QCommandLineParser& parser, const JobOptionValues& defaults, QList<JobEntry>& entries) {
+        if (parser.isSet("manifest")) {
+            QString error;
+            if (!readManifest(parser.value("manifest"), defaults, entries, &error)) {
+                fprintf(stderr, "%s\n", qPrintable(error));
+                return false;
+            }
+        }
+        if (parser.isSet("inputs")) {
+            expandInputs(parser.value("inputs"), defaults, entries);
+        }
+        if (entries.isEmpty()) {
+            fprintf(stderr, "No jobs to run.\n");
+            return false;
+        }
+        return true;
+    }
+
+    int jobCount(const QCommandLineParser& parser) {
+        if (!parser.isSet("jobs")) {
+            return QThread::idealThreadCount();
+        }
+        bool ok = false;
+        const int count = parser.value("jobs").toInt(&ok);
+        if (!ok || count < 1) {
+            fprintf(stderr, "Invalid job count: %s\n", qPrintable(parser.value("jobs")));
+            return 0;
+        }
+        return count;
+    }
+}
+
+QList<QCommandLineOption> batchRunnerOptions() {
+    return {
+        {"manifest", "Run every job in a manifest: JSON, or one job per line written like the command line. Other options are the jobs' defaults", "file"},
+        {"inputs", "Run a job for every input matching a glob (wildcards in the file name only, quote it). Other options apply to every job", "glob"},
+        {"jobs", "OPTIONAL: Jobs to run at once with --manifest or --inputs (default: one per core)", "count"},
+    };
+}
+
+bool isBatchRun(const QCommandLineParser& parser) {
+    return parser.isSet("manifest") || parser.isSet("inputs");
+}
+
+int runBatchJobs(const QCommandLineParser& parser) {
+    const JobOptionValues defaults = jobOptionValues(parser);
+
+    if (parser.isSet("inputs") && defaults.contains("basename")) {
+        fprintf(stderr, "--basename can't be used with --inputs, every match would get the same name\n");
+        return 1;
+    }
+
+    const int workers = jobCount(parser);
+    if (workers < 1) {
+        return 1;
+    }
+
+    QString cacheError;
+    const std::unique_ptr<ResultCache> cache = resultCacheFromOptions(parser, &cacheError);
+    if (!cache && !cacheError.isEmpty()) {
+        fprintf(stderr, "%s\n", qPrintable(cacheError));
+        return 1;
+    }
+
+    QList<JobEntry> entries;
+    if (!collectEntries(parser, defaults, entries)) {
+        return 1;
+    }
+
+    // Validate everything up front, a bad entry fails on its own and the rest still run
+    const int total = int(entries.size());
+    QVector<std::optional<BatchJob>> jobs(total);
+    QVector<JobResult> results(total);
+    for (int i = 0; i < total; ++i) {
+        QString error = entries[i].error;
+        if (error.isEmpty()) {
+            jobs[i] = jobFromOptions(entries[i].values, &error);
+        }
+        results[i].error = error;
+    }
+
+    // Each palette is loaded once for all the jobs using it. The quantizer's mappers for
+    // them are shared through PaletteMapper::shared().
+    QMap<QString, QVector<QRgb>> palettes;
+    QMap<QString, QString> paletteErrors;
+    for (int i = 0; i < total; ++i) {
+        if (!jobs[i] || !jobs[i]->quantize) {
+            continue;
+        }
+        const QString& arg = jobs[i]->palette;
+        if (arg.isEmpty() || arg.compare("auto", Qt::CaseInsensitive) == 0) {
+            continue;
+        }
+        if (!palettes.contains(arg) && !paletteErrors.contains(arg)) {
+            QVector<QRgb> colors;
+            QString error;
+            if (resolvePalette(arg, colors, &error)) {
+                palettes.insert(arg, colors);
+            } else {
+                paletteErrors.insert(arg, error);
+            }
+        }
+        if (paletteErrors.contains(arg)) {
+            results[i].error = paletteErrors.value(arg);
+            jobs[i].reset();
+        }
+    }
+
+    QVector<int> order;
+    for (int i = 0; i < total; ++i) {
+        if (jobs[i]) {
+            order.append(i);
+        }
+    }
+
+    // The cores are split between the jobs running at once. Each job's importer, quantizer and
+    // exporter pools get its share, so a full run keeps about one thread per core busy.
+    const int concurrent = std::max(1, std::min(workers, int(order.size())));
+    const int perJob = std::max(1, QThread::idealThreadCount() / concurrent);
+
+    printf("Running %d job(s), %d at a time\n", total, concurrent);
+    fflush(stdout);
+
+    QMutex printMutex;
+    int finished = 0;
+    auto report = [&](int i) {
+        QMutexLocker lock(&printMutex);
+        ++finished;
+        const JobResult& r = results[i];
+        if (r.success && r.cached) {
+            printf("[%d/%d] ok      %s (cached)\n", finished, total, qPrintable(entries[i].label));
+        } else if (r.success) {
+            printf("[%d/%d] ok      %s (%.1f s)\n", finished, total, qPrintable(entries[i].label), r.elapsedMs / 1000.0);
+        } else {
+            printf("[%d/%d] FAILED  %s: %s\n", finished, total, qPrintable(entries[i].label), qPrintable(r.error));
+        }
+        fflush(stdout);
+    };
+
+    for (int i = 0; i < total; ++i) {
+        if (!jobs[i]) {
+            report(i);
+        }
+    }
+
+    // Each worker takes the next job as soon as it is free, so short jobs fill in around
+    // long ones
+    std::atomic<int> next{ 0 };
+    QThreadPool pool;
+    pool.setMaxThreadCount(concurrent);
+    for (int w = 0; w < pool.maxThreadCount(); ++w) {
+        pool.start([&]() {
+            for (int n = next++; n < order.size(); n = next++) {
+                const int i = order[n];
+                QElapsedTimer timer;
+                timer.start();
+                ConversionOptions options = conversionOptions(*jobs[i], palettes.value(jobs[i]->palette));
+                options.workerCount = perJob;
+                const ExportResult result = cache
+                    ? cache->run(jobs[i]->inputType, jobs[i]->inPath, options, nullptr, &results[i].cached)
+                    : ConversionPipeline().run(jobs[i]->inputType, jobs[i]->inPath, options);
+                results[i].success = result.success;
+                results[i].error = result.errorMessage.isEmpty() && !result.success
+                    ? QString("An unknown error occurred while exporting.")
+                    : result.errorMessage;
+                results[i].elapsedMs = timer.elapsed();
+                report(i);
+            }
+        });
+    }
+    pool.waitForDone();
+
+    QStringList failures;
+    for (int i = 0; i < total; ++i) {
+        if (!results[i].success) {
+            failures.append(QString("  %1: %2").arg(entries[i].label, results[i].error));
+        }
+    }
+
+    const int cachedCount = int(std::count_if(results.begin(), results.end(), [](const JobResult& r) { return r.cached; }));
+    printf("\n%d succeeded, %d failed", total - int(failures.size()), int(failures.size()));
+    if (cache) {
+        printf(", %d from the cache", cachedCount);
+    }
+    printf("\n");
+    for (const QString& failure : failures) {
+        printf("%s\n", qPrintable(failure));
+    }
+    fflush(stdout);
+    return failures.isEmpty() ? 0 : 2;
+}
+
+int runBatchProbes(const QCommandLineParser& parser) {
+    const int workers = jobCount(parser);
+    QList<JobEntry> entries;
+    if (workers < 1 || !collectEntries(parser, jobOptionValues(parser), entries)) {
+        return 1;
+    }
+
+    QMutex printMutex;
+    std::atomic<bool> anyFailed{ false };
+    auto probe = [&](const JobEntry& entry) {
+        const QString inPath = entry.values.value("in");
+        QJsonObject line;
+        QString error = entry.error;
+        if (error.isEmpty()) {
+            const std::optional<AnimationType> type = inputTypeForPath(inPath);
+            if (!type) {
+                error = "Could not determine animation type from input.";
+            } else if (const std::optional<AnimationInfo> info = probeInput(*type, inPath)) {
+                line = toJson(*info);
+            } else {
+                error = "Could not read headers";
+            }
+        }
+        line.insert("input", inPath.isEmpty() ? entry.label : inPath);
+        if (!error.isEmpty()) {
+            line.insert("error", error);
+            anyFailed = true;
+        }
+
+        const QByteArray text = QJsonDocument(line).toJson(QJsonDocument::Compact);
+        QMutexLocker lock(&printMutex);
+        printf("%s\n", text.constData());
+        fflush(stdout);
+    };
+
+    // Only headers are read, so this is mostly waiting on the disk. Lines come out as inputs
+    // finish, each names its input.
+    QThreadPool pool;
+    pool.setMaxThreadCount(workers);
+    QtConcurrent::blockingMap(&pool, entries, probe);
+    return anyFailed ? 2 : 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QList>
+
+// Many conversions in one process. Jobs come from a manifest, a glob of inputs or both, each
+// with the single-run options (given on the command line as defaults) and its own overrides.
+//
+// Manifests are either JSON:
+//   { "defaults": { "type": "ani", "palette": "Hud" },
+//     "jobs": [ { "in": "intro.apng", "out": "build" }, { "in": "frames", "type": "eff" } ] }
+// (a plain array of jobs works too) or a text list with one job per line, written like the
+// command line ("-i intro.apng -o build -t ani"), or just an input path. Blank lines and lines
+// starting with # are skipped. Relative paths in a manifest are relative to the manifest.
+
+// --manifest, --inputs and --jobs
+QList<QCommandLineOption> batchRunnerOptions();
+
+// True if the parsed arguments ask for a multi-job run
+bool isBatchRun(const QCommandLineParser& parser);
+
+// Run the jobs --jobs at a time (default one per core) with the cores split between them, print
+// a line per job as it finishes and a summary at the end. Returns 0 if every job succeeded, 2 if any failed and 1 if the jobs
+// could not be read at all.
+int runBatchJobs(const QCommandLineParser& parser);
+
+// --probe with --manifest or --inputs: read each input's headers on a pool (--jobs) and print
+// them as one JSON object per line, with "input" and, if it failed, "error". Other job options
+// are ignored. Returns 0 if every input could be read, 2 if any could not.
+int runBatchProbes(const QCommandLineParser& parser);
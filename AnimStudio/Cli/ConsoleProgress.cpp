@@ -0,0 +1,54 @@
+#include "ConsoleProgress.h"
+#include <algorithm>
+#include <cmath>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+    bool isTerminal(FILE* file) {
+#ifdef _WIN32
+        return _isatty(_fileno(file)) != 0;
+#else
+        return isatty(fileno(file)) != 0;
+#endif
+    }
+}
+
+ConsoleProgress::ConsoleProgress(FILE* out)
+    : m_out(out)
+    , m_interactive(isTerminal(out))
+{
+}
+
+void ConsoleProgress::update(const char* stage, float fraction) {
+    const int percent = int(std::lround(std::clamp(fraction, 0.0f, 1.0f) * 100.0f));
+    const QByteArray line = QByteArray("[") + stage + "] " + QByteArray::number(percent) + "%";
+    if (line == m_line) {
+        return;
+    }
+
+    if (m_interactive) {
+        // Blank out whatever is left of a longer previous line
+        const int pad = std::max(0, int(m_line.size() - line.size()));
+        fprintf(m_out, "\r%s%*s", line.constData(), pad, "");
+        fflush(m_out);
+        m_lineOpen = true;
+    } else if (percent == 100) {
+        fprintf(m_out, "%s\n", line.constData());
+        fflush(m_out);
+    }
+    m_line = line;
+}
+
+void ConsoleProgress::finish() {
+    if (m_lineOpen) {
+        fputc('\n', m_out);
+        fflush(m_out);
+        m_lineOpen = false;
+    }
+    m_line.clear();
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <QByteArray>
+#include <cstdio>
+
+// "[Import] 42%" progress on a single console line, redrawn in place with a carriage return
+// so it works on any terminal. When the output is not a terminal (a log file, a build farm job)
+// only the 100% line of each stage is written, so logs don't fill up with redraws.
+class ConsoleProgress {
+public:
+    explicit ConsoleProgress(FILE* out = stdout);
+
+    // Show stage at fraction (0.0 to 1.0). Nothing is written if the text would not change.
+    void update(const char* stage, float fraction);
+
+    // End the progress line, if one is showing, so other output starts on a fresh line
+    void finish();
+
+private:
+    FILE* m_out;
+    bool m_interactive;
+    bool m_lineOpen = false; // The cursor is still on the progress line
+    QByteArray m_line;       // Text last shown
+};
@@ -0,0 +1,401 @@
+#include "ConversionServer.h"
+#include "BatchJob.h"
+#include "ConsoleProgress.h"
+#include "ResultCache.h"
+#include "Animation/ConversionPipeline.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QPointer>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace {
+    const char* stageName(ConversionStage stage) {
+        switch (stage) {
+        case ConversionStage::Import:   return "import";
+        case ConversionStage::Quantize: return "quantize";
+        case ConversionStage::Export:   return "export";
+        }
+        return "";
+    }
+
+    // A client of the server: the stdin/stdout pipe or one socket connection
+    struct Connection {
+        std::function<void(const QByteArray&)> write;           // Only called on the server's thread
+        QHash<QString, std::shared_ptr<ConversionToken>> jobs;  // Running, by id
+        bool open = true;
+    };
+
+    // Lives on the main thread. Jobs run on m_pool and post their progress and results back.
+    // Their stages run on m_stagePool, which must be a different pool: a job blocks its
+    // m_pool thread while it waits for its stage work.
+    class ConversionServer : public QObject {
+    public:
+        ConversionServer(int maxJobs, std::unique_ptr<ResultCache> cache)
+            : m_cache(std::move(cache))
+        {
+            m_pool.setMaxThreadCount(std::max(1, maxJobs));
+            // Like a batch run, the cores are split between the jobs that can run at once
+            m_workersPerJob = std::max(1, QThread::idealThreadCount() / m_pool.maxThreadCount());
+            m_pool.setExpiryTimeout(-1); // Keep the threads between jobs
+            m_stagePool.setMaxThreadCount(std::max(1, QThread::idealThreadCount()));
+            m_stagePool.setExpiryTimeout(-1);
+        }
+
+        void serveStdio() {
+            auto connection = std::make_shared<Connection>();
+            connection->write = [](const QByteArray& line) {
+                fwrite(line.constData(), 1, size_t(line.size()), stdout);
+                fflush(stdout);
+            };
+
+            // Reading stdin blocks, so it gets its own thread. Detached, since it can still be
+            // waiting for input when a shutdown request ends the process.
+            std::thread([this, connection]() {
+                std::string line;
+                while (std::getline(std::cin, line)) {
+                    const QByteArray bytes = QByteArray::fromStdString(line);
+                    QMetaObject::invokeMethod(this, [this, connection, bytes]() {
+                        handleLine(connection, bytes);
+                    }, Qt::QueuedConnection);
+                }
+                QMetaObject::invokeMethod(this, [this]() { shutdown(); }, Qt::QueuedConnection);
+            }).detach();
+        }
+
+        bool listen(const QString& name, QString* error) {
+            m_server = new QLocalServer(this);
+            bool listening = m_server->listen(name);
+            if (!listening && m_server->serverError() == QAbstractSocket::AddressInUseError) {
+                // Left behind by a server that died, unless one still answers
+                QLocalSocket probe;
+                probe.connectToServer(name);
+                if (probe.waitForConnected(500)) {
+                    *error = QString("A server is already listening on %1").arg(name);
+                    return false;
+                }
+                QLocalServer::removeServer(name);
+                listening = m_server->listen(name);
+            }
+            if (!listening) {
+                *error = QString("Cannot listen on %1: %2").arg(name, m_server->errorString());
+                return false;
+            }
+
+            connect(m_server, &QLocalServer::newConnection, this, [this]() {
+                while (QLocalSocket* socket = m_server->nextPendingConnection()) {
+                    acceptSocket(socket);
+                }
+            });
+            return true;
+        }
+
+    private:
+        void acceptSocket(QLocalSocket* socket) {
+            auto connection = std::make_shared<Connection>();
+            QPointer<QLocalSocket> guard(socket);
+            connection->write = [guard](const QByteArray& line) {
+                if (guard) guard->write(line);
+            };
+
+            auto readLines = [this, socket, connection]() {
+                while (socket->canReadLine()) {
+                    handleLine(connection, socket->readLine());
+                }
+            };
+            connect(socket, &QLocalSocket::readyRead, this, readLines);
+            connect(socket, &QLocalSocket::disconnected, this, [socket, connection]() {
+                // Nobody is waiting for these anymore
+                connection->open = false;
+                for (const auto& token : connection->jobs) {
+                    token->cancel();
+                }
+                socket->deleteLater();
+            });
+            readLines();
+        }
+
+        void handleLine(const std::shared_ptr<Connection>& connection, const QByteArray& line) {
+            const QByteArray trimmed = line.trimmed();
+            if (trimmed.isEmpty()) {
+                return;
+            }
+
+            QJsonParseError parseError;
+            const QJsonDocument doc = QJsonDocument::fromJson(trimmed, &parseError);
+            if (!doc.isObject()) {
+                sendError(connection, doc.isNull()
+                    ? QString("Invalid JSON: %1").arg(parseError.errorString())
+                    : QString("Request must be a JSON object"));
+                return;
+            }
+
+            const QJsonObject request = doc.object();
+            const QString type = request.value("type").toString("convert");
+            QString id = request.value("id").toVariant().toString();
+
+            if (type == "shutdown") {
+                shutdown();
+            } else if (type == "cancel") {
+                if (!connection->jobs.contains(id)) {
+                    sendError(connection, QString("No running job with id %1").arg(id));
+                    return;
+                }
+                connection->jobs.value(id)->cancel();
+            } else if (type == "convert") {
+                if (id.isEmpty()) {
+                    id = QString::number(m_nextId++);
+                }
+                if (connection->jobs.contains(id)) {
+                    sendError(connection, QString("A job with id %1 is already running").arg(id));
+                    return;
+                }
+                startJob(connection, id, request.value("job").toObject());
+            } else {
+                sendError(connection, QString("Unknown request type: %1").arg(type));
+            }
+        }
+
+        void startJob(const std::shared_ptr<Connection>& connection, const QString& id, const QJsonObject& jobObject) {
+            auto fail = [&](const QString& error) {
+                send(connection, { {"id", id}, {"event", "done"}, {"success", false}, {"error", error}, {"elapsedMs", 0} });
+            };
+
+            if (m_shuttingDown) {
+                fail("The server is shutting down");
+                return;
+            }
+
+            JobOptionValues values;
+            QString error;
+            if (!jobOptionValuesFromJson(jobObject, values, &error)) {
+                fail(error);
+                return;
+            }
+            const std::optional<BatchJob> job = jobFromOptions(values, &error);
+            if (!job) {
+                fail(error);
+                return;
+            }
+
+            QVector<QRgb> palette;
+            if (!paletteFor(job->palette, palette, &error)) {
+                fail(error);
+                return;
+            }
+
+            // Progress arrives on the job's threads; only whole percent changes are sent
+            auto token = std::make_shared<ConversionToken>();
+            auto lastStep = std::make_shared<std::atomic<int>>(-1);
+            token->setProgressCallback([this, connection, id, lastStep](ConversionStage stage, float p) {
+                const int step = int(stage) * 1000 + int(p * 100.0f);
+                if (lastStep->exchange(step) == step) {
+                    return;
+                }
+                QMetaObject::invokeMethod(this, [this, connection, id, stage, p]() {
+                    send(connection, { {"id", id}, {"event", "progress"}, {"stage", stageName(stage)}, {"progress", double(p)} });
+                }, Qt::QueuedConnection);
+            });
+
+            connection->jobs.insert(id, token);
+            ++m_running;
+            send(connection, { {"id", id}, {"event", "accepted"} });
+
+            QElapsedTimer timer;
+            timer.start();
+            ConversionOptions options = conversionOptions(*job, palette);
+            options.workerCount = m_workersPerJob;
+            options.threadPool = &m_stagePool;
+            auto hit = std::make_shared<bool>(false);
+            QFuture<ExportResult> future = m_cache
+                ? QtConcurrent::run(&m_pool, [cache = m_cache.get(), inputType = job->inputType, inPath = job->inPath, options, token, hit]() {
+                    return cache->run(inputType, inPath, options, token.get(), hit.get());
+                })
+                : ConversionPipeline::runAsync(job->inputType, job->inPath, options, token.get(), &m_pool);
+            future.then(this, [this, connection, id, token, timer, hit](ExportResult result) {
+                connection->jobs.remove(id);
+                --m_running;
+
+                QJsonObject done{ {"id", id}, {"event", "done"}, {"success", result.success}, {"elapsedMs", timer.elapsed()} };
+                if (m_cache) {
+                    done["cached"] = *hit;
+                }
+                if (!result.success) {
+                    done["error"] = result.errorMessage.isEmpty()
+                        ? QString("An unknown error occurred while exporting.")
+                        : result.errorMessage;
+                }
+                send(connection, done);
+                quitIfDone();
+            });
+        }
+
+        // Palette colors for a job's palette argument, loaded once and kept for later jobs.
+        // Palette files are keyed by their modification time too, so an edited file is reloaded.
+        bool paletteFor(const QString& arg, QVector<QRgb>& colors, QString* error) {
+            if (arg.isEmpty() || arg.compare("auto", Qt::CaseInsensitive) == 0) {
+                return true;
+            }
+
+            QString key = arg;
+            if (arg.startsWith("file:", Qt::CaseInsensitive)) {
+                const QFileInfo info(arg.mid(5).trimmed());
+                key += QString("|%1|%2").arg(info.lastModified().toMSecsSinceEpoch()).arg(info.size());
+            }
+
+            auto it = m_palettes.constFind(key);
+            if (it != m_palettes.constEnd()) {
+                colors = it.value();
+                return true;
+            }
+            if (!resolvePalette(arg, colors, error)) {
+                return false;
+            }
+            m_palettes.insert(key, colors);
+            return true;
+        }
+
+        void send(const std::shared_ptr<Connection>& connection, const QJsonObject& message) {
+            if (connection->open) {
+                connection->write(QJsonDocument(message).toJson(QJsonDocument::Compact) + '\n');
+            }
+        }
+
+        void sendError(const std::shared_ptr<Connection>& connection, const QString& error) {
+            send(connection, { {"event", "error"}, {"error", error} });
+        }
+
+        // Stop taking jobs and quit once the running ones are done
+        void shutdown() {
+            m_shuttingDown = true;
+            if (m_server) {
+                m_server->close();
+            }
+            quitIfDone();
+        }
+
+        void quitIfDone() {
+            if (m_shuttingDown && m_running == 0) {
+                QCoreApplication::quit();
+            }
+        }
+
+        QThreadPool m_pool;
+        QThreadPool m_stagePool;                    // Shared by every job's stages, see StagePool
+        std::unique_ptr<ResultCache> m_cache;       // Null without --cache-dir
+        QLocalServer* m_server = nullptr;
+        QHash<QString, QVector<QRgb>> m_palettes;   // Resolved palette arguments
+        int m_workersPerJob = 0;
+        int m_running = 0;
+        int m_nextId = 1;
+        bool m_shuttingDown = false;
+    };
+
+    // Stage label for the client's progress line, the same as a local run shows
+    const char* stageLabel(const QString& stage) {
+        if (stage == "import") return "Import";
+        if (stage == "quantize") return "Quantize";
+        return "Export";
+    }
+}
+
+QList<QCommandLineOption> serverOptions() {
+    return {
+        {"serve", "Run as a conversion server, reading JSON requests from stdin until it closes (or from --socket)"},
+        {"socket", "OPTIONAL: Local socket name for --serve to listen on instead of stdin/stdout", "name"},
+        {"connect", "Hand the conversion to the server listening on this socket name, or convert in-process if there is none", "name"},
+    };
+}
+
+int runServer(const QCommandLineParser& parser, QCoreApplication& app) {
+    int workers = QThread::idealThreadCount();
+    if (parser.isSet("jobs")) {
+        bool ok = false;
+        workers = parser.value("jobs").toInt(&ok);
+        if (!ok || workers < 1) {
+            fprintf(stderr, "Invalid job count: %s\n", qPrintable(parser.value("jobs")));
+            return 1;
+        }
+    }
+
+    QString error;
+    std::unique_ptr<ResultCache> cache = resultCacheFromOptions(parser, &error);
+    if (!cache && !error.isEmpty()) {
+        fprintf(stderr, "%s\n", qPrintable(error));
+        return 1;
+    }
+
+    // Not deleted: the stdin reader may post to it until the process is gone
+    auto* server = new ConversionServer(workers, std::move(cache));
+    if (parser.isSet("socket")) {
+        if (!server->listen(parser.value("socket"), &error)) {
+            fprintf(stderr, "%s\n", qPrintable(error));
+            return 1;
+        }
+        fprintf(stderr, "Listening on %s\n", qPrintable(parser.value("socket")));
+    } else {
+        server->serveStdio();
+    }
+    return app.exec();
+}
+
+int runClient(const QCommandLineParser& parser) {
+    QLocalSocket socket;
+    socket.connectToServer(parser.value("connect"));
+    if (!socket.waitForConnected(1000)) {
+        return -1;
+    }
+
+    // The server has its own working directory
+    JobOptionValues values = jobOptionValues(parser);
+    resolveJobPaths(values, QDir::current());
+
+    const QJsonObject request{ {"type", "convert"}, {"id", "1"}, {"job", toJson(values)} };
+    socket.write(QJsonDocument(request).toJson(QJsonDocument::Compact) + '\n');
+
+    ConsoleProgress progress;
+    for (;;) {
+        while (!socket.canReadLine()) {
+            if (!socket.waitForReadyRead(-1)) {
+                progress.finish();
+                fprintf(stderr, "Error: Lost the connection to the server\n");
+                return 2;
+            }
+        }
+
+        const QJsonObject message = QJsonDocument::fromJson(socket.readLine()).object();
+        const QString event = message.value("event").toString();
+        if (event == "progress") {
+            progress.update(stageLabel(message.value("stage").toString()), float(message.value("progress").toDouble()));
+        } else if (event == "done") {
+            progress.finish();
+            const bool success = message.value("success").toBool();
+            if (!success) {
+                fprintf(stderr, "Error: %s\n", qPrintable(message.value("error").toString()));
+            }
+            printf("Conversion %s\n", success ? "complete" : "failed");
+            fflush(stdout);
+            return success ? 0 : 2;
+        } else if (event == "error") {
+            progress.finish();
+            fprintf(stderr, "Error: %s\n", qPrintable(message.value("error").toString()));
+            return 1;
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QList>
+
+// Long-running conversion server. Build tools that convert many animations keep one process
+// around instead of paying for startup, Qt and palette tables on every conversion.
+//
+// The protocol is JSON, one object per line, over stdin/stdout (--serve) or a local socket
+// (--serve --socket <name>, a named pipe on Windows). Requests:
+//   { "type": "convert", "id": "a1", "job": { "in": "intro.apng", "out": "build", "type": "ani" } }
+//   { "type": "cancel", "id": "a1" }
+//   { "type": "shutdown" }
+// Job keys are the batch options, as in a manifest; paths should be absolute. Each job gets
+//   { "id": "a1", "event": "accepted" }
+//   { "id": "a1", "event": "progress", "stage": "quantize", "progress": 0.42 }
+//   { "id": "a1", "event": "done", "success": false, "error": "...", "elapsedMs": 812 }
+// ("cached" is added to done events when the server runs with --cache-dir)
+// and lines that can't be understood get { "event": "error", "error": "..." }.
+//
+// Jobs run concurrently on a pool that lives as long as the server (--jobs, default one per
+// core). Their stages (decoding, quantizing, encoding) share a second long-lived pool with a
+// thread per core (see StagePool), so no job starts threads of its own. Loaded palettes and
+// their PaletteMapper tables stay cached between jobs, and with --cache-dir so do the results
+// (see ResultCache).
+
+// --serve, --socket and --connect
+QList<QCommandLineOption> serverOptions();
+
+// Serve until stdin closes, or with --socket until a shutdown request. Returns the exit code.
+int runServer(const QCommandLineParser& parser, QCoreApplication& app);
+
+// Send the command line's single conversion to the server named by --connect and show its
+// progress like a local run. Returns the exit code, or -1 if no server is listening so the
+// caller can convert in-process instead.
+int runClient(const QCommandLineParser& parser);
@@ -0,0 +1,300 @@
+#include "ResultCache.h"
+#include "Formats/Import/EffImporter.h"
+#include "Formats/Import/RawImporter.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QUuid>
+#include <filesystem>
+
+namespace {
+    // Part of every key. Bump it when an exporter's output changes, so old entries stop matching.
+    const char* CACHE_FORMAT = "AnimStudio result cache 1";
+
+    // Staging folders live in here, next to the entries
+    const char* STAGING_DIR = ".staging";
+
+    const qint64 DEFAULT_MAX_MB = 2048;
+
+    qint64 treeSize(const QString& dir) {
+        qint64 size = 0;
+        QDirIterator it(dir, QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            size += it.nextFileInfo().size();
+        }
+        return size;
+    }
+
+    std::filesystem::path fsPath(const QString& path) {
+        return std::filesystem::path(path.toStdWString());
+    }
+
+    // Mark an entry as just used for eviction
+    void touch(const QString& dir) {
+        std::error_code ec;
+        std::filesystem::last_write_time(fsPath(dir), std::filesystem::file_time_type::clock::now(), ec);
+    }
+}
+
+ResultCache::ResultCache(const QString& dir, qint64 maxBytes, bool hardlink)
+    : m_dir(QDir(dir).absolutePath())
+    , m_maxBytes(maxBytes)
+    , m_hardlink(hardlink)
+{
+}
+
+QString ResultCache::key(AnimationType inputType, const QString& inPath, const ConversionOptions& options) const {
+    QStringList files;
+    switch (inputType) {
+    case AnimationType::Ani:
+    case AnimationType::Apng: files = { inPath }; break;
+    case AnimationType::Eff:  files = EffImporter().sourceFiles(inPath); break;
+    case AnimationType::Raw:  files = RawImporter().sourceFiles(inPath); break;
+    }
+    if (files.isEmpty()) {
+        return {};
+    }
+
+    // Not for security, just a quick hash that spreads well
+    QCryptographicHash hash(QCryptographicHash::Md5);
+
+    // File names count, the animation's name comes from them
+    QByteArray header;
+    QDataStream out(&header, QIODevice::WriteOnly);
+    out << QString(CACHE_FORMAT) << int(inputType) << int(files.size());
+    hash.addData(header);
+    for (const QString& path : files) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return {};
+        }
+        QByteArray name;
+        QDataStream(&name, QIODevice::WriteOnly) << QFileInfo(path).fileName() << file.size();
+        hash.addData(name);
+        if (!hash.addData(&file)) {
+            return {};
+        }
+    }
+
+    // Everything the output depends on, whether or not this export type uses it
+    const ExportOptions& o = options.output;
+    QByteArray settings;
+    QDataStream s(&settings, QIODevice::WriteOnly);
+    s << int(o.type) << int(o.imageFormat) << int(o.compression) << int(o.apngPreset)
+      << o.dds.quality << o.dds.mipLevels << int(o.dds.backend) << o.tgaRle << o.baseName;
+    s << options.quantize.has_value();
+    if (options.quantize) {
+        const QuantizeOptions& q = *options.quantize;
+        s << q.palette << q.quality << q.maxColors << q.enforceTransparency;
+    }
+    hash.addData(settings);
+
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+ExportResult ResultCache::runWith(AnimationType inputType, const QString& inPath, const ConversionOptions& options,
+    const ConvertFn& convert, bool* hit) {
+    if (hit) *hit = false;
+
+    const QString entryKey = key(inputType, inPath, options);
+    if (entryKey.isEmpty()) {
+        // Let the import report what's wrong with the input
+        return convert(options.output.path);
+    }
+
+    if (restore(entryKey, options.output.path)) {
+        if (hit) *hit = true;
+        return ExportResult::ok();
+    }
+
+    const QString staging = stagingDir();
+    if (staging.isEmpty()) {
+        return convert(options.output.path);
+    }
+
+    const ExportResult result = convert(staging);
+    if (!result.success) {
+        discard(staging);
+        return result;
+    }
+    return store(entryKey, staging, options.output.path);
+}
+
+ExportResult ResultCache::run(AnimationType inputType, const QString& inPath, const ConversionOptions& options,
+    ConversionToken* token, bool* hit) {
+    return runWith(inputType, inPath, options, [&](const QString& exportDir) {
+        ConversionOptions staged = options;
+        staged.output.path = exportDir;
+        return ConversionPipeline(token).run(inputType, inPath, staged);
+    }, hit);
+}
+
+bool ResultCache::restore(const QString& key, const QString& outputDir) {
+    QReadLocker lock(&m_entriesLock);
+    const QString entry = QDir(m_dir).filePath(key);
+    if (!QFileInfo(entry).isDir()) {
+        return false;
+    }
+    // Can still fail if another process evicts the entry meanwhile, then it's just a miss
+    if (!copyTree(entry, outputDir)) {
+        return false;
+    }
+    touch(entry);
+    return true;
+}
+
+QString ResultCache::stagingDir() {
+    const QString dir = QDir(m_dir).filePath(QString("%1/%2").arg(STAGING_DIR, QUuid::createUuid().toString(QUuid::WithoutBraces)));
+    if (!QDir().mkpath(dir)) {
+        qWarning("Cannot create cache folder %s, caching nothing", qPrintable(dir));
+        return {};
+    }
+    return dir;
+}
+
+ExportResult ResultCache::store(const QString& key, const QString& stagingDir, const QString& outputDir) {
+    const qint64 size = treeSize(stagingDir);
+
+    {
+        QReadLocker lock(&m_entriesLock);
+        const QString entry = QDir(m_dir).filePath(key);
+
+        // Fails if another job stored the same result first, which is just as good
+        bool stored = false;
+        if (size <= m_maxBytes) {
+            stored = QDir().rename(stagingDir, entry);
+            if (!stored && !QFileInfo(entry).isDir()) {
+                qWarning("Cannot store %s in the cache", qPrintable(key));
+            }
+        }
+
+        const QString source = QFileInfo(entry).isDir() ? entry : stagingDir;
+        const bool copied = copyTree(source, outputDir);
+        if (!stored) {
+            QDir(stagingDir).removeRecursively();
+        }
+        if (!copied) {
+            return ExportResult::fail(QString("Failed to copy the result to %1").arg(outputDir));
+        }
+        if (!stored) {
+            return ExportResult::ok();
+        }
+    }
+
+    {
+        QMutexLocker lock(&m_sizeMutex);
+        if (m_totalBytes < 0) {
+            m_totalBytes = treeSize(m_dir);
+        } else {
+            m_totalBytes += size;
+        }
+        if (m_totalBytes <= m_maxBytes) {
+            return ExportResult::ok();
+        }
+    }
+    evict(key);
+    return ExportResult::ok();
+}
+
+void ResultCache::discard(const QString& stagingDir) {
+    QDir(stagingDir).removeRecursively();
+}
+
+bool ResultCache::copyTree(const QString& from, const QString& to) const {
+    const QDir source(from);
+    QDirIterator it(from, QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const QString path = it.next();
+        const QString target = QDir(to).filePath(source.relativeFilePath(path));
+        if (!QDir().mkpath(QFileInfo(target).path())) {
+            return false;
+        }
+
+        // Copying and linking both refuse to replace a file
+        QFile::remove(target);
+        if (m_hardlink) {
+            std::error_code ec;
+            std::filesystem::create_hard_link(fsPath(path), fsPath(target), ec);
+            if (!ec) {
+                continue;
+            }
+        }
+        if (!QFile::copy(path, target)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Remove the least recently used entries until the cache is back under 90% of its limit, so
+// the next few stores don't each trigger another pass. Staging folders left behind by a
+// process that died are removed too.
+void ResultCache::evict(const QString& keep) {
+    QWriteLocker lock(&m_entriesLock);
+    QMutexLocker sizeLock(&m_sizeMutex);
+
+    const QDir root(m_dir);
+    const QDateTime stale = QDateTime::currentDateTime().addDays(-1);
+    for (const QFileInfo& staging : QDir(root.filePath(STAGING_DIR)).entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        if (staging.lastModified() < stale) {
+            QDir(staging.filePath()).removeRecursively();
+        }
+    }
+
+    // Oldest first
+    const QFileInfoList entries = root.entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Time | QDir::Reversed);
+    QVector<qint64> sizes;
+    qint64 total = 0;
+    for (const QFileInfo& entry : entries) {
+        sizes.append(entry.fileName() == STAGING_DIR ? 0 : treeSize(entry.filePath()));
+        total += sizes.last();
+    }
+
+    const qint64 target = m_maxBytes / 10 * 9;
+    for (int i = 0; i < entries.size() && total > target; ++i) {
+        const QString name = entries[i].fileName();
+        if (name == STAGING_DIR || name == keep) {
+            continue;
+        }
+        if (QDir(entries[i].filePath()).removeRecursively()) {
+            total -= sizes[i];
+        }
+    }
+    m_totalBytes = total;
+}
+
+QList<QCommandLineOption> resultCacheOptions() {
+    return {
+        {"cache-dir", "OPTIONAL: Reuse results of earlier conversions with the same input and options, stored in this folder", "dir"},
+        {"cache-size", QString("OPTIONAL: Size limit of --cache-dir in MB, least recently used results are removed past it (default %1)").arg(DEFAULT_MAX_MB), "mb"},
+        {"cache-hardlink", "OPTIONAL: Hard link cached results into the output folder instead of copying them"},
+    };
+}
+
+std::unique_ptr<ResultCache> resultCacheFromOptions(const QCommandLineParser& parser, QString* error) {
+    if (!parser.isSet("cache-dir")) {
+        return nullptr;
+    }
+
+    qint64 maxMb = DEFAULT_MAX_MB;
+    if (parser.isSet("cache-size")) {
+        bool ok = false;
+        maxMb = parser.value("cache-size").toLongLong(&ok);
+        if (!ok || maxMb < 1) {
+            *error = QString("Invalid cache size: %1").arg(parser.value("cache-size"));
+            return nullptr;
+        }
+    }
+
+    const QString dir = parser.value("cache-dir");
+    if (!QDir().mkpath(dir)) {
+        *error = QString("Cannot create cache folder %1").arg(dir);
+        return nullptr;
+    }
+    return std::make_unique<ResultCache>(dir, maxMb * 1024 * 1024, parser.isSet("cache-hardlink"));
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Animation/AnimationData.h"
+#include "Animation/ConversionPipeline.h"
+
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QList>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QString>
+#include <functional>
+#include <memory>
+
+// On-disk cache of conversion results. Rebuilding a project converts mostly the same inputs
+// with the same settings as last time; a hit puts the stored output files in place without
+// decoding, quantizing or encoding anything.
+//
+// Entries are keyed by a hash of the input's files (names and bytes) and every option that can
+// change the output, with the palette as its resolved colors. Each entry is a folder named by
+// its key holding the exported files as the exporter laid them out. Results are exported into
+// a staging folder next to the entries and renamed into place, so an entry is either complete
+// or absent, even with several jobs or processes sharing the cache.
+//
+// The cache is bounded in size. When a new entry takes it over the limit the least recently
+// used entries are removed, using each entry folder's modification time, which a hit updates.
+class ResultCache {
+public:
+    // maxBytes is the size limit. With hardlink, hits are hard links to the stored files instead
+    // of copies, where the file system allows it.
+    ResultCache(const QString& dir, qint64 maxBytes, bool hardlink);
+
+    // Does the conversion, exporting into the given folder instead of the options' output path
+    using ConvertFn = std::function<ExportResult(const QString& exportDir)>;
+
+    // A conversion through the cache. A hit copies the stored files to the options' output
+    // folder without calling convert. A miss calls it and stores a successful result, or just
+    // calls it with the output folder if the input can't be hashed. hit, if given, says which.
+    ExportResult runWith(AnimationType inputType, const QString& inPath, const ConversionOptions& options,
+        const ConvertFn& convert, bool* hit = nullptr);
+
+    // runWith() converting with ConversionPipeline::run()
+    ExportResult run(AnimationType inputType, const QString& inPath, const ConversionOptions& options,
+        ConversionToken* token = nullptr, bool* hit = nullptr);
+
+private:
+    // Key for converting the input with these options, empty if the input can't be listed
+    QString key(AnimationType inputType, const QString& inPath, const ConversionOptions& options) const;
+
+    // Put a stored result into outputDir, false on a miss
+    bool restore(const QString& key, const QString& outputDir);
+
+    // A fresh folder for a miss to export into, and storing or dropping what it holds afterwards
+    QString stagingDir();
+    ExportResult store(const QString& key, const QString& stagingDir, const QString& outputDir);
+    void discard(const QString& stagingDir);
+
+    bool copyTree(const QString& from, const QString& to) const;
+    void evict(const QString& keep);
+
+    QString m_dir;
+    qint64 m_maxBytes;
+    bool m_hardlink;
+
+    QReadWriteLock m_entriesLock;   // Restores read entries, eviction removes them
+    QMutex m_sizeMutex;
+    qint64 m_totalBytes = -1;       // Counted on the first store
+};
+
+// --cache-dir, --cache-size and --cache-hardlink
+QList<QCommandLineOption> resultCacheOptions();
+
+// The cache the options ask for, null without --cache-dir. Also null, with error set, if the
+// options are invalid.
+std::unique_ptr<ResultCache> resultCacheFromOptions(const QCommandLineParser& parser, QString* error);
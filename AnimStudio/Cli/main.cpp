@@ -0,0 +1,11 @@
+#include <QCoreApplication>
+
+#include "BatchMode.h"
+
+// animstudio-cli: the batch mode of AnimStudio without any of the GUI. No widgets are linked
+// and no display is needed, so it runs headless and starts faster for short conversions.
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    return runBatchMode(app);
+}
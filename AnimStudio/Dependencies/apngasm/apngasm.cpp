@@ -1,9 +1,13 @@
 #include "apngasm.h"
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <filesystem>
 #include <functional>
+#include <future>
+#include <thread>
 #include <png.h>
 #include <zlib.h>
 
@@ -16,6 +20,11 @@
 #define id_fdAT 0x54416466
 #define id_IEND 0x444E4549
 
+// Deflate levels used by the presets
+#define TRIAL_LEVEL         (Z_BEST_SPEED+1)
+#define FAST_TRIAL_LEVEL    Z_BEST_SPEED
+#define FAST_FINAL_LEVEL    (Z_BEST_SPEED+2)
+
 namespace {
 
   typedef struct { unsigned int num; unsigned char r, g, b, a; } COLORS;
@@ -37,6 +46,26 @@ namespace {
     return (int)(((COLORS*)arg1)->b) - (int)(((COLORS*)arg2)->b);
   }
 
+  // Deflates filtered rows in one go and returns the compressed size
+  unsigned int deflate_rows(unsigned char * rows, unsigned int length, unsigned char * zbuf, int zbuf_size, int level, int memLevel, int strategy)
+  {
+    z_stream zstream;
+    zstream.data_type = Z_BINARY;
+    zstream.zalloc = Z_NULL;
+    zstream.zfree = Z_NULL;
+    zstream.opaque = Z_NULL;
+    deflateInit2(&zstream, level, 8, 15, memLevel, strategy);
+
+    zstream.next_out = zbuf;
+    zstream.avail_out = zbuf_size;
+    zstream.next_in = rows;
+    zstream.avail_in = length;
+    deflate(&zstream, Z_FINISH);
+    unsigned int size = zstream.total_out;
+    deflateEnd(&zstream);
+    return size;
+  }
+
 } // unnamed namespace
 
 namespace apngasm {
@@ -46,6 +75,8 @@ namespace apngasm {
     : _loops(0)
     , _skipFirst(false)
     , _keyframe(-1)
+    , _threadCount(0)
+    , _preset(COMPRESSION_BALANCED)
   {
     // nop
   }
@@ -55,6 +86,8 @@ namespace apngasm {
     : _loops(0)
     , _skipFirst(false)
     , _keyframe(-1)
+    , _threadCount(0)
+    , _preset(COMPRESSION_BALANCED)
   {
     _frames.insert(_frames.end(), frames.begin(), frames.end());
   }
@@ -83,6 +116,12 @@ namespace apngasm {
     return _skipFirst;
   }
 
+  // Returns the compression preset.
+  CompressionPreset APNGAsm::getCompressionPreset() const
+  {
+    return _preset;
+  }
+
   size_t APNGAsm::frameCount()
   {
     return _frames.size();
@@ -134,6 +173,13 @@ namespace apngasm {
     return addFrame(APNGFrame(pixels, width, height, delayNum, delayDen));
   }
 
+  //Adds an indexed frame to the frame vector
+  //Returns the frame number in the frame vector
+  size_t APNGAsm::addFrame(const unsigned char *indices, unsigned int width, unsigned int height, unsigned int stride, const rgba *palette, int paletteSize, unsigned delayNum, unsigned delayDen)
+  {
+    return addFrame(APNGFrame(indices, width, height, stride, palette, paletteSize, delayNum, delayDen));
+  }
+
   //Adds an APNGFrame object to the frame vector
   //Returns a frame vector with the added frames
   APNGAsm& APNGAsm::operator << (const APNGFrame &frame)
@@ -161,6 +207,18 @@ namespace apngasm {
     _keyframe = frame;
   }
 
+  // Sets the number of threads used by assemble().
+  void APNGAsm::setThreadCount(unsigned int threads)
+  {
+    _threadCount = threads;
+  }
+
+  // Sets the speed/size trade-off used by assemble().
+  void APNGAsm::setCompressionPreset(CompressionPreset preset)
+  {
+    _preset = preset;
+  }
+
   //Assembles and outputs an APNG file
   //Returns the assembled file object
   //If no output path is specified only the file object is returned
@@ -186,7 +244,9 @@ namespace apngasm {
 
     dirtyTransparencyOptimization(coltype);
 
-    coltype = downconvertOptimizations(coltype, false, false);
+    // Frames that all share one palette keep it as given (entry order matters to whoever
+    // made it, and re-sorting it means a palette search per pixel).
+    coltype = downconvertOptimizations(coltype, coltype == 3, false);
 
     duplicateFramesOptimization(coltype, (_skipFirst ? 1 : 0));
 
@@ -1010,8 +1070,12 @@ namespace apngasm {
       }
       else
       {
-        _palsize = _frames[0]._paletteSize;
-        _trnssize = _frames[0]._transparencySize;
+        // Indices stay as they are, entries past the last one in use are dropped
+        _palsize = 0;
+        for (i=0; i<(unsigned int)_frames[0]._paletteSize; i++)
+          if (col[i].num != 0)
+            _palsize = i+1;
+        _trnssize = std::min(_palsize, (unsigned int)_frames[0]._transparencySize);
         for (i=0; i<_palsize; i++)
         {
           _palette[i].r = col[i].r;
@@ -1145,8 +1209,7 @@ namespace apngasm {
     unsigned int    has_tcolor = 0;
     unsigned int    tcolor = 0;
     unsigned int    i, rowbytes, imagesize;
-    unsigned int    idat_size, zbuf_size, zsize;
-    unsigned char * zbuf;
+    unsigned int    idat_size, zbuf_size;
     FILE*           f;
     unsigned char   png_sign[8] = {137,  80,  78,  71,  13,  10,  26,  10};
     unsigned char   png_Software[27] = { 83, 111, 102, 116, 119, 97, 114, 101, '\0',
@@ -1205,7 +1268,6 @@ namespace apngasm {
     unsigned char * over2 = new unsigned char[imagesize];
     unsigned char * over3 = new unsigned char[imagesize];
     unsigned char * prev  = new unsigned char[imagesize];
-    unsigned char * rows  = new unsigned char[(rowbytes + 1) * _height];
 
     if ((f = fopen(outputPath.c_str(), "wb")) != 0)
     {
@@ -1262,35 +1324,89 @@ namespace apngasm {
       if (_trnssize > 0)
         write_chunk(f, "tRNS", _trns, _trnssize);
 
-      _op_zstream1.data_type = Z_BINARY;
-      _op_zstream1.zalloc = Z_NULL;
-      _op_zstream1.zfree = Z_NULL;
-      _op_zstream1.opaque = Z_NULL;
-      deflateInit2(&_op_zstream1, Z_BEST_SPEED+1, 8, 15, 8, Z_DEFAULT_STRATEGY);
-
-      _op_zstream2.data_type = Z_BINARY;
-      _op_zstream2.zalloc = Z_NULL;
-      _op_zstream2.zfree = Z_NULL;
-      _op_zstream2.opaque = Z_NULL;
-      deflateInit2(&_op_zstream2, Z_BEST_SPEED+1, 8, 15, 8, Z_FILTERED);
-
       idat_size = (rowbytes + 1) * _height;
       zbuf_size = idat_size + ((idat_size + 7) >> 3) + ((idat_size + 63) >> 6) + 11;
 
-      zbuf = new unsigned char[zbuf_size];
-      _op_zbuf1 = new unsigned char[zbuf_size];
-      _op_zbuf2 = new unsigned char[zbuf_size];
-      _row_buf = new unsigned char[rowbytes + 1];
-      _sub_row = new unsigned char[rowbytes + 1];
-      _up_row = new unsigned char[rowbytes + 1];
-      _avg_row = new unsigned char[rowbytes + 1];
-      _paeth_row = new unsigned char[rowbytes + 1];
-
-      _row_buf[0] = 0;
-      _sub_row[0] = 1;
-      _up_row[0] = 2;
-      _avg_row[0] = 3;
-      _paeth_row[0] = 4;
+      // The dispose candidates of a frame are tried on separate threads, and the final
+      // Z_BEST_COMPRESSION pass of each frame runs in the background while the candidates of
+      // the next frame are tried. zlib output only depends on its input, so the file is
+      // byte-identical to a serial run whatever the thread count.
+      unsigned int threads = _threadCount ? _threadCount : std::thread::hardware_concurrency();
+      const bool parallel = threads > 1;
+      const std::launch policy = parallel ? std::launch::async : std::launch::deferred;
+      const size_t max_pending = parallel ? threads : 0;
+
+      DeflateScratch scratch[3];
+      for (j=0; j<3; j++)
+        init_scratch(scratch[j], rowbytes, zbuf_size, true);
+
+      // Final compression of one frame. Candidates that point into the reused over buffers are
+      // copied first when the job runs in the background.
+      auto start_fin = [&](OP op) -> std::future<std::vector<unsigned char> > {
+        std::vector<unsigned char> pixels;
+        if (parallel && (op.p == over1 || op.p == over2 || op.p == over3))
+          pixels.assign(op.p, op.p + imagesize);
+
+        auto job = [this, op, pixels, bpp, rowbytes, zbuf_size, idat_size]() mutable {
+          if (!pixels.empty())
+            op.p = pixels.data();
+          DeflateScratch fin_scratch;
+          init_scratch(fin_scratch, rowbytes, zbuf_size, false);
+          std::vector<unsigned char> fin_rows(idat_size);
+          std::vector<unsigned char> fin_zbuf(zbuf_size);
+          unsigned int fin_zsize = 0;
+          deflate_rect_fin(fin_scratch, op, fin_zbuf.data(), &fin_zsize, bpp, rowbytes, fin_rows.data(), zbuf_size);
+          fin_zbuf.resize(fin_zsize);
+          return fin_zbuf;
+        };
+
+        if (parallel)
+          return std::async(std::launch::async, std::move(job));
+
+        std::promise<std::vector<unsigned char> > ready;
+        ready.set_value(job());
+        return ready.get_future();
+      };
+
+      // Frames waiting to be written, in file order
+      struct PendingFrame {
+        bool has_fcTL;
+        unsigned char buf_fcTL[26];
+        int frame;
+        std::future<std::vector<unsigned char> > data;
+      };
+      std::deque<PendingFrame> pending;
+
+      auto queue_frame = [&](bool has_fcTL, const unsigned char *fcTL, int frame, std::future<std::vector<unsigned char> > data) {
+        pending.emplace_back();
+        PendingFrame &p = pending.back();
+        p.has_fcTL = has_fcTL;
+        if (has_fcTL)
+          memcpy(p.buf_fcTL, fcTL, 26);
+        p.frame = frame;
+        p.data = std::move(data);
+      };
+
+      auto flush = [&](size_t keep) {
+        while (pending.size() > keep)
+        {
+          PendingFrame &p = pending.front();
+          std::vector<unsigned char> data = p.data.get();
+          if (p.has_fcTL)
+          {
+            png_save_uint_32(p.buf_fcTL, _next_seq_num++);
+            write_chunk(f, "fcTL", p.buf_fcTL, 26);
+          }
+          write_IDATs(f, p.frame, data.data(), static_cast<unsigned int>(data.size()), idat_size);
+
+          // Emit progress mapped into [0.3, 0.99]
+          if (_progressCallback) {
+              float frac = float(p.frame + 1) / float(_frames.size());
+              _progressCallback(0.30f + frac * (0.99f - 0.30f));
+          }
+          pending.pop_front();
+        }
+      };
 
       unsigned int x0 = 0;
       unsigned int y0 = 0;
@@ -1302,17 +1418,17 @@ namespace apngasm {
 
       for (j=0; j<6; j++)
         _op[j].valid = 0;
-      deflate_rect_op(_frames[0]._pixels, x0, y0, w0, h0, bpp, rowbytes, zbuf_size, 0);
-      deflate_rect_fin(zbuf, &zsize, bpp, rowbytes, rows, zbuf_size, 0);
+      deflate_rect_op(scratch[0], _op[0], _frames[0]._pixels, x0, y0, w0, h0, bpp, rowbytes, zbuf_size);
+      std::future<std::vector<unsigned char> > next_data = start_fin(_op[0]);
 
       if (first)
       {
-        write_IDATs(f, 0, zbuf, zsize, idat_size);
+        queue_frame(false, NULL, 0, std::move(next_data));
 
         for (j=0; j<6; j++)
           _op[j].valid = 0;
-        deflate_rect_op(_frames[1]._pixels, x0, y0, w0, h0, bpp, rowbytes, zbuf_size, 0);
-        deflate_rect_fin(zbuf, &zsize, bpp, rowbytes, rows, zbuf_size, 0);
+        deflate_rect_op(scratch[0], _op[0], _frames[1]._pixels, x0, y0, w0, h0, bpp, rowbytes, zbuf_size);
+        next_data = start_fin(_op[0]);
       }
 
       for (size_t n = first; n < _frames.size()-1; ++n)
@@ -1323,11 +1439,9 @@ namespace apngasm {
         for (j=0; j<6; j++)
           _op[j].valid = 0;
 
-        /* dispose = none */
-        get_rect(_width, _height, _frames[n]._pixels, _frames[n+1]._pixels, over1, coltype, bpp, rowbytes, zbuf_size, has_tcolor, tcolor, 0);
-
         /* dispose = background */
-        if (has_tcolor)
+        std::future<void> trial_background;
+        if (has_tcolor && _preset != COMPRESSION_FAST)
         {
           memcpy(temp, _frames[n]._pixels, imagesize);
           if (coltype == 2)
@@ -1338,12 +1452,25 @@ namespace apngasm {
             for (j=0; j<h0; j++)
               memset(temp + ((j+y0)*_width + x0)*bpp, tcolor, w0*bpp);
 
-          get_rect(_width, _height, temp, _frames[n+1]._pixels, over2, coltype, bpp, rowbytes, zbuf_size, has_tcolor, tcolor, 1);
+          trial_background = std::async(policy, [&, n]() {
+            get_rect(scratch[1], _width, _height, temp, _frames[n+1]._pixels, over2, coltype, bpp, rowbytes, zbuf_size, has_tcolor, tcolor, 1);
+          });
         }
 
         /* dispose = previous */
-        if (n > first)
-          get_rect(_width, _height, prev, _frames[n+1]._pixels, over3, coltype, bpp, rowbytes, zbuf_size, has_tcolor, tcolor, 2);
+        std::future<void> trial_previous;
+        if (n > first && _preset != COMPRESSION_FAST)
+          trial_previous = std::async(policy, [&, n]() {
+            get_rect(scratch[2], _width, _height, prev, _frames[n+1]._pixels, over3, coltype, bpp, rowbytes, zbuf_size, has_tcolor, tcolor, 2);
+          });
+
+        /* dispose = none */
+        get_rect(scratch[0], _width, _height, _frames[n]._pixels, _frames[n+1]._pixels, over1, coltype, bpp, rowbytes, zbuf_size, has_tcolor, tcolor, 0);
+
+        if (trial_background.valid())
+          trial_background.get();
+        if (trial_previous.valid())
+          trial_previous.get();
 
         op_min = _op[0].size;
         op_best = 0;
@@ -1359,7 +1486,6 @@ namespace apngasm {
 
         dop = op_best >> 1;
 
-        png_save_uint_32(buf_fcTL, _next_seq_num++);
         png_save_uint_32(buf_fcTL + 4, w0);
         png_save_uint_32(buf_fcTL + 8, h0);
         png_save_uint_32(buf_fcTL + 12, x0);
@@ -1368,9 +1494,8 @@ namespace apngasm {
         png_save_uint_16(buf_fcTL + 22, _frames[n]._delayDen);
         buf_fcTL[24] = dop;
         buf_fcTL[25] = bop;
-        write_chunk(f, "fcTL", buf_fcTL, 26);
-
-        write_IDATs(f, static_cast<int>(n), zbuf, zsize, idat_size);
+        queue_frame(true, buf_fcTL, static_cast<int>(n), std::move(next_data));
+        flush(max_pending);
 
         /* process apng dispose - begin */
         if (dop != 2)
@@ -1394,18 +1519,11 @@ namespace apngasm {
         h0 = _op[op_best].h;
         bop = op_best & 1;
 
-        deflate_rect_fin(zbuf, &zsize, bpp, rowbytes, rows, zbuf_size, op_best);
-
-        // Emit progress mapped into [0.3, 0.99]
-        if (_progressCallback) {
-            float frac = float(n + 1) / float(_frames.size());
-            _progressCallback(0.30f + frac * (0.99f - 0.30f));
-        }
+        next_data = start_fin(_op[op_best]);
       }
 
       if (_frames.size() > 1)
       {
-        png_save_uint_32(buf_fcTL, _next_seq_num++);
         png_save_uint_32(buf_fcTL + 4, w0);
         png_save_uint_32(buf_fcTL + 8, h0);
         png_save_uint_32(buf_fcTL + 12, x0);
@@ -1414,26 +1532,19 @@ namespace apngasm {
         png_save_uint_16(buf_fcTL + 22, _frames[_frames.size()-1]._delayDen);
         buf_fcTL[24] = 0;
         buf_fcTL[25] = bop;
-        write_chunk(f, "fcTL", buf_fcTL, 26);
+        queue_frame(true, buf_fcTL, static_cast<int>(_frames.size()-1), std::move(next_data));
       }
+      else
+        queue_frame(false, NULL, static_cast<int>(_frames.size()-1), std::move(next_data));
 
-      write_IDATs(f, static_cast<int>(_frames.size()-1), zbuf, zsize, idat_size);
+      flush(0);
 
       write_chunk(f, "tEXt", png_Software, 27);
       write_chunk(f, "IEND", 0, 0);
       fclose(f);
 
-      delete[] zbuf;
-      delete[] _op_zbuf1;
-      delete[] _op_zbuf2;
-      delete[] _row_buf;
-      delete[] _sub_row;
-      delete[] _up_row;
-      delete[] _avg_row;
-      delete[] _paeth_row;
-
-      deflateEnd(&_op_zstream1);
-      deflateEnd(&_op_zstream2);
+      for (j=0; j<3; j++)
+        free_scratch(scratch[j]);
     }
     else
       return false;
@@ -1443,18 +1554,62 @@ namespace apngasm {
     delete[] over2;
     delete[] over3;
     delete[] prev;
-    delete[] rows;
 
     return true;
   }
 
-  void APNGAsm::process_rect(unsigned char * row, int rowbytes, int bpp, int stride, int h, unsigned char * rows)
+  void APNGAsm::init_scratch(DeflateScratch &s, int rowbytes, int zbuf_size, bool streams)
+  {
+    s.row_buf.assign(rowbytes + 1, 0);
+    s.sub_row.assign(rowbytes + 1, 1);
+    s.up_row.assign(rowbytes + 1, 2);
+    s.avg_row.assign(rowbytes + 1, 3);
+    s.paeth_row.assign(rowbytes + 1, 4);
+    s.streams = streams;
+
+    if (streams)
+    {
+      const int trial_level = (_preset == COMPRESSION_FAST) ? FAST_TRIAL_LEVEL : TRIAL_LEVEL;
+
+      s.zbuf1.resize(zbuf_size);
+      s.zbuf2.resize(zbuf_size);
+
+      s.zstream1.data_type = Z_BINARY;
+      s.zstream1.zalloc = Z_NULL;
+      s.zstream1.zfree = Z_NULL;
+      s.zstream1.opaque = Z_NULL;
+      deflateInit2(&s.zstream1, trial_level, 8, 15, 8, Z_DEFAULT_STRATEGY);
+
+      s.zstream2.data_type = Z_BINARY;
+      s.zstream2.zalloc = Z_NULL;
+      s.zstream2.zfree = Z_NULL;
+      s.zstream2.opaque = Z_NULL;
+      deflateInit2(&s.zstream2, trial_level, 8, 15, 8, Z_FILTERED);
+    }
+  }
+
+  void APNGAsm::free_scratch(DeflateScratch &s)
+  {
+    if (s.streams)
+    {
+      deflateEnd(&s.zstream1);
+      deflateEnd(&s.zstream2);
+      s.streams = false;
+    }
+  }
+
+  void APNGAsm::process_rect(DeflateScratch &s, unsigned char * row, int rowbytes, int bpp, int stride, int h, unsigned char * rows)
   {
     int i, j, v;
     int a, b, c, pa, pb, pc, p;
     unsigned char * prev = NULL;
     unsigned char * dp  = rows;
     unsigned char * out;
+    unsigned char * _row_buf = s.row_buf.data();
+    unsigned char * _sub_row = s.sub_row.data();
+    unsigned char * _up_row = s.up_row.data();
+    unsigned char * _avg_row = s.avg_row.data();
+    unsigned char * _paeth_row = s.paeth_row.data();
 
     for (j=0; j<h; j++)
     {
@@ -1555,13 +1710,13 @@ namespace apngasm {
       if (rows == NULL)
       {
         // deflate_rect_op()
-        _op_zstream1.next_in = _row_buf;
-        _op_zstream1.avail_in = rowbytes + 1;
-        deflate(&_op_zstream1, Z_NO_FLUSH);
+        s.zstream1.next_in = _row_buf;
+        s.zstream1.avail_in = rowbytes + 1;
+        deflate(&s.zstream1, Z_NO_FLUSH);
 
-        _op_zstream2.next_in = best_row;
-        _op_zstream2.avail_in = rowbytes + 1;
-        deflate(&_op_zstream2, Z_NO_FLUSH);
+        s.zstream2.next_in = best_row;
+        s.zstream2.avail_in = rowbytes + 1;
+        deflate(&s.zstream2, Z_NO_FLUSH);
       }
       else
       {
@@ -1575,82 +1730,123 @@ namespace apngasm {
     }
   }
 
-  void APNGAsm::deflate_rect_fin(unsigned char * zbuf, unsigned int * zsize, int bpp, int stride, unsigned char * rows, int zbuf_size, int n)
+  void APNGAsm::filter_rect(unsigned char * row, int rowbytes, int bpp, int stride, int h, unsigned char * rows, int filter)
   {
-    unsigned char * row  = _op[n].p + _op[n].y*stride + _op[n].x*bpp;
-    int rowbytes = _op[n].w*bpp;
-
-    z_stream _fin_zstream;
-    _fin_zstream.data_type = Z_BINARY;
-    _fin_zstream.zalloc = Z_NULL;
-    _fin_zstream.zfree = Z_NULL;
-    _fin_zstream.opaque = Z_NULL;
+    // One fixed PNG filter type for every row. The row above the first one counts as zero.
+    unsigned char * prev = NULL;
+    unsigned char * dp = rows;
+    int i, j;
+    int a, b, c, pa, pb, pc, p;
 
-    if (_op[n].filters == 0)
+    for (j=0; j<h; j++)
     {
-      deflateInit2(&_fin_zstream, Z_BEST_COMPRESSION, 8, 15, 8, Z_DEFAULT_STRATEGY);
-      unsigned char * dp  = rows;
-      for (int j=0; j<_op[n].h; j++)
+      *dp++ = (unsigned char)filter;
+      for (i=0; i<rowbytes; i++)
       {
-        *dp++ = 0;
-        memcpy(dp, row, rowbytes);
-        dp += rowbytes;
-        row += stride;
+        a = (i >= bpp) ? row[i-bpp] : 0;
+        b = prev ? prev[i] : 0;
+        c = (prev && i >= bpp) ? prev[i-bpp] : 0;
+        switch (filter)
+        {
+          case 1: dp[i] = row[i] - a; break;
+          case 2: dp[i] = row[i] - b; break;
+          case 3: dp[i] = row[i] - (a + b)/2; break;
+          case 4:
+            p = b - c;
+            pc = a - c;
+            pa = abs(p);
+            pb = abs(pc);
+            pc = abs(p + pc);
+            p = (pa <= pb && pa <=pc) ? a : (pb <= pc) ? b : c;
+            dp[i] = row[i] - p;
+            break;
+          default: dp[i] = row[i]; break;
+        }
       }
+      dp += rowbytes;
+      prev = row;
+      row += stride;
     }
+  }
+
+  void APNGAsm::deflate_rect_fin(DeflateScratch &s, const OP &op, unsigned char * zbuf, unsigned int * zsize, int bpp, int stride, unsigned char * rows, int zbuf_size)
+  {
+    unsigned char * row  = op.p + op.y*stride + op.x*bpp;
+    int rowbytes = op.w*bpp;
+    unsigned int length = op.h*(rowbytes + 1);
+    int level = (_preset == COMPRESSION_FAST) ? FAST_FINAL_LEVEL : Z_BEST_COMPRESSION;
+
+    if (op.filters == 0)
+      filter_rect(row, rowbytes, bpp, stride, op.h, rows, 0);
     else
+      process_rect(s, row, rowbytes, bpp, stride, op.h, rows);
+
+    *zsize = deflate_rows(rows, length, zbuf, zbuf_size, level, 8, op.filters == 0 ? Z_DEFAULT_STRATEGY : Z_FILTERED);
+
+    if (_preset != COMPRESSION_MAX)
+      return;
+
+    // Start from the balanced result, so max is never larger, then try every row filter
+    // (-1 == adaptive) with each strategy and keep whatever comes out smallest.
+    static const int strategies[] = { Z_DEFAULT_STRATEGY, Z_FILTERED, Z_RLE };
+    std::vector<unsigned char> trial(zbuf_size);
+    for (int filter = -1; filter <= 4; filter++)
     {
-      deflateInit2(&_fin_zstream, Z_BEST_COMPRESSION, 8, 15, 8, Z_FILTERED);
-      process_rect(row, rowbytes, bpp, stride, _op[n].h, rows);
-    }
+      if (filter < 0)
+        process_rect(s, row, rowbytes, bpp, stride, op.h, rows);
+      else
+        filter_rect(row, rowbytes, bpp, stride, op.h, rows, filter);
 
-    _fin_zstream.next_out = zbuf;
-    _fin_zstream.avail_out = zbuf_size;
-    _fin_zstream.next_in = rows;
-    _fin_zstream.avail_in = _op[n].h*(rowbytes + 1);
-    deflate(&_fin_zstream, Z_FINISH);
-    *zsize = _fin_zstream.total_out;
-    deflateEnd(&_fin_zstream);
+      for (int strategy : strategies)
+      {
+        unsigned int size = deflate_rows(rows, length, trial.data(), zbuf_size, Z_BEST_COMPRESSION, 9, strategy);
+        if (size < *zsize)
+        {
+          memcpy(zbuf, trial.data(), size);
+          *zsize = size;
+        }
+      }
+    }
   }
 
-  void APNGAsm::deflate_rect_op(unsigned char *pdata, int x, int y, int w, int h, int bpp, int stride, int zbuf_size, int n)
+  void APNGAsm::deflate_rect_op(DeflateScratch &s, OP &op, unsigned char *pdata, int x, int y, int w, int h, int bpp, int stride, int zbuf_size)
   {
     unsigned char * row  = pdata + y*stride + x*bpp;
     int rowbytes = w * bpp;
 
-    _op_zstream1.data_type = Z_BINARY;
-    _op_zstream1.next_out = _op_zbuf1;
-    _op_zstream1.avail_out = zbuf_size;
+    s.zstream1.data_type = Z_BINARY;
+    s.zstream1.next_out = s.zbuf1.data();
+    s.zstream1.avail_out = zbuf_size;
 
-    _op_zstream2.data_type = Z_BINARY;
-    _op_zstream2.next_out = _op_zbuf2;
-    _op_zstream2.avail_out = zbuf_size;
+    s.zstream2.data_type = Z_BINARY;
+    s.zstream2.next_out = s.zbuf2.data();
+    s.zstream2.avail_out = zbuf_size;
 
-    process_rect(row, rowbytes, bpp, stride, h, NULL);
+    process_rect(s, row, rowbytes, bpp, stride, h, NULL);
 
-    deflate(&_op_zstream1, Z_FINISH);
-    deflate(&_op_zstream2, Z_FINISH);
-    _op[n].p = pdata;
-    if (_op_zstream1.total_out < _op_zstream2.total_out)
+    deflate(&s.zstream1, Z_FINISH);
+    deflate(&s.zstream2, Z_FINISH);
+    op.p = pdata;
+    if (s.zstream1.total_out < s.zstream2.total_out)
     {
-      _op[n].size = _op_zstream1.total_out;
-      _op[n].filters = 0;
+      op.size = s.zstream1.total_out;
+      op.filters = 0;
     }
     else
     {
-      _op[n].size = _op_zstream2.total_out;
-      _op[n].filters = 1;
+      op.size = s.zstream2.total_out;
+      op.filters = 1;
     }
-    _op[n].x = x;
-    _op[n].y = y;
-    _op[n].w = w;
-    _op[n].h = h;
-    _op[n].valid = 1;
-    deflateReset(&_op_zstream1);
-    deflateReset(&_op_zstream2);
+    op.x = x;
+    op.y = y;
+    op.w = w;
+    op.h = h;
+    op.valid = 1;
+    deflateReset(&s.zstream1);
+    deflateReset(&s.zstream2);
   }
 
-  void APNGAsm::get_rect(unsigned int w, unsigned int h, unsigned char *pimage1, unsigned char *pimage2, unsigned char *ptemp, unsigned char coltype, unsigned int bpp, unsigned int stride, int zbuf_size, unsigned int has_tcolor, unsigned int tcolor, int n)
+  void APNGAsm::get_rect(DeflateScratch &s, unsigned int w, unsigned int h, unsigned char *pimage1, unsigned char *pimage2, unsigned char *ptemp, unsigned char coltype, unsigned int bpp, unsigned int stride, int zbuf_size, unsigned int has_tcolor, unsigned int tcolor, int n)
   {
     unsigned int   i, j, x0, y0, w0, h0;
     unsigned int   x_min = w-1;
@@ -1787,10 +1983,10 @@ namespace apngasm {
       h0 = y_max-y_min+1;
     }
 
-    deflate_rect_op(pimage2, x0, y0, w0, h0, bpp, stride, zbuf_size, n*2);
+    deflate_rect_op(s, _op[n*2], pimage2, x0, y0, w0, h0, bpp, stride, zbuf_size);
 
     if (over_is_possible)
-      deflate_rect_op(ptemp, x0, y0, w0, h0, bpp, stride, zbuf_size, n*2+1);
+      deflate_rect_op(s, _op[n*2+1], ptemp, x0, y0, w0, h0, bpp, stride, zbuf_size);
   }
 
   void APNGAsm::write_chunk(FILE * f, const char * name, unsigned char * data, unsigned int length)
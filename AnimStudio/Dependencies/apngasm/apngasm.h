@@ -22,6 +22,33 @@ namespace apngasm {
 
     typedef struct { unsigned char *p; unsigned int size; int x, y, w, h, valid, filters; } OP;
 
+    /**
+     * @enum CompressionPreset
+     * @brief Trade-off between assemble() time and output file size.
+     */
+    enum CompressionPreset {
+        COMPRESSION_FAST,       // Only the "dispose none" candidate, low deflate levels
+        COMPRESSION_BALANCED,   // All dispose candidates, Z_BEST_COMPRESSION for the final pass
+        COMPRESSION_MAX         // As balanced, then every row filter and strategy is tried on the final pass
+    };
+
+    /**
+     * @struct DeflateScratch
+     * @brief Row filter buffers and trial zlib streams. Each thread compressing frame rectangles has its own.
+     */
+    struct DeflateScratch {
+        z_stream zstream1;  // Trial stream for unfiltered rows
+        z_stream zstream2;  // Trial stream for adaptively filtered rows
+        std::vector<unsigned char> zbuf1;
+        std::vector<unsigned char> zbuf2;
+        std::vector<unsigned char> row_buf;
+        std::vector<unsigned char> sub_row;
+        std::vector<unsigned char> up_row;
+        std::vector<unsigned char> avg_row;
+        std::vector<unsigned char> paeth_row;
+        bool streams = false; // zstream1/zstream2 are initialized
+    };
+
     /**
      * @struct CHUNK
      * @brief A chunk of image data.
@@ -91,6 +118,21 @@ namespace apngasm {
          * @return The [new] number of frames/the number of this frame on the frame vector.
          */
         size_t addFrame(rgba *pixels, unsigned int width, unsigned int height, unsigned delayNum = DEFAULT_FRAME_NUMERATOR, unsigned delayDen = DEFAULT_FRAME_DENOMINATOR);
+
+        /**
+         * @brief Adds an indexed APNGFrame object to the vector.
+         * @param indices The 8-bit color indices.
+         * @param width The width of the pixel data.
+         * @param height The height of the pixel data.
+         * @param stride Bytes from one row of indices to the next.
+         * @param palette The palette, alpha is written as tRNS. When every frame uses the same
+         *        palette the file is written as color type 3 with the palette and indices kept as given.
+         * @param paletteSize The number of palette entries (at most 256).
+         * @param delayNum The delay numerator for this frame (defaults to DEFAULT_FRAME_NUMERATOR).
+         * @param delayDen The delay denominator for this frame (defaults to DEFAULT_FRAME_DENMINATOR).
+         * @return The [new] number of frames/the number of this frame on the frame vector.
+         */
+        size_t addFrame(const unsigned char *indices, unsigned int width, unsigned int height, unsigned int stride, const rgba *palette, int paletteSize, unsigned delayNum = DEFAULT_FRAME_NUMERATOR, unsigned delayDen = DEFAULT_FRAME_DENOMINATOR);
 		
         /**
 		 * @brief Adds an APNGFrame object to the frame vector.
@@ -126,6 +168,19 @@ namespace apngasm {
          */
         void setKeyframe(int frame);
 
+        /**
+         * @brief Set the number of threads assemble() may use.
+         * @param threads 0 uses one per hardware thread, 1 runs everything on the calling thread.
+         *        The output file is byte-identical for any value.
+         */
+        void setThreadCount(unsigned int threads);
+
+        /**
+         * @brief Set how hard assemble() works to make the file small.
+         * @param preset COMPRESSION_BALANCED by default.
+         */
+        void setCompressionPreset(CompressionPreset preset);
+
         /**
          * @brief Returns the frame vector.
          * @return Returns the frame vector.
@@ -144,6 +199,12 @@ namespace apngasm {
          */
         bool isSkipFirst() const;
 
+        /**
+         * @brief Returns the compression preset.
+         * @return Returns the compression preset.
+         */
+        CompressionPreset getCompressionPreset() const;
+
         /**
          * @brief Returns the number of frames.
          * @return Returns the number of frames.
@@ -175,6 +236,12 @@ namespace apngasm {
     // FSO loop keyframe to write as an "FSO.Keyframe" iTXt chunk (<0 == none).
     int _keyframe;
 
+    // Threads used by assemble() (0 == hardware concurrency).
+    unsigned int _threadCount;
+
+    // Speed/size trade-off used by assemble().
+    CompressionPreset _preset;
+
     // Progress callback
     std::function<void(float)> _progressCallback;
 
@@ -186,24 +253,18 @@ namespace apngasm {
 
     bool save(const std::string &outputPath, unsigned char coltype, unsigned first, unsigned loops);
 
-    void process_rect(unsigned char * row, int rowbytes, int bpp, int stride, int h, unsigned char * rows);
-    void deflate_rect_fin(unsigned char * zbuf, unsigned int * zsize, int bpp, int stride, unsigned char * rows, int zbuf_size, int n);
-    void deflate_rect_op(unsigned char *pdata, int x, int y, int w, int h, int bpp, int stride, int zbuf_size, int n);
-    void get_rect(unsigned int w, unsigned int h, unsigned char *pimage1, unsigned char *pimage2, unsigned char *ptemp, unsigned char coltype, unsigned int bpp, unsigned int stride, int zbuf_size, unsigned int has_tcolor, unsigned int tcolor, int n);
+    void init_scratch(DeflateScratch &s, int rowbytes, int zbuf_size, bool streams);
+    void free_scratch(DeflateScratch &s);
+    void process_rect(DeflateScratch &s, unsigned char * row, int rowbytes, int bpp, int stride, int h, unsigned char * rows);
+    void filter_rect(unsigned char * row, int rowbytes, int bpp, int stride, int h, unsigned char * rows, int filter);
+    void deflate_rect_fin(DeflateScratch &s, const OP &op, unsigned char * zbuf, unsigned int * zsize, int bpp, int stride, unsigned char * rows, int zbuf_size);
+    void deflate_rect_op(DeflateScratch &s, OP &op, unsigned char *pdata, int x, int y, int w, int h, int bpp, int stride, int zbuf_size);
+    void get_rect(DeflateScratch &s, unsigned int w, unsigned int h, unsigned char *pimage1, unsigned char *pimage2, unsigned char *ptemp, unsigned char coltype, unsigned int bpp, unsigned int stride, int zbuf_size, unsigned int has_tcolor, unsigned int tcolor, int n);
 
     void write_chunk(FILE * f, const char * name, unsigned char * data, unsigned int length);
     void write_IDATs(FILE * f, int frame, unsigned char * data, unsigned int length, unsigned int idat_size);
 
     OP              _op[6];
-    z_stream        _op_zstream1;
-    z_stream        _op_zstream2;
-    unsigned char * _op_zbuf1;
-    unsigned char * _op_zbuf2;
-    unsigned char * _row_buf;
-    unsigned char * _sub_row;
-    unsigned char * _up_row;
-    unsigned char * _avg_row;
-    unsigned char * _paeth_row;
     unsigned int    _next_seq_num;
 
     unsigned int    _width;
@@ -235,4 +235,39 @@ APNGFrame::APNGFrame(rgba *pixels, unsigned int width, unsigned int height,
   }
 }
 
+APNGFrame::APNGFrame(const unsigned char *indices, unsigned int width,
+                     unsigned int height, unsigned int stride,
+                     const rgba *palette, int paletteSize,
+                     unsigned delayNum, unsigned delayDen)
+    : _pixels(NULL), _width(0), _height(0), _colorType(0), _paletteSize(0),
+      _transparencySize(0), _delayNum(delayNum), _delayDen(delayDen),
+      _rows(NULL) {
+  memset(_palette, 0, sizeof(_palette));
+  memset(_transparency, 0, sizeof(_transparency));
+
+  if (indices != NULL && palette != NULL && paletteSize > 0) {
+    _width = width;
+    _height = height;
+    _colorType = 3;
+
+    _pixels = new unsigned char[_height * _width];
+    _rows = new png_bytep[_height * sizeof(png_bytep)];
+
+    for (unsigned int i = 0; i < _height; ++i) {
+      _rows[i] = _pixels + i * _width;
+      memcpy(_rows[i], indices + i * stride, _width);
+    }
+
+    _paletteSize = std::min(paletteSize, 256);
+    for (int i = 0; i < _paletteSize; ++i) {
+      _palette[i].r = palette[i].r;
+      _palette[i].g = palette[i].g;
+      _palette[i].b = palette[i].b;
+      _transparency[i] = palette[i].a;
+      if (palette[i].a != 255)
+        _transparencySize = i + 1;
+    }
+  }
+}
+
 } // namespace apngasm
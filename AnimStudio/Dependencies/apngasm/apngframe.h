@@ -119,6 +119,24 @@ public:
             unsigned delayNum = DEFAULT_FRAME_NUMERATOR,
             unsigned delayDen = DEFAULT_FRAME_DENOMINATOR);
 
+  /**
+   * @brief Creates an indexed (palette) APNGFrame from 8-bit color indices.
+   * @param indices The color indices, one byte per pixel.
+   * @param width The width of the pixel data.
+   * @param height The height of the pixel data.
+   * @param stride Bytes from one row of indices to the next.
+   * @param palette The palette. Alpha values are written as tRNS.
+   * @param paletteSize The number of palette entries (at most 256).
+   * @param delayNum The delay numerator for this frame (defaults to
+   * DEFAULT_FRAME_NUMERATOR).
+   * @param delayDen The delay denominator for this frame (defaults to
+   * DEFAULT_FRAME_DENMINATOR).
+   */
+  APNGFrame(const unsigned char *indices, unsigned int width,
+            unsigned int height, unsigned int stride, const rgba *palette,
+            int paletteSize, unsigned delayNum = DEFAULT_FRAME_NUMERATOR,
+            unsigned delayDen = DEFAULT_FRAME_DENOMINATOR);
+
   /**
    * @brief Saves this frame as a single PNG file.
    * @param outPath The relative or absolute path to save the image file to.
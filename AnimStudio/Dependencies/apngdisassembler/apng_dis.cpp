@@ -30,8 +30,11 @@
 
  // This version has been modified for use in AnimStudio in order to load APNGs only into our custom AnimationData structure.
 
+#ifdef _WIN32
 #include <windows.h>
 #include <commctrl.h>
+#endif
+#include <string>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -73,7 +76,9 @@ struct Image
   void free() { delete[] rows; delete[] p; }
 };
 
+#ifdef _WIN32
 extern HWND  hMainDlg;
+#endif
 
 const unsigned long cMaxPNGSize = 16384UL;
 
@@ -211,6 +216,41 @@ int processing_finish(png_structp png_ptr, png_infop info_ptr)
   return 0;
 }
 
+// _wfopen is Windows only, elsewhere the path goes to fopen as UTF-8
+static FILE * open_file(const wchar_t * path)
+{
+#ifdef _WIN32
+  return _wfopen(path, L"rb");
+#else
+  std::string utf8;
+  for (; *path; path++)
+  {
+    unsigned long c = (unsigned long)*path;
+    if (c < 0x80)
+      utf8 += (char)c;
+    else if (c < 0x800)
+    {
+      utf8 += (char)(0xC0 | (c >> 6));
+      utf8 += (char)(0x80 | (c & 0x3F));
+    }
+    else if (c < 0x10000)
+    {
+      utf8 += (char)(0xE0 | (c >> 12));
+      utf8 += (char)(0x80 | ((c >> 6) & 0x3F));
+      utf8 += (char)(0x80 | (c & 0x3F));
+    }
+    else
+    {
+      utf8 += (char)(0xF0 | (c >> 18));
+      utf8 += (char)(0x80 | ((c >> 12) & 0x3F));
+      utf8 += (char)(0x80 | ((c >> 6) & 0x3F));
+      utf8 += (char)(0x80 | (c & 0x3F));
+    }
+  }
+  return fopen(utf8.c_str(), "rb");
+#endif
+}
+
 int load_apng(wchar_t * szIn, std::vector<Image>& img)
 {
   FILE * f;
@@ -230,7 +270,7 @@ int load_apng(wchar_t * szIn, std::vector<Image>& img)
   Image frameNext;
   int res = -1;
 
-  if ((f = _wfopen(szIn, L"rb")) != 0)
+  if ((f = open_file(szIn)) != 0)
   {
     if (fread(sig, 1, 8, f) == 8 && png_sig_cmp(sig, 0, 8) == 0)
     {
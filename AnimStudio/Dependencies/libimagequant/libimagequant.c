@@ -91,6 +91,7 @@ struct liq_histogram {
     unsigned short fixed_colors_count;
     unsigned short ignorebits;
     bool had_image_added;
+    bool reusable;
 };
 
 static void contrast_maps(liq_image *image) LIQ_NONNULL;
@@ -916,6 +917,17 @@ LIQ_EXPORT LIQ_NONNULL void liq_histogram_destroy(liq_histogram *hist)
     hist->free(hist);
 }
 
+/**
+ Keeps the collected colors after liq_histogram_quantize, so the same histogram can be
+ quantized again (e.g. with different quality or color limits) without re-adding images.
+ */
+LIQ_EXPORT LIQ_NONNULL liq_error liq_histogram_set_reusable(liq_histogram *hist, int reusable)
+{
+    if (!CHECK_STRUCT_TYPE(hist, liq_histogram)) return LIQ_INVALID_POINTER;
+    hist->reusable = reusable != 0;
+    return LIQ_OK;
+}
+
 LIQ_EXPORT LIQ_NONNULL liq_result *liq_quantize_image(liq_attr *attr, liq_image *img)
 {
     liq_result *res;
@@ -1030,6 +1042,27 @@ LIQ_NONNULL static void liq_remapping_result_destroy(liq_remapping_result *resul
     result->free(result);
 }
 
+/**
+ Independent copy of a quantization result. liq_write_remapped_image* store per-call state in
+ the liq_result, so threads remapping with the same palette each need their own copy.
+ */
+LIQ_EXPORT LIQ_NONNULL liq_result *liq_result_copy(const liq_result *result)
+{
+    if (!CHECK_STRUCT_TYPE(result, liq_result)) return NULL;
+
+    liq_result *res = result->malloc(sizeof(liq_result));
+    if (!res) return NULL;
+
+    *res = *result;
+    res->remapping = NULL;
+    res->palette = pam_duplicate_colormap(result->palette);
+    if (!res->palette) {
+        res->free(res);
+        return NULL;
+    }
+    return res;
+}
+
 LIQ_EXPORT LIQ_NONNULL void liq_result_destroy(liq_result *res)
 {
     if (!CHECK_STRUCT_TYPE(res, liq_result)) return;
@@ -1343,8 +1376,10 @@ LIQ_NONNULL static liq_error finalize_histogram(liq_histogram *input_hist, liq_a
     }
 
     histogram *hist = pam_acolorhashtoacolorhist(input_hist->acht, input_hist->gamma, options->malloc, options->free);
-    pam_freeacolorhash(input_hist->acht);
-    input_hist->acht = NULL;
+    if (!input_hist->reusable) {
+        pam_freeacolorhash(input_hist->acht);
+        input_hist->acht = NULL;
+    }
 
     if (!hist) {
         return LIQ_OUT_OF_MEMORY;
@@ -81,6 +81,7 @@ LIQ_EXPORT liq_error liq_histogram_add_image(liq_histogram *hist, const liq_attr
 LIQ_EXPORT liq_error liq_histogram_add_colors(liq_histogram *hist, const liq_attr *attr, const liq_histogram_entry entries[], int num_entries, double gamma) LIQ_NONNULL;
 LIQ_EXPORT liq_error liq_histogram_add_fixed_color(liq_histogram *hist, liq_color color, double gamma) LIQ_NONNULL;
 LIQ_EXPORT void liq_histogram_destroy(liq_histogram *hist) LIQ_NONNULL;
+LIQ_EXPORT liq_error liq_histogram_set_reusable(liq_histogram *hist, int reusable) LIQ_NONNULL;
 
 LIQ_EXPORT liq_error liq_set_max_colors(liq_attr* attr, int colors) LIQ_NONNULL;
 LIQ_EXPORT LIQ_USERESULT int liq_get_max_colors(const liq_attr* attr) LIQ_NONNULL;
@@ -136,6 +137,7 @@ LIQ_EXPORT int liq_get_quantization_quality(const liq_result *result) LIQ_NONNUL
 LIQ_EXPORT double liq_get_remapping_error(const liq_result *result) LIQ_NONNULL;
 LIQ_EXPORT int liq_get_remapping_quality(const liq_result *result) LIQ_NONNULL;
 
+LIQ_EXPORT LIQ_USERESULT liq_result *liq_result_copy(const liq_result *result) LIQ_NONNULL;
 LIQ_EXPORT void liq_result_destroy(liq_result *) LIQ_NONNULL;
 
 LIQ_EXPORT int liq_version(void);
@@ -0,0 +1,420 @@
+// BcnDecoder.cpp
+#include "BcnDecoder.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BCN_DECODER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace BcnDecoder {
+
+    // --- Shared helpers ---
+
+    static void expand565(quint16 c, uchar out[4]) {
+        const uint r = (c >> 11) & 0x1F;
+        const uint g = (c >> 5) & 0x3F;
+        const uint b = c & 0x1F;
+        out[0] = uchar((r << 3) | (r >> 2));
+        out[1] = uchar((g << 2) | (g >> 4));
+        out[2] = uchar((b << 3) | (b >> 2));
+        out[3] = 255;
+    }
+
+    static void writeBlock(const uchar (*pixels)[4], uchar* out, qsizetype stride) {
+        for (int y = 0; y < 4; ++y) {
+            memcpy(out + y * stride, pixels[y * 4], 16);
+        }
+    }
+
+    // BC1 colour block. BC3 colour blocks always use four colours, BC1 switches to three
+    // colours plus transparent black when the first endpoint isn't the larger one.
+    static void decodeColors(const uchar* block, bool allowTransparent, uchar (*pixels)[4]) {
+        const quint16 c0 = quint16(block[0] | (block[1] << 8));
+        const quint16 c1 = quint16(block[2] | (block[3] << 8));
+        const quint32 indices = quint32(block[4]) | (quint32(block[5]) << 8) | (quint32(block[6]) << 16) | (quint32(block[7]) << 24);
+
+        uchar palette[4][4];
+        expand565(c0, palette[0]);
+        expand565(c1, palette[1]);
+
+        if (!allowTransparent || c0 > c1) {
+            for (int ch = 0; ch < 3; ++ch) {
+                palette[2][ch] = uchar((2 * palette[0][ch] + palette[1][ch]) / 3);
+                palette[3][ch] = uchar((palette[0][ch] + 2 * palette[1][ch]) / 3);
+            }
+            palette[2][3] = 255;
+            palette[3][3] = 255;
+        } else {
+            for (int ch = 0; ch < 3; ++ch) {
+                palette[2][ch] = uchar((palette[0][ch] + palette[1][ch]) / 2);
+            }
+            palette[2][3] = 255;
+            memset(palette[3], 0, 4);
+        }
+
+        for (int i = 0; i < 16; ++i) {
+            memcpy(pixels[i], palette[(indices >> (2 * i)) & 3], 4);
+        }
+    }
+
+    // --- BC7 ---
+
+    struct Bc7Mode {
+        int subsets;
+        int partitionBits;
+        int rotationBits;
+        int indexSelectionBits;
+        int colorBits;
+        int alphaBits;
+        int endpointPBits;  // One p-bit per endpoint
+        int sharedPBits;    // One p-bit per subset
+        int indexBits;
+        int index2Bits;
+    };
+
+    static const Bc7Mode bc7Modes[8] = {
+        { 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+        { 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+        { 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+        { 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+        { 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+        { 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+        { 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+        { 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 },
+    };
+
+    // Subset of each pixel, 2 bits per pixel starting at pixel 0
+    static const quint32 bc7Partitions2[64] = {
+        0x50505050, 0x40404040, 0x54545454, 0x54505040, 0x50404000, 0x55545450, 0x55545040, 0x54504000,
+        0x50400000, 0x55555450, 0x55544000, 0x54400000, 0x55555440, 0x55550000, 0x55555500, 0x55000000,
+        0x55150100, 0x00004054, 0x15010000, 0x00405054, 0x00004050, 0x15050100, 0x05010000, 0x40505054,
+        0x00404050, 0x05010100, 0x14141414, 0x05141450, 0x01155440, 0x00555500, 0x15014054, 0x05414150,
+        0x44444444, 0x55005500, 0x11441144, 0x05055050, 0x05500550, 0x11114444, 0x41144114, 0x44111144,
+        0x15055054, 0x01055040, 0x05041050, 0x05455150, 0x14414114, 0x50050550, 0x41411414, 0x00141400,
+        0x00041504, 0x00105410, 0x10541000, 0x04150400, 0x50410514, 0x41051450, 0x05415014, 0x14054150,
+        0x41050514, 0x41505014, 0x40011554, 0x54150140, 0x50505500, 0x00555050, 0x15151010, 0x54540404,
+    };
+
+    static const quint32 bc7Partitions3[64] = {
+        0xAA685050, 0x6A5A5040, 0x5A5A4200, 0x5450A0A8, 0xA5A50000, 0xA0A05050, 0x5555A0A0, 0x5A5A5050,
+        0xAA550000, 0xAA555500, 0xAAAA5500, 0x90909090, 0x94949494, 0xA4A4A4A4, 0xA9A59450, 0x2A0A4250,
+        0xA5945040, 0x0A425054, 0xA5A5A500, 0x55A0A0A0, 0xA8A85454, 0x6A6A4040, 0xA4A45000, 0x1A1A0500,
+        0x0050A4A4, 0xAAA59090, 0x14696914, 0x69691400, 0xA08585A0, 0xAA821414, 0x50A4A450, 0x6A5A0200,
+        0xA9A58000, 0x5090A0A8, 0xA8A09050, 0x24242424, 0x00AA5500, 0x24924924, 0x24499224, 0x50A50A50,
+        0x500AA550, 0xAAAA4444, 0x66660000, 0xA5A0A5A0, 0x50A050A0, 0x69286928, 0x44AAAA44, 0x66666600,
+        0xAA444444, 0x54A854A8, 0x95809580, 0x96969600, 0xA85454A8, 0x80959580, 0xAA141414, 0x96960000,
+        0xAAAA1414, 0xA05050A0, 0xA0A5A5A0, 0x96000000, 0x40804080, 0xA9A8A9A8, 0xAAAAAA44, 0x2A4A5254,
+    };
+
+    // Anchor pixel of the second subset for two-subset partitions
+    static const uchar bc7Anchors2[64] = {
+        15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+        15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+        15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+        6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15,
+    };
+
+    // Anchor pixels of the second and third subsets for three-subset partitions
+    static const uchar bc7Anchors3b[64] = {
+        3, 3, 15, 15, 8, 3, 15, 15, 8, 8, 6, 6, 6, 5, 3, 3,
+        3, 3, 8, 15, 3, 3, 6, 10, 5, 8, 8, 6, 8, 5, 15, 15,
+        8, 15, 3, 5, 6, 10, 8, 15, 15, 3, 15, 5, 15, 15, 15, 15,
+        3, 15, 5, 5, 5, 8, 5, 10, 5, 10, 8, 13, 15, 12, 3, 3,
+    };
+
+    static const uchar bc7Anchors3c[64] = {
+        15, 8, 8, 3, 15, 15, 3, 8, 15, 15, 15, 15, 15, 15, 15, 8,
+        15, 8, 15, 3, 15, 8, 15, 8, 3, 15, 6, 10, 15, 15, 10, 8,
+        15, 3, 15, 10, 10, 8, 9, 10, 6, 15, 8, 15, 3, 6, 6, 8,
+        15, 3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 3, 15, 15, 8,
+    };
+
+    static const quint16 bc7Weights2[4] = { 0, 21, 43, 64 };
+    static const quint16 bc7Weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+    static const quint16 bc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    static const quint16* bc7Weights(int bits) {
+        return bits == 2 ? bc7Weights2 : (bits == 3 ? bc7Weights3 : bc7Weights4);
+    }
+
+    // Reads a 128-bit block LSB first
+    class BitReader {
+    public:
+        explicit BitReader(const uchar* block) {
+            for (int i = 7; i >= 0; --i) {
+                m_lo = (m_lo << 8) | block[i];
+                m_hi = (m_hi << 8) | block[i + 8];
+            }
+        }
+
+        uint read(int count) {
+            quint64 value;
+            if (m_pos >= 64) {
+                value = m_hi >> (m_pos - 64);
+            } else if (m_pos + count <= 64) {
+                value = m_lo >> m_pos;
+            } else {
+                value = (m_lo >> m_pos) | (m_hi << (64 - m_pos));
+            }
+            m_pos += count;
+            return uint(value) & ((1u << count) - 1);
+        }
+
+    private:
+        quint64 m_lo = 0;
+        quint64 m_hi = 0;
+        int m_pos = 0;
+    };
+
+    // Palette entry k = ((64 - w[k]) * e0 + w[k] * e1 + 32) >> 6 for all four channels
+#ifdef BCN_DECODER_SSE2
+    // Two palette entries (eight 16-bit channels) per step. count is always even.
+    static void interpolateRamp(const uchar e0[4], const uchar e1[4], const quint16* weights, int count, uchar (*out)[4]) {
+        const __m128i zero = _mm_setzero_si128();
+        quint32 packed0, packed1;
+        memcpy(&packed0, e0, 4);
+        memcpy(&packed1, e1, 4);
+        __m128i a = _mm_unpacklo_epi8(_mm_cvtsi32_si128(int(packed0)), zero);
+        __m128i b = _mm_unpacklo_epi8(_mm_cvtsi32_si128(int(packed1)), zero);
+        a = _mm_unpacklo_epi64(a, a);
+        b = _mm_unpacklo_epi64(b, b);
+
+        const __m128i sixtyFour = _mm_set1_epi16(64);
+        const __m128i half = _mm_set1_epi16(32);
+        for (int k = 0; k < count; k += 2) {
+            const short w0 = short(weights[k]);
+            const short w1 = short(weights[k + 1]);
+            const __m128i w = _mm_set_epi16(w1, w1, w1, w1, w0, w0, w0, w0);
+            const __m128i iw = _mm_sub_epi16(sixtyFour, w);
+            __m128i sum = _mm_add_epi16(_mm_mullo_epi16(a, iw), _mm_mullo_epi16(b, w));
+            sum = _mm_srli_epi16(_mm_add_epi16(sum, half), 6);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out[k]), _mm_packus_epi16(sum, sum));
+        }
+    }
+#else
+    static void interpolateRamp(const uchar e0[4], const uchar e1[4], const quint16* weights, int count, uchar (*out)[4]) {
+        for (int k = 0; k < count; ++k) {
+            const uint w = weights[k];
+            for (int ch = 0; ch < 4; ++ch) {
+                out[k][ch] = uchar(((64 - w) * e0[ch] + w * e1[ch] + 32) >> 6);
+            }
+        }
+    }
+#endif
+
+    static void decodeBc7(const uchar* block, uchar (*pixels)[4]) {
+        if (block[0] == 0) {
+            // Reserved mode, decoders output transparent black
+            memset(pixels, 0, 64);
+            return;
+        }
+
+        int modeIndex = 0;
+        while (!(block[0] & (1 << modeIndex))) {
+            ++modeIndex;
+        }
+        const Bc7Mode& mode = bc7Modes[modeIndex];
+
+        BitReader bits(block);
+        bits.read(modeIndex + 1);
+        const uint partition = bits.read(mode.partitionBits);
+        const uint rotation = bits.read(mode.rotationBits);
+        const uint indexSelection = bits.read(mode.indexSelectionBits);
+
+        // Endpoints are stored channel by channel: all R, then G, then B, then A
+        uchar endpoints[3][2][4];
+        for (int ch = 0; ch < 3; ++ch) {
+            for (int s = 0; s < mode.subsets; ++s) {
+                endpoints[s][0][ch] = uchar(bits.read(mode.colorBits));
+                endpoints[s][1][ch] = uchar(bits.read(mode.colorBits));
+            }
+        }
+        for (int s = 0; s < mode.subsets; ++s) {
+            endpoints[s][0][3] = mode.alphaBits ? uchar(bits.read(mode.alphaBits)) : 255;
+            endpoints[s][1][3] = mode.alphaBits ? uchar(bits.read(mode.alphaBits)) : 255;
+        }
+        // P-bits add one low bit to every channel of an endpoint
+        const bool hasPBits = mode.endpointPBits || mode.sharedPBits;
+        if (hasPBits) {
+            for (int s = 0; s < mode.subsets; ++s) {
+                uint p[2];
+                p[0] = bits.read(1);
+                p[1] = mode.endpointPBits ? bits.read(1) : p[0];
+                for (int e = 0; e < 2; ++e) {
+                    for (int ch = 0; ch < 3; ++ch) {
+                        endpoints[s][e][ch] = uchar((endpoints[s][e][ch] << 1) | p[e]);
+                    }
+                    if (mode.alphaBits) {
+                        endpoints[s][e][3] = uchar((endpoints[s][e][3] << 1) | p[e]);
+                    }
+                }
+            }
+        }
+
+        // Widen to 8 bits by repeating the top bits into the bottom
+        const int colorPrecision = mode.colorBits + (hasPBits ? 1 : 0);
+        const int alphaPrecision = mode.alphaBits ? mode.alphaBits + (hasPBits ? 1 : 0) : 8;
+        for (int s = 0; s < mode.subsets; ++s) {
+            for (int e = 0; e < 2; ++e) {
+                for (int ch = 0; ch < 4; ++ch) {
+                    const int precision = ch < 3 ? colorPrecision : alphaPrecision;
+                    uint v = endpoints[s][e][ch];
+                    v = (v << (8 - precision)) | (v >> (2 * precision - 8));
+                    endpoints[s][e][ch] = uchar(v);
+                }
+            }
+        }
+
+        const quint32 partitionWord = mode.subsets == 2 ? bc7Partitions2[partition]
+            : (mode.subsets == 3 ? bc7Partitions3[partition] : 0);
+        const int anchor1 = mode.subsets == 2 ? bc7Anchors2[partition]
+            : (mode.subsets == 3 ? bc7Anchors3b[partition] : -1);
+        const int anchor2 = mode.subsets == 3 ? bc7Anchors3c[partition] : -1;
+
+        // Anchor pixels drop the top bit of their index, it is always 0
+        uchar indices[16];
+        for (int i = 0; i < 16; ++i) {
+            const bool anchor = (i == 0 || i == anchor1 || i == anchor2);
+            indices[i] = uchar(bits.read(anchor ? mode.indexBits - 1 : mode.indexBits));
+        }
+
+        uchar indices2[16];
+        if (mode.index2Bits) {
+            for (int i = 0; i < 16; ++i) {
+                indices2[i] = uchar(bits.read(i == 0 ? mode.index2Bits - 1 : mode.index2Bits));
+            }
+        }
+
+        // Mode 4 can swap which index set drives colour and which drives alpha
+        const uchar* colorIndices = indices;
+        const uchar* alphaIndices = mode.index2Bits ? indices2 : indices;
+        int colorIndexBits = mode.indexBits;
+        int alphaIndexBits = mode.index2Bits ? mode.index2Bits : mode.indexBits;
+        if (indexSelection) {
+            std::swap(colorIndices, alphaIndices);
+            std::swap(colorIndexBits, alphaIndexBits);
+        }
+
+        uchar colorRamp[3][16][4];
+        uchar alphaRamp[3][16][4];
+        for (int s = 0; s < mode.subsets; ++s) {
+            interpolateRamp(endpoints[s][0], endpoints[s][1], bc7Weights(colorIndexBits), 1 << colorIndexBits, colorRamp[s]);
+            if (alphaIndices != colorIndices) {
+                interpolateRamp(endpoints[s][0], endpoints[s][1], bc7Weights(alphaIndexBits), 1 << alphaIndexBits, alphaRamp[s]);
+            }
+        }
+        const uchar (*alphaSource)[16][4] = (alphaIndices != colorIndices) ? alphaRamp : colorRamp;
+
+        for (int i = 0; i < 16; ++i) {
+            const int s = (partitionWord >> (2 * i)) & 3;
+            memcpy(pixels[i], colorRamp[s][colorIndices[i]], 3);
+            pixels[i][3] = alphaSource[s][alphaIndices[i]][3];
+
+            if (rotation) {
+                std::swap(pixels[i][3], pixels[i][rotation - 1]);
+            }
+        }
+    }
+
+    // --- Public API ---
+
+    int blockBytes(CompressionFormat format) {
+        return format == CompressionFormat::BC1 ? 8 : 16;
+    }
+
+    qsizetype surfaceBytes(CompressionFormat format, int width, int height) {
+        const qsizetype blocksWide = (qsizetype(width) + 3) / 4;
+        const qsizetype blocksHigh = (qsizetype(height) + 3) / 4;
+        return blocksWide * blocksHigh * blockBytes(format);
+    }
+
+    void decodeBlockBC1(const uchar* block, uchar* out, qsizetype stride) {
+        uchar pixels[16][4];
+        decodeColors(block, true, pixels);
+        writeBlock(pixels, out, stride);
+    }
+
+    void decodeBlockBC3(const uchar* block, uchar* out, qsizetype stride) {
+        uchar pixels[16][4];
+        decodeColors(block + 8, false, pixels);
+
+        uchar alpha[8];
+        alpha[0] = block[0];
+        alpha[1] = block[1];
+        if (alpha[0] > alpha[1]) {
+            for (int k = 1; k < 7; ++k) {
+                alpha[k + 1] = uchar(((7 - k) * alpha[0] + k * alpha[1] + 3) / 7);
+            }
+        } else {
+            for (int k = 1; k < 5; ++k) {
+                alpha[k + 1] = uchar(((5 - k) * alpha[0] + k * alpha[1] + 2) / 5);
+            }
+            alpha[6] = 0;
+            alpha[7] = 255;
+        }
+
+        quint64 indices = 0;
+        for (int i = 7; i >= 2; --i) {
+            indices = (indices << 8) | block[i];
+        }
+        for (int i = 0; i < 16; ++i) {
+            pixels[i][3] = alpha[(indices >> (3 * i)) & 7];
+        }
+        writeBlock(pixels, out, stride);
+    }
+
+    void decodeBlockBC7(const uchar* block, uchar* out, qsizetype stride) {
+        uchar pixels[16][4];
+        decodeBc7(block, pixels);
+        writeBlock(pixels, out, stride);
+    }
+
+    void decode(CompressionFormat format, const uchar* blocks, int width, int height, uchar* out, qsizetype bytesPerLine) {
+        void (*decodeBlock)(const uchar*, uchar*, qsizetype) =
+            format == CompressionFormat::BC1 ? decodeBlockBC1
+            : (format == CompressionFormat::BC3 ? decodeBlockBC3 : decodeBlockBC7);
+        const int step = blockBytes(format);
+        const int blocksWide = (width + 3) / 4;
+        const int blocksHigh = (height + 3) / 4;
+
+        for (int by = 0; by < blocksHigh; ++by) {
+            for (int bx = 0; bx < blocksWide; ++bx) {
+                const uchar* block = blocks + (qsizetype(by) * blocksWide + bx) * step;
+                const int x = bx * 4;
+                const int y = by * 4;
+                uchar* target = out + qsizetype(y) * bytesPerLine + qsizetype(x) * 4;
+
+                if (x + 4 <= width && y + 4 <= height) {
+                    decodeBlock(block, target, bytesPerLine);
+                    continue;
+                }
+
+                // Edge block of a size that isn't a multiple of 4, keep only the pixels inside
+                uchar scratch[4 * 16];
+                decodeBlock(block, scratch, 16);
+                const int w = std::min(4, width - x);
+                const int h = std::min(4, height - y);
+                for (int row = 0; row < h; ++row) {
+                    memcpy(target + qsizetype(row) * bytesPerLine, scratch + row * 16, size_t(w) * 4);
+                }
+            }
+        }
+    }
+
+    QImage decode(CompressionFormat format, const QByteArray& blocks, int width, int height) {
+        if (width <= 0 || height <= 0 || blocks.size() < surfaceBytes(format, width, height)) {
+            return QImage();
+        }
+
+        QImage image(width, height, QImage::Format_RGBA8888);
+        if (image.isNull()) {
+            return QImage();
+        }
+
+        decode(format, reinterpret_cast<const uchar*>(blocks.constData()), width, height, image.bits(), image.bytesPerLine());
+        return image;
+    }
+
+} // namespace BcnDecoder
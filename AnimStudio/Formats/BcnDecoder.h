@@ -0,0 +1,46 @@
+// BcnDecoder.h
+#pragma once
+
+#include "ImageFormats.h"
+#include <QByteArray>
+#include <QImage>
+#include <QtGlobal>
+
+// Software decoders for the block-compressed formats AnimStudio writes to DDS (BC1, BC3, BC7).
+// Blocks decode straight into RGBA8888 rows. BC7 endpoint interpolation uses SSE2 where the
+// build targets it. Every path gives the same pixels as CMP_ConvertMipTexture, which DDS frames
+// were decoded with before, except for BC7 blocks in the reserved mode: those are transparent
+// black as D3D specifies, where Compressonator leaves them unwritten. Tests/BcnDecoderTest
+// checks this.
+namespace BcnDecoder {
+
+    // Bytes per 4x4 block: 8 for BC1, 16 for BC3 and BC7
+    int blockBytes(CompressionFormat format);
+
+    // Bytes of block data for a width x height surface, partial blocks round up
+    qsizetype surfaceBytes(CompressionFormat format, int width, int height);
+
+    // Decode surfaceBytes() bytes of blocks into height rows of width RGBA8888 pixels
+    void decode(CompressionFormat format, const uchar* blocks, int width, int height, uchar* out, qsizetype bytesPerLine);
+
+    // Decode into a new Format_RGBA8888 image. Null if blocks is too short for the size.
+    QImage decode(CompressionFormat format, const QByteArray& blocks, int width, int height);
+
+    // One block to 4 rows of 4 RGBA8888 pixels, rows 'stride' bytes apart
+    void decodeBlockBC1(const uchar* block, uchar* out, qsizetype stride);
+    void decodeBlockBC3(const uchar* block, uchar* out, qsizetype stride);
+    void decodeBlockBC7(const uchar* block, uchar* out, qsizetype stride);
+
+} // namespace BcnDecoder
+
+// Top mip level of a block-compressed DDS frame, kept as it was in the file.
+// Takes a quarter (BC7, BC3) or an eighth (BC1) of the memory of the decoded pixels.
+struct BcnImage {
+    CompressionFormat format = CompressionFormat::BC7;
+    int width = 0;
+    int height = 0;
+    QByteArray blocks;
+
+    bool isNull() const { return blocks.isEmpty(); }
+    QImage decode() const { return BcnDecoder::decode(format, blocks, width, height); }
+};
@@ -0,0 +1,239 @@
+#include "DdsBatchEncoder.h"
+#include "compressonator.h"
+#include "Animation/StagePool.h"
+
+#include <QtConcurrent/QtConcurrent>
+#include <QAtomicInt>
+#include <QDebug>
+#include <QMutex>
+#include <algorithm>
+#include <mutex>
+#include <numeric>
+#include <vector>
+
+namespace {
+    CMP_FORMAT toCmpFormat(CompressionFormat format) {
+        switch (format) {
+        case CompressionFormat::BC1:
+            return CMP_FORMAT_BC1;
+        case CompressionFormat::BC3:
+            return CMP_FORMAT_BC3;
+        case CompressionFormat::BC7:
+        default:
+            return CMP_FORMAT_BC7;
+        }
+    }
+
+    // An uncompressed RGBA source mip set. The level buffers are kept between frames and
+    // only reallocated when the frame size changes.
+    class SourceMipSet {
+    public:
+        SourceMipSet() = default;
+        ~SourceMipSet() { release(); }
+        SourceMipSet(const SourceMipSet&) = delete;
+        SourceMipSet& operator=(const SourceMipSet&) = delete;
+
+        bool load(const QImage& image, int mipLevels);
+        CMP_MipSet* get() { return &m_set; }
+
+    private:
+        void release();
+
+        CMP_MipSet m_set = {};
+        bool m_allocated = false;
+    };
+
+    void SourceMipSet::release() {
+        if (m_allocated) {
+            CMP_FreeMipSet(&m_set);
+            m_set = {};
+            m_allocated = false;
+        }
+    }
+
+    bool SourceMipSet::load(const QImage& image, int mipLevels) {
+        const QImage rgba = image.convertToFormat(QImage::Format_RGBA8888);
+        const int width = rgba.width();
+        const int height = rgba.height();
+
+        if (!m_allocated || m_set.m_nWidth != width || m_set.m_nHeight != height) {
+            release();
+            if (CMP_CreateMipSet(&m_set, width, height, 1, CF_8bit, TT_2D) != CMP_OK) {
+                qWarning() << "Failed to create source MipSet for writing.";
+                return false;
+            }
+            m_allocated = true;
+            m_set.m_format = CMP_FORMAT_RGBA_8888;
+            m_set.m_nBlockDepth = 1;
+        }
+
+        CMP_MipLevel* level = nullptr;
+        CMP_GetMipLevel(&level, &m_set, 0, 0);
+        if (!level || !level->m_pbData) {
+            qWarning() << "Failed to get source MipLevel.";
+            return false;
+        }
+
+        // RGBA8888 rows are always tightly packed, so the whole image is one copy
+        memcpy(level->m_pbData, rgba.constBits(), size_t(rgba.sizeInBytes()));
+        m_set.m_nMipLevels = 1;
+
+        if (mipLevels == 1) {
+            return true;
+        }
+
+        // The chain stops once both sides are no bigger than nMinSize, 0 runs it down to 1x1
+        const int minSize = mipLevels > 1 ? (std::max(width, height) >> std::min(mipLevels - 1, 30)) : 0;
+        if (CMP_GenerateMIPLevels(&m_set, minSize) != CMP_OK) {
+            qWarning() << "Failed to generate mipmaps.";
+            return false;
+        }
+
+        // Odd sizes can round to one level more than asked for
+        if (mipLevels > 1) {
+            m_set.m_nMipLevels = std::min(m_set.m_nMipLevels, mipLevels);
+        }
+        return true;
+    }
+
+    CMP_ERROR compressHpc(CMP_MipSet* source, CMP_MipSet* out, CMP_FORMAT format, float quality) {
+        static std::once_flag frameworkReady;
+        std::call_once(frameworkReady, CMP_InitFramework);
+
+        KernelOptions kernel = {};
+        kernel.format = format;
+        kernel.fquality = quality;
+        kernel.encodeWith = CMP_HPC;
+        kernel.threads = 0;   // Compressonator runs one HPC texture at a time, so always let it use every core
+        return CMP_ProcessTexture(source, out, kernel, nullptr);
+    }
+
+    CMP_ERROR compressCpu(CMP_MipSet* source, CMP_MipSet* out, CMP_FORMAT format, float quality, int threads) {
+        CMP_CompressOptions options = {};
+        options.dwSize = sizeof(CMP_CompressOptions);
+        options.SourceFormat = source->m_format;
+        options.DestFormat = format;
+        options.fquality = quality;
+        options.dwnumThreads = threads;
+        options.bDisableMultiThreading = (threads == 1);
+        return CMP_ConvertMipTexture(source, out, &options, nullptr);
+    }
+
+    // Compress one frame and save it. threads is the per-texture thread count, 0 is automatic.
+    bool encodeFrame(SourceMipSet& source, const QImage& image, const QString& path,
+        CMP_FORMAT format, const DdsSettings& settings, int threads)
+    {
+        if (!source.load(image, settings.mipLevels)) {
+            return false;
+        }
+
+        // The converters reset the output set themselves, it only has to be freed afterwards
+        CMP_MipSet out = {};
+        CMP_ERROR result = CMP_ERR_GENERIC;
+
+        if (settings.backend == DdsBackend::Hpc) {
+            result = compressHpc(source.get(), &out, format, settings.quality);
+            if (result != CMP_OK) {
+                qWarning() << "HPC encoder failed, falling back to CPU. Error:" << result;
+                CMP_FreeMipSet(&out);
+                out = {};
+            }
+        }
+
+        if (result != CMP_OK) {
+            result = compressCpu(source.get(), &out, format, settings.quality, threads);
+        }
+
+        if (result != CMP_OK) {
+            qWarning() << "Failed to compress texture. Error:" << result;
+            CMP_FreeMipSet(&out);
+            return false;
+        }
+
+        const bool saved = CMP_SaveTexture(path.toStdString().c_str(), &out) == CMP_OK;
+        if (!saved) {
+            qWarning() << "Failed to save DDS file:" << path;
+        }
+
+        CMP_FreeMipSet(&out);
+        return saved;
+    }
+}
+
+DdsBatchEncoder::DdsBatchEncoder(CompressionFormat format, const DdsSettings& settings)
+    : m_format(format)
+    , m_settings(settings)
+{
+}
+
+void DdsBatchEncoder::setWorkerCount(int workers) {
+    m_workerCount = workers;
+}
+
+void DdsBatchEncoder::setThreadPool(QThreadPool* pool) {
+    m_threadPool = pool;
+}
+
+void DdsBatchEncoder::setProgressCallback(std::function<void(float)> cb) {
+    m_progressCallback = std::move(cb);
+}
+
+QVector<int> DdsBatchEncoder::write(const QStringList& paths, const std::function<QImage(int)>& frameAt)
+{
+    const int total = static_cast<int>(paths.size());
+    QVector<int> failed;
+    if (total == 0) {
+        return failed;
+    }
+
+    const CMP_FORMAT format = toCmpFormat(m_format);
+    const int cores = m_workerCount > 0 ? m_workerCount : std::max(1, QThread::idealThreadCount());
+    const int workerCount = std::max(1, std::min(cores, total - 1));
+
+    // One frame per worker only pays off with enough frames to go around. Otherwise
+    // leave the threading to the codec, which splits a texture into blocks.
+    const int textureThreads = (cores > 1 && total - 1 >= cores) ? 1 : 0;
+
+    std::vector<SourceMipSet> sources(workerCount);
+
+    QMutex progressMutex;
+    QVector<bool> done(total, false);
+    int doneInOrder = 0;    // Frames before this one are all done
+    auto frameDone = [&](int i, bool ok) {
+        QMutexLocker lock(&progressMutex);
+        if (!ok) {
+            failed.append(i);
+        }
+        done[i] = true;
+        const int before = doneInOrder;
+        while (doneInOrder < total && done[doneInOrder]) {
+            ++doneInOrder;
+        }
+        if (m_progressCallback && doneInOrder > before) {
+            m_progressCallback(static_cast<float>(doneInOrder) / total);
+        }
+    };
+
+    // The first frame runs alone with the codec's own threading. This also builds the
+    // codecs' shared lookup tables, whose lazy setup isn't safe to race from several workers.
+    frameDone(0, encodeFrame(sources[0], frameAt(0), paths[0], format, m_settings, 0));
+
+    if (total > 1) {
+        StagePool pool(m_threadPool, workerCount);
+
+        // Each worker owns a source mip set and pulls frames until none are left
+        QVector<int> workers(workerCount);
+        std::iota(workers.begin(), workers.end(), 0);
+        QAtomicInt next(1);
+
+        QtConcurrent::blockingMap(pool.get(), workers, [&](int worker) {
+            for (int i = next.fetchAndAddRelaxed(1); i < total; i = next.fetchAndAddRelaxed(1)) {
+                const bool ok = encodeFrame(sources[worker], frameAt(i), paths[i], format, m_settings, textureThreads);
+                frameDone(i, ok);
+            }
+        });
+    }
+
+    std::sort(failed.begin(), failed.end());
+    return failed;
+}
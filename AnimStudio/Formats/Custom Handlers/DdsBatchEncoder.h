@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Formats/ImageFormats.h"
+#include <QImage>
+#include <QStringList>
+#include <QVector>
+#include <functional>
+
+class QThreadPool;
+
+// Compresses a whole list of frames to DDS files. Each worker keeps its source mip set
+// between frames instead of creating and freeing one per texture, and the work is spread
+// over frames rather than over blocks of a single texture, so small frames (64x64 UI
+// animations) still keep every core busy.
+class DdsBatchEncoder {
+public:
+    explicit DdsBatchEncoder(CompressionFormat format, const DdsSettings& settings = DdsSettings());
+
+    // 0 (the default) uses one worker per core
+    void setWorkerCount(int workers);
+
+    // Run the workers on this pool instead of a private one, see StagePool
+    void setThreadPool(QThreadPool* pool);
+
+    // Call with values from 0.0 to 1.0 (progress %), in frame order: a frame that finishes early
+    // is only counted once every frame before it is done
+    void setProgressCallback(std::function<void(float)> cb);
+
+    // Compress frameAt(i) and save it to paths[i]. frameAt is called from the worker threads.
+    // A failed frame does not stop the others, the indices of every failed frame are returned.
+    QVector<int> write(const QStringList& paths, const std::function<QImage(int)>& frameAt);
+
+private:
+    CompressionFormat m_format;
+    DdsSettings m_settings;
+    int m_workerCount = 0;
+    QThreadPool* m_threadPool = nullptr;
+    std::function<void(float)> m_progressCallback;
+};
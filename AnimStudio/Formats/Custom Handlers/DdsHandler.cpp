@@ -1,14 +1,166 @@
 #include "DdsHandler.h"
+#include "DdsBatchEncoder.h"
 #include "compressonator.h"
 #include <QDebug>
+#include <QFile>
 #include <QImage>
+#include <optional>
 
 // If Compressonator needs updates then we'll have to rebuild the debug and release libs.
 // Get the Compressonator SDK source. Last time we built with cmp_compressonatorlib.sln in build_sdk
 // we built the release_MD and debug_MD versions. Copy the .lib and the compressonator.h into
 // dependencies and call it a day. Compiling for other platforms was not handled.
 
+namespace {
+    constexpr qint64 DDS_HEADER_SIZE = 128;         // Magic plus the 124 byte DDS_HEADER
+    constexpr qint64 DDS_DX10_HEADER_SIZE = 20;
+    constexpr quint32 DDPF_FOURCC = 0x4;
+
+    quint32 readU32(const uchar* p) {
+        return quint32(p[0]) | (quint32(p[1]) << 8) | (quint32(p[2]) << 16) | (quint32(p[3]) << 24);
+    }
+
+    quint32 fourCC(const char* code) {
+        return readU32(reinterpret_cast<const uchar*>(code));
+    }
+
+    // Where the top mip level's blocks are in a mapped DDS file
+    struct DdsSurface {
+        CompressionFormat format;
+        int width;
+        int height;
+        const uchar* blocks;
+    };
+
+    // Only the block formats we write ourselves are handled, everything else returns nullopt.
+    // Without checkData only the headers need to be there and blocks may point past size.
+    std::optional<DdsSurface> parseDds(const uchar* data, qint64 size, bool checkData = true) {
+        if (!data || size < DDS_HEADER_SIZE || readU32(data) != fourCC("DDS ") || readU32(data + 4) != 124) {
+            return std::nullopt;
+        }
+
+        DdsSurface surface;
+        surface.height = int(readU32(data + 12));
+        surface.width = int(readU32(data + 16));
+        if (surface.width <= 0 || surface.height <= 0) {
+            return std::nullopt;
+        }
+
+        if (!(readU32(data + 80) & DDPF_FOURCC)) {
+            return std::nullopt;
+        }
+
+        qint64 offset = DDS_HEADER_SIZE;
+        const quint32 code = readU32(data + 84);
+        if (code == fourCC("DXT1")) {
+            surface.format = CompressionFormat::BC1;
+        } else if (code == fourCC("DXT5")) {
+            surface.format = CompressionFormat::BC3;
+        } else if (code == fourCC("DX10")) {
+            if (size < DDS_HEADER_SIZE + DDS_DX10_HEADER_SIZE) {
+                return std::nullopt;
+            }
+            // DXGI_FORMAT values: BC1 70-72, BC3 76-78, BC7 97-99 (typeless, unorm, srgb)
+            const quint32 dxgiFormat = readU32(data + DDS_HEADER_SIZE);
+            if (dxgiFormat >= 70 && dxgiFormat <= 72) {
+                surface.format = CompressionFormat::BC1;
+            } else if (dxgiFormat >= 76 && dxgiFormat <= 78) {
+                surface.format = CompressionFormat::BC3;
+            } else if (dxgiFormat >= 97 && dxgiFormat <= 99) {
+                surface.format = CompressionFormat::BC7;
+            } else {
+                return std::nullopt;
+            }
+            offset += DDS_DX10_HEADER_SIZE;
+        } else {
+            return std::nullopt;
+        }
+
+        if (checkData && size - offset < BcnDecoder::surfaceBytes(surface.format, surface.width, surface.height)) {
+            qWarning() << "DDS file is shorter than its top mip level.";
+            return std::nullopt;
+        }
+
+        surface.blocks = data + offset;
+        return surface;
+    }
+}
+
 bool DdsHandler::read(QImage* image)
+{
+    QFile file(m_device);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open texture:" << m_device;
+        return false;
+    }
+
+    // Decode straight from the mapped file into the image, no intermediate mip sets.
+    // The mapping goes away with the QFile.
+    const uchar* data = file.map(0, file.size());
+    if (const std::optional<DdsSurface> surface = parseDds(data, file.size())) {
+        QImage img(surface->width, surface->height, QImage::Format_RGBA8888);
+        if (img.isNull()) {
+            qWarning() << "Failed to allocate image for texture:" << m_device;
+            return false;
+        }
+
+        BcnDecoder::decode(surface->format, surface->blocks, surface->width, surface->height, img.bits(), img.bytesPerLine());
+        *image = img;
+        return true;
+    }
+
+    file.close();
+    return readWithCompressonator(image);
+}
+
+bool DdsHandler::readCompressed(BcnImage* image)
+{
+    QFile file(m_device);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open texture:" << m_device;
+        return false;
+    }
+
+    const std::optional<DdsSurface> surface = parseDds(file.map(0, file.size()), file.size());
+    if (!surface) {
+        return false;
+    }
+
+    image->format = surface->format;
+    image->width = surface->width;
+    image->height = surface->height;
+    image->blocks = QByteArray(reinterpret_cast<const char*>(surface->blocks),
+        BcnDecoder::surfaceBytes(surface->format, surface->width, surface->height));
+    return true;
+}
+
+bool DdsHandler::readInfo(QSize* size, QString* pixelFormat)
+{
+    QFile file(m_device);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const QByteArray head = file.read(DDS_HEADER_SIZE + DDS_DX10_HEADER_SIZE);
+    const uchar* data = reinterpret_cast<const uchar*>(head.constData());
+    if (head.size() < DDS_HEADER_SIZE || readU32(data) != fourCC("DDS ")) {
+        return false;
+    }
+
+    *size = QSize(int(readU32(data + 16)), int(readU32(data + 12)));
+    if (const std::optional<DdsSurface> surface = parseDds(data, head.size(), false)) {
+        switch (surface->format) {
+        case CompressionFormat::BC1: *pixelFormat = "bc1"; break;
+        case CompressionFormat::BC3: *pixelFormat = "bc3"; break;
+        default: *pixelFormat = "bc7"; break;
+        }
+    } else {
+        *pixelFormat = "other"; // Left to Compressonator when loading
+    }
+    return true;
+}
+
+bool DdsHandler::readWithCompressonator(QImage* image)
 {
     CMP_MipSet mipSetIn = {};
 
@@ -74,87 +226,8 @@ bool DdsHandler::read(QImage* image)
 
 bool DdsHandler::write(const QImage& image)
 {
-    QImage sourceImage = image.convertToFormat(QImage::Format_RGBA8888);
-
-    const int width = sourceImage.width();
-    const int height = sourceImage.height();
-    const int depth = 1;
-
-    // 1. Create source MipSet
-    CMP_MipSet mipSetIn = {};
-    if (CMP_CreateMipSet(&mipSetIn, width, height, depth, CF_8bit, TT_2D) != CMP_OK) {
-        qWarning() << "Failed to create source MipSet for writing.";
-        return false;
-    }
-
-    mipSetIn.m_format = CMP_FORMAT_RGBA_8888;
-    mipSetIn.m_nMipLevels = 1;
-
-    // Copy base level image data
-    CMP_MipLevel* mipLevelIn = nullptr;
-    CMP_GetMipLevel(&mipLevelIn, &mipSetIn, 0, 0);
-    if (!mipLevelIn) {
-        qWarning() << "Failed to get source MipLevel.";
-        CMP_FreeMipSet(&mipSetIn);
-        return false;
-    }
-    memcpy(mipLevelIn->m_pbData, sourceImage.bits(), sourceImage.sizeInBytes());
-
-    // 2. Generate mipmaps
-    if (CMP_GenerateMIPLevels(&mipSetIn, false) != CMP_OK) {
-        qWarning() << "Failed to generate mipmaps.";
-        CMP_FreeMipSet(&mipSetIn);
-        return false;
-    }
-
-    // 3. Create destination MipSet
-    CMP_MipSet mipSetOut = {};
-    if (CMP_CreateMipSet(&mipSetOut, width, height, depth, CF_Compressed, TT_2D) != CMP_OK) {
-        qWarning() << "Failed to create destination MipSet.";
-        CMP_FreeMipSet(&mipSetIn);
-        return false;
-    }
-
-    switch (m_compressionFormat) {
-    case CompressionFormat::BC1:
-        mipSetOut.m_format = CMP_FORMAT_BC1;
-        break;
-    case CompressionFormat::BC3:
-        mipSetOut.m_format = CMP_FORMAT_BC3;
-        break;
-    case CompressionFormat::BC7:
-        mipSetOut.m_format = CMP_FORMAT_BC7;
-        break;
-    }
-
-    mipSetOut.m_nMipLevels = mipSetIn.m_nMipLevels;
-
-    // 4. Set compression options
-    CMP_CompressOptions options = {};
-    options.dwSize = sizeof(CMP_CompressOptions);
-    options.SourceFormat = mipSetIn.m_format;
-    options.DestFormat = mipSetOut.m_format;
-    options.fquality = 0.8f;
-    options.dwnumThreads = 0;
-
-    // 5. Compress full mip chain
-    CMP_ERROR result = CMP_ConvertMipTexture(&mipSetIn, &mipSetOut, &options, nullptr);
-    if (result != CMP_OK) {
-        qWarning() << "Failed to compress texture. Error:" << result;
-        CMP_FreeMipSet(&mipSetIn);
-        CMP_FreeMipSet(&mipSetOut);
-        return false;
-    }
-
-    // 6. Save DDS
-    if (CMP_SaveTexture(m_device.toStdString().c_str(), &mipSetOut) != CMP_OK) {
-        qWarning() << "Failed to save DDS file:" << m_device;
-        CMP_FreeMipSet(&mipSetIn);
-        CMP_FreeMipSet(&mipSetOut);
-        return false;
-    }
-
-    CMP_FreeMipSet(&mipSetIn);
-    CMP_FreeMipSet(&mipSetOut);
-    return true;
-}
\ No newline at end of file
+    // A single frame is just a batch of one, the codec threads across the texture's blocks
+    DdsBatchEncoder encoder(m_compressionFormat, m_settings);
+    encoder.setWorkerCount(1);
+    return encoder.write({ m_device }, [&image](int) { return image; }).isEmpty();
+}
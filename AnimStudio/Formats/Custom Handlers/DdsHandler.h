@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Formats/BcnDecoder.h"
 #include "Formats/ImageFormats.h"
 #include <QImage>
 #include <QIODevice>
@@ -8,11 +9,22 @@ class DdsHandler {
 public:
     void setDevice(const QString& device) { m_device = device; }
     void setCompression(CompressionFormat format) { m_compressionFormat = format; }
+    void setSettings(const DdsSettings& settings) { m_settings = settings; }
 
+    // BC1, BC3 and BC7 files are parsed and decoded here, anything else goes through Compressonator
     bool read(QImage* image);
     bool write(const QImage& image);
 
+    // Top mip level of a BC1, BC3 or BC7 file without decoding it. False for other formats.
+    bool readCompressed(BcnImage* image);
+
+    // Size and block format from the headers only. False if the file is not a DDS.
+    bool readInfo(QSize* size, QString* pixelFormat);
+
 private:
+    bool readWithCompressonator(QImage* image);
+
     QString m_device;
     CompressionFormat m_compressionFormat = CompressionFormat::BC7;
+    DdsSettings m_settings;
 };
@@ -1,5 +1,8 @@
 #include "PcxHandler.h"
 #include <QDebug>
+#include <cstring>
+
+#include "Formats/RleKernels.h"
 
 // PCX magic number is 0x0A (first byte)
 bool PcxHandler::canRead() const {
@@ -8,6 +11,24 @@ bool PcxHandler::canRead() const {
     return magic.size() == 1 && static_cast<uchar>(magic[0]) == 0x0A;
 }
 
+bool PcxHandler::readInfo(QSize* size, QString* pixelFormat) {
+    if (!m_device) return false;
+
+    PCXHeader header;
+    const QByteArray head = m_device->peek(sizeof(PCXHeader));
+    if (head.size() < static_cast<int>(sizeof(PCXHeader))) return false;
+    memcpy(&header, head.constData(), sizeof(PCXHeader));
+
+    // Same checks as read(), only 8-bit single plane files are supported
+    if (header.Manufacturer != 0x0A || header.Encoding != 1 || header.BitsPerPixel != 8 || header.Nplanes != 1) {
+        return false;
+    }
+
+    *size = QSize(header.Xmax - header.Xmin + 1, header.Ymax - header.Ymin + 1);
+    *pixelFormat = "indexed8";
+    return true;
+}
+
 bool PcxHandler::read(QImage* image) {
     if (!m_device || !image) return false;
 
@@ -82,20 +103,23 @@ bool PcxHandler::read(QImage* image) {
 }
 
 static void writeRleLine(QIODevice* dev, const uchar* data, int length) {
+    // Worst case is two bytes per pixel; the whole line goes out in one write
+    QByteArray line(length * 2, Qt::Uninitialized);
+    char* out = line.data();
+
     int i = 0;
     while (i < length) {
         uchar val = data[i];
-        int count = 1;
-        while (i + count < length && data[i + count] == val && count < 63) {
-            ++count;
-        }
+        int count = RleKernels::runLength(data + i, length - i, 63);
 
         if (count > 1 || (val & 0xC0) == 0xC0) {
-            dev->putChar(0xC0 | count);
+            *out++ = static_cast<char>(0xC0 | count);
         }
-        dev->putChar(val);
+        *out++ = static_cast<char>(val);
         i += count;
     }
+
+    dev->write(line.constData(), out - line.constData());
 }
 
 bool PcxHandler::write(const QImage& image) {
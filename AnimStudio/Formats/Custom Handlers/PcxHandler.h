@@ -11,6 +11,9 @@ public:
 
     bool canRead() const override;
     bool read(QImage* image) override;
+
+    // Size and pixel layout from the 128 byte header, without reading the device further
+    bool readInfo(QSize* size, QString* pixelFormat);
     bool write(const QImage& image) override;
 
 private:
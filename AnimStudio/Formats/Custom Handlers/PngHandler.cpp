@@ -0,0 +1,281 @@
+#include "PngHandler.h"
+#include "png.h"
+#include <QDebug>
+#include <QFile>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+// Most blocks libpng allocates for a frame: the read and info structs, the zlib state and
+// window, palette and row buffers. Anything over this is freed instead of kept.
+#define PNG_MAX_KEPT_BLOCKS 32
+
+// Each block starts with its size. png_struct holds a jmp_buf which needs 16-byte alignment on
+// x64, and 64-bit malloc returns 16-byte aligned memory, so the header is 16 bytes to keep it.
+// (alignof(std::max_align_t) is only 8 on MSVC.)
+#define PNG_BLOCK_HEADER 16
+
+namespace {
+    struct MemoryReader {
+        const uchar* data;
+        size_t size;
+        size_t pos;
+    };
+
+    void readFromMemory(png_structp png, png_bytep out, size_t length) {
+        MemoryReader* reader = static_cast<MemoryReader*>(png_get_io_ptr(png));
+        if (length > reader->size - reader->pos) {
+            png_error(png, "Read past the end of the PNG data");
+        }
+        memcpy(out, reader->data + reader->pos, length);
+        reader->pos += length;
+    }
+
+    void onError(png_structp png, png_const_charp message) {
+        qWarning() << "PNG error:" << message;
+        png_longjmp(png, 1);
+    }
+
+    void onWarning(png_structp, png_const_charp) {
+        // Same as Qt, benign warnings (iCCP profiles and the like) are not worth a message
+    }
+
+    // The setjmp blocks live in their own functions with nothing but trivial locals, so a
+    // longjmp out of libpng never skips a destructor.
+
+    // Read the header and set up the transforms. Returns false on a libpng error.
+    // keyedGrayDepth is the bit depth of a gray image with a tRNS key, 0 for anything else.
+    bool readHeader(png_structp png, png_infop info, bool* indexed, int* keyedGrayDepth) {
+        if (setjmp(png_jmpbuf(png))) {
+            return false;
+        }
+
+        png_read_info(png, info);
+
+        const int colorType = png_get_color_type(png, info);
+        const int bitDepth = png_get_bit_depth(png, info);
+        const bool keyedGray = colorType == PNG_COLOR_TYPE_GRAY && bitDepth <= 8 && png_get_valid(png, info, PNG_INFO_tRNS);
+
+        if (colorType == PNG_COLOR_TYPE_PALETTE || keyedGray) {
+            // 1, 2 and 4-bit indices become one byte each, the palette stays a palette.
+            // Keyed gray is read as indices into a gray ramp, like Qt reads it.
+            *indexed = true;
+            *keyedGrayDepth = keyedGray ? bitDepth : 0;
+            if (bitDepth < 8) {
+                png_set_packing(png);
+            }
+        } else {
+            *indexed = false;
+            if (bitDepth == 16) {
+                png_set_scale_16(png);
+            }
+            if (colorType == PNG_COLOR_TYPE_GRAY || colorType == PNG_COLOR_TYPE_GRAY_ALPHA) {
+                if (bitDepth < 8) {
+                    png_set_expand_gray_1_2_4_to_8(png);
+                }
+                png_set_gray_to_rgb(png);
+            }
+            if (png_get_valid(png, info, PNG_INFO_tRNS)) {
+                png_set_tRNS_to_alpha(png);
+            } else if (!(colorType & PNG_COLOR_MASK_ALPHA)) {
+                png_set_filler(png, 0xFF, PNG_FILLER_AFTER);
+            }
+        }
+
+        png_set_interlace_handling(png);
+        png_read_update_info(png, info);
+        return true;
+    }
+
+    bool readRows(png_structp png, png_bytepp rows) {
+        if (setjmp(png_jmpbuf(png))) {
+            return false;
+        }
+
+        png_read_image(png, rows);
+        png_read_end(png, nullptr);
+        return true;
+    }
+}
+
+PngHandler::~PngHandler() {
+    for (const auto& block : m_freeBlocks) {
+        free(static_cast<char*>(block.second) - PNG_BLOCK_HEADER);
+    }
+}
+
+// Hand out a kept block of exactly the same size if there is one. A frame of the same size
+// and type as the last asks for the same sizes, so after the first frame this rarely mallocs.
+void* PngHandler::allocate(png_structp png, size_t size) {
+    PngHandler* self = static_cast<PngHandler*>(png_get_mem_ptr(png));
+    for (size_t i = 0; i < self->m_freeBlocks.size(); ++i) {
+        if (self->m_freeBlocks[i].first == size) {
+            void* ptr = self->m_freeBlocks[i].second;
+            self->m_freeBlocks[i] = self->m_freeBlocks.back();
+            self->m_freeBlocks.pop_back();
+            return ptr;
+        }
+    }
+
+    // libpng treats a null return as out of memory
+    char* block = static_cast<char*>(malloc(size + PNG_BLOCK_HEADER));
+    if (!block) {
+        return nullptr;
+    }
+    memcpy(block, &size, sizeof(size));
+    return block + PNG_BLOCK_HEADER;
+}
+
+void PngHandler::release(png_structp png, void* ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    char* block = static_cast<char*>(ptr) - PNG_BLOCK_HEADER;
+    PngHandler* self = static_cast<PngHandler*>(png_get_mem_ptr(png));
+    if (self->m_freeBlocks.size() < PNG_MAX_KEPT_BLOCKS) {
+        size_t size;
+        memcpy(&size, block, sizeof(size));
+        self->m_freeBlocks.emplace_back(size, ptr);
+    } else {
+        free(block);
+    }
+}
+
+bool PngHandler::read(QImage* image) {
+    if (!m_device) {
+        qWarning() << "PNG handler has no device";
+        return false;
+    }
+
+    // Map files, anything else is read in one go
+    QFile* file = qobject_cast<QFile*>(m_device);
+    if (file) {
+        const qint64 size = file->size() - file->pos();
+        if (uchar* mapped = file->map(file->pos(), size)) {
+            const bool ok = read(mapped, size, image);
+            file->unmap(mapped);
+            return ok;
+        }
+    }
+
+    m_fileBuffer = m_device->readAll();
+    return read(reinterpret_cast<const uchar*>(m_fileBuffer.constData()), m_fileBuffer.size(), image);
+}
+
+bool PngHandler::readInfo(QSize* size, QString* pixelFormat) {
+    if (!m_device) {
+        return false;
+    }
+
+    // Signature, then IHDR which must be the first chunk: length, type, width, height,
+    // bit depth, color type
+    const QByteArray head = m_device->peek(26);
+    const uchar* data = reinterpret_cast<const uchar*>(head.constData());
+    if (head.size() < 26 || png_sig_cmp(data, 0, 8) != 0 || memcmp(data + 12, "IHDR", 4) != 0) {
+        return false;
+    }
+
+    const char* layout = nullptr;
+    switch (data[25]) {
+    case PNG_COLOR_TYPE_GRAY: layout = "gray"; break;
+    case PNG_COLOR_TYPE_RGB: layout = "rgb"; break;
+    case PNG_COLOR_TYPE_PALETTE: layout = "indexed"; break;
+    case PNG_COLOR_TYPE_GRAY_ALPHA: layout = "graya"; break;
+    case PNG_COLOR_TYPE_RGB_ALPHA: layout = "rgba"; break;
+    default: return false;
+    }
+
+    *size = QSize(int(png_get_uint_32(data + 16)), int(png_get_uint_32(data + 20)));
+    *pixelFormat = QString("%1%2").arg(layout).arg(int(data[24]));
+    return true;
+}
+
+bool PngHandler::read(const uchar* data, qint64 size, QImage* image) {
+    if (size < 8 || png_sig_cmp(data, 0, 8) != 0) {
+        qWarning() << "Not a PNG file";
+        return false;
+    }
+
+    png_structp png = png_create_read_struct_2(PNG_LIBPNG_VER_STRING, nullptr, onError, onWarning,
+        this, allocate, release);
+    if (!png) {
+        return false;
+    }
+    png_infop info = png_create_info_struct(png);
+    if (!info) {
+        png_destroy_read_struct(&png, nullptr, nullptr);
+        return false;
+    }
+
+    MemoryReader reader = { data, size_t(size), 0 };
+    png_set_read_fn(png, &reader, readFromMemory);
+
+    bool indexed = false;
+    int keyedGrayDepth = 0;
+    if (!readHeader(png, info, &indexed, &keyedGrayDepth)) {
+        png_destroy_read_struct(&png, &info, nullptr);
+        return false;
+    }
+
+    const int width = int(png_get_image_width(png, info));
+    const int height = int(png_get_image_height(png, info));
+    const size_t rowBytes = png_get_rowbytes(png, info);
+    const size_t expectedRowBytes = size_t(width) * (indexed ? 1 : 4);
+
+    QImage img;
+    if (rowBytes == expectedRowBytes) {
+        img = QImage(width, height, indexed ? QImage::Format_Indexed8 : QImage::Format_RGBA8888);
+    }
+    if (img.isNull()) {
+        qWarning() << "Unexpected PNG layout or out of memory";
+        png_destroy_read_struct(&png, &info, nullptr);
+        return false;
+    }
+
+    if (keyedGrayDepth) {
+        // The key color is transparent black, the same color table QImage builds
+        png_color_16p key = nullptr;
+        png_get_tRNS(png, info, nullptr, nullptr, &key);
+
+        const int colors = 1 << keyedGrayDepth;
+        QVector<QRgb> colorTable(colors);
+        for (int i = 0; i < colors; ++i) {
+            const int gray = i * 255 / (colors - 1);
+            colorTable[i] = (key && i == key->gray) ? qRgba(0, 0, 0, 0) : qRgb(gray, gray, gray);
+        }
+        img.setColorTable(colorTable);
+    } else if (indexed) {
+        png_colorp palette = nullptr;
+        int paletteSize = 0;
+        png_get_PLTE(png, info, &palette, &paletteSize);
+
+        png_bytep alpha = nullptr;
+        int alphaCount = 0;
+        if (png_get_valid(png, info, PNG_INFO_tRNS)) {
+            png_get_tRNS(png, info, &alpha, &alphaCount, nullptr);
+        }
+
+        QVector<QRgb> colorTable(paletteSize);
+        for (int i = 0; i < paletteSize; ++i) {
+            const int a = i < alphaCount ? alpha[i] : 255;
+            colorTable[i] = qRgba(palette[i].red, palette[i].green, palette[i].blue, a);
+        }
+        img.setColorTable(colorTable);
+    }
+
+    // Rows go straight into the image
+    m_rows.resize(size_t(height));
+    for (int y = 0; y < height; ++y) {
+        m_rows[y] = img.scanLine(y);
+    }
+
+    const bool ok = readRows(png, m_rows.data());
+    png_destroy_read_struct(&png, &info, nullptr);
+    if (!ok) {
+        return false;
+    }
+
+    *image = img;
+    return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <QByteArray>
+#include <QImage>
+#include <QIODevice>
+#include <vector>
+
+// Straight libpng decoder for single PNG frames. Truecolor and grayscale images come out as
+// Format_RGBA8888, palette images of any bit depth as Format_Indexed8 with their palette
+// (tRNS alpha included). Gray images of up to 8 bits with a tRNS key are Format_Indexed8 as
+// well, a gray ramp with the key as transparent black, which is what QImage gives for them.
+//
+// Meant to be kept around and reused, one per thread: libpng has no way to reset a read
+// struct, so one is still created per frame, but its allocations (the structs, the zlib
+// window, the row pointers) come from blocks this handler keeps from the previous frame.
+class PngHandler {
+public:
+    PngHandler() = default;
+    ~PngHandler();
+    PngHandler(const PngHandler&) = delete;
+    PngHandler& operator=(const PngHandler&) = delete;
+
+    void setDevice(QIODevice* device) { m_device = device; }
+
+    bool read(QImage* image);
+
+    // Decode from memory
+    bool read(const uchar* data, qint64 size, QImage* image);
+
+    // Size and pixel layout from the IHDR chunk, without reading the device further.
+    // The format is the file's own ("indexed4", "gray8", "rgba16"...), not what read() returns.
+    bool readInfo(QSize* size, QString* pixelFormat);
+
+private:
+    static void* allocate(struct png_struct_def* png, size_t size);
+    static void release(struct png_struct_def* png, void* ptr);
+
+    QIODevice* m_device = nullptr;
+    QByteArray m_fileBuffer;                            // For devices that can't be mapped
+    std::vector<uchar*> m_rows;
+    std::vector<std::pair<size_t, void*>> m_freeBlocks; // libpng allocations kept for the next frame
+};
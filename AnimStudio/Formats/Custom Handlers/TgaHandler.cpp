@@ -1,5 +1,27 @@
 #include "TgaHandler.h"
 #include <QDebug>
+#include <QFile>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TGA_HANDLER_SSE2 1
+#include <emmintrin.h>
+
+// SSSE3 (pshufb) is not part of the x64 baseline, so it is checked for at run time. MSVC allows
+// its intrinsics in any function, GCC and Clang need them enabled per function.
+#define TGA_HANDLER_SSSE3 1
+#include <tmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#if defined(__GNUC__) || defined(__clang__)
+#define TGA_TARGET_SSSE3 __attribute__((target("ssse3")))
+#else
+#define TGA_TARGET_SSSE3
+#endif
+#endif
 
 #pragma pack(push, 1)
 struct TGAHeader {
@@ -18,91 +40,380 @@ struct TGAHeader {
 };
 #pragma pack(pop)
 
+#define TGA_TOP_TO_BOTTOM   0x20
+#define TGA_RIGHT_TO_LEFT   0x10
+#define TGA_ALPHA_BITS      0x0F
+#define TGA_MAX_PACKET      128
+
+namespace {
+    // --- Channel order ---
+
+    // RGBA <-> BGRA. Works in place (src == dst).
+    void swapRedBlueScalar(const uchar* src, uchar* dst, int count) {
+        for (int i = 0; i < count; ++i) {
+            const uchar r = src[i * 4 + 0];
+            dst[i * 4 + 0] = src[i * 4 + 2];
+            dst[i * 4 + 1] = src[i * 4 + 1];
+            dst[i * 4 + 2] = r;
+            dst[i * 4 + 3] = src[i * 4 + 3];
+        }
+    }
+
+#ifdef TGA_HANDLER_SSE2
+    // Four pixels per step. G and A stay put, R and B are the low bytes of each pixel's two
+    // 16-bit halves, so swapping the halves of the masked R/B word swaps the channels.
+    void swapRedBlueSse2(const uchar* src, uchar* dst, int count) {
+        const __m128i greenAlpha = _mm_set1_epi32(int(0xFF00FF00));
+        int i = 0;
+        for (; i + 4 <= count; i += 4) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+            __m128i redBlue = _mm_andnot_si128(greenAlpha, v);
+            redBlue = _mm_shufflelo_epi16(redBlue, _MM_SHUFFLE(2, 3, 0, 1));
+            redBlue = _mm_shufflehi_epi16(redBlue, _MM_SHUFFLE(2, 3, 0, 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_or_si128(_mm_and_si128(v, greenAlpha), redBlue));
+        }
+        swapRedBlueScalar(src + i * 4, dst + i * 4, count - i);
+    }
+#endif
+
+    void swapRedBlue(const uchar* src, uchar* dst, int count) {
+#ifdef TGA_HANDLER_SSE2
+        swapRedBlueSse2(src, dst, count);
+#else
+        swapRedBlueScalar(src, dst, count);
+#endif
+    }
+
+    // BGR to RGBA with opaque alpha
+    void bgrToRgbaScalar(const uchar* src, uchar* dst, int count) {
+        for (int i = 0; i < count; ++i) {
+            dst[i * 4 + 0] = src[i * 3 + 2];
+            dst[i * 4 + 1] = src[i * 3 + 1];
+            dst[i * 4 + 2] = src[i * 3 + 0];
+            dst[i * 4 + 3] = 255;
+        }
+    }
+
+#ifdef TGA_HANDLER_SSSE3
+    // Four pixels per step: one shuffle spreads 12 BGR bytes into RGB0 words, then alpha is
+    // set. Each load reads 16 bytes, so the loop stops while 6 pixels (18 bytes) are left.
+    TGA_TARGET_SSSE3 void bgrToRgbaSsse3(const uchar* src, uchar* dst, int count) {
+        const __m128i order = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+        const __m128i alpha = _mm_set1_epi32(int(0xFF000000));
+        int i = 0;
+        for (; i + 6 <= count; i += 4) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(v, order), alpha));
+        }
+        bgrToRgbaScalar(src + i * 3, dst + i * 4, count - i);
+    }
+
+    bool cpuHasSsse3() {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 9)) != 0;
+#else
+        return __builtin_cpu_supports("ssse3");
+#endif
+    }
+#endif
+
+    void bgrToRgba(const uchar* src, uchar* dst, int count) {
+#ifdef TGA_HANDLER_SSSE3
+        static const bool ssse3 = cpuHasSsse3();
+        if (ssse3) {
+            bgrToRgbaSsse3(src, dst, count);
+            return;
+        }
+#endif
+        bgrToRgbaScalar(src, dst, count);
+    }
+
+    // 16-bit ARGB1555 to RGBA. The top bit is only alpha when the header says so.
+    QRgb argb1555ToRgb(quint16 v, bool hasAlpha) {
+        const int r = (v >> 10) & 0x1F;
+        const int g = (v >> 5) & 0x1F;
+        const int b = v & 0x1F;
+        const int a = (!hasAlpha || (v & 0x8000)) ? 255 : 0;
+        return qRgba((r << 3) | (r >> 2), (g << 3) | (g >> 2), (b << 3) | (b >> 2), a);
+    }
+
+    void argb1555ToRgba(const uchar* src, uchar* dst, int count, bool hasAlpha) {
+        for (int i = 0; i < count; ++i) {
+            const QRgb c = argb1555ToRgb(quint16(src[i * 2] | (src[i * 2 + 1] << 8)), hasAlpha);
+            dst[i * 4 + 0] = uchar(qRed(c));
+            dst[i * 4 + 1] = uchar(qGreen(c));
+            dst[i * 4 + 2] = uchar(qBlue(c));
+            dst[i * 4 + 3] = uchar(qAlpha(c));
+        }
+    }
+
+    // --- Run-length packets ---
+
+    // Expand pixelCount pixels of RLE packets into out. False if the data runs out first.
+    bool unpackRle(const uchar* src, qint64 size, int pixelBytes, uchar* out, qint64 pixelCount) {
+        const uchar* end = src + size;
+        qint64 done = 0;
+        while (done < pixelCount) {
+            if (src >= end) {
+                return false;
+            }
+
+            const uchar packet = *src++;
+            const qint64 count = std::min<qint64>((packet & 0x7F) + 1, pixelCount - done);
+            if (packet & 0x80) {
+                if (end - src < pixelBytes) {
+                    return false;
+                }
+                for (qint64 i = 0; i < count; ++i) {
+                    memcpy(out, src, pixelBytes);
+                    out += pixelBytes;
+                }
+                src += pixelBytes;
+            } else {
+                const qint64 bytes = count * pixelBytes;
+                if (end - src < bytes) {
+                    return false;
+                }
+                memcpy(out, src, size_t(bytes));
+                out += bytes;
+                src += bytes;
+            }
+            done += count;
+        }
+        return true;
+    }
+
+    quint32 pixelAt(const uchar* row, int x) {
+        quint32 v;
+        memcpy(&v, row + x * 4, 4);
+        return v;
+    }
+
+    // Append one row of 32-bit pixels as RLE packets. Packets never cross rows.
+    void appendRleRow(const uchar* row, int width, QByteArray& out) {
+        int x = 0;
+        while (x < width) {
+            const quint32 value = pixelAt(row, x);
+            int run = 1;
+            while (x + run < width && run < TGA_MAX_PACKET && pixelAt(row, x + run) == value) {
+                ++run;
+            }
+
+            if (run > 1) {
+                out.append(char(0x80 | (run - 1)));
+                out.append(reinterpret_cast<const char*>(row + x * 4), 4);
+                x += run;
+                continue;
+            }
+
+            // Literal pixels up to where the next run of two or more starts
+            int raw = 1;
+            while (x + raw < width && raw < TGA_MAX_PACKET
+                && !(x + raw + 1 < width && pixelAt(row, x + raw) == pixelAt(row, x + raw + 1))) {
+                ++raw;
+            }
+            out.append(char(raw - 1));
+            out.append(reinterpret_cast<const char*>(row + x * 4), raw * 4);
+            x += raw;
+        }
+    }
+}
+
 bool TgaHandler::read(QImage* outImage) {
     if (!m_device) {
         qWarning() << "TGA handler has no device";
         return false;
     }
 
+    // Map files, anything else is read in one go
+    QFile* file = qobject_cast<QFile*>(m_device);
+    uchar* mapped = nullptr;
+    qint64 size = 0;
+    if (file) {
+        size = file->size() - file->pos();
+        mapped = file->map(file->pos(), size);
+    }
+
+    if (mapped) {
+        const bool ok = decode(mapped, size, outImage);
+        file->unmap(mapped);
+        return ok;
+    }
+
+    const QByteArray bytes = m_device->readAll();
+    return decode(reinterpret_cast<const uchar*>(bytes.constData()), bytes.size(), outImage);
+}
+
+bool TgaHandler::readInfo(QSize* size, QString* pixelFormat) {
+    if (!m_device) {
+        return false;
+    }
+
+    TGAHeader header;
+    const QByteArray head = m_device->peek(sizeof(header));
+    if (head.size() < int(sizeof(header))) {
+        return false;
+    }
+    memcpy(&header, head.constData(), sizeof(header));
+
+    const int baseType = header.imageType >= 9 ? header.imageType - 8 : header.imageType;
+    const bool hasAlpha = (header.imageDescriptor & TGA_ALPHA_BITS) != 0;
+    if (baseType == 1 && header.pixelDepth == 8) {
+        *pixelFormat = "indexed8";
+    } else if (baseType == 2 && header.pixelDepth == 32) {
+        *pixelFormat = hasAlpha ? "rgba8" : "rgb8";
+    } else if (baseType == 2 && header.pixelDepth == 24) {
+        *pixelFormat = "rgb8";
+    } else if (baseType == 2 && (header.pixelDepth == 15 || header.pixelDepth == 16)) {
+        *pixelFormat = hasAlpha ? "argb1555" : "rgb555";
+    } else if (baseType == 3 && header.pixelDepth == 8) {
+        *pixelFormat = "gray8";
+    } else {
+        return false; // Same set read() accepts
+    }
+
+    *size = QSize(header.width, header.height);
+    return true;
+}
+
+bool TgaHandler::decode(const uchar* data, qint64 size, QImage* outImage) {
     TGAHeader header;
-    if (m_device->read(reinterpret_cast<char*>(&header), sizeof(header)) != sizeof(header)) {
+    if (size < qint64(sizeof(header))) {
         qWarning() << "Failed to read TGA header";
         return false;
     }
+    memcpy(&header, data, sizeof(header));
+
+    // Types 9-11 are the run-length encoded versions of 1-3
+    const bool rle = header.imageType >= 9;
+    const int baseType = rle ? header.imageType - 8 : header.imageType;
+    const int bpp = header.pixelDepth;
+
+    bool supported = false;
+    switch (baseType) {
+    case 1: // Color-mapped
+        supported = header.colorMapType == 1 && bpp == 8;
+        break;
+    case 2: // Truecolor
+        supported = bpp == 15 || bpp == 16 || bpp == 24 || bpp == 32;
+        break;
+    case 3: // Grayscale
+        supported = bpp == 8;
+        break;
+    default:
+        break;
+    }
+    if (!supported) {
+        qWarning() << "Unsupported TGA image type" << header.imageType << "at" << bpp << "bits per pixel";
+        return false;
+    }
 
-    if (header.imageType != 1 && header.imageType != 2 && header.imageType != 10) {
-        qWarning() << "Unsupported TGA image type" << header.imageType;
+    const int width = header.width;
+    const int height = header.height;
+    if (width == 0 || height == 0) {
+        qWarning() << "TGA image has no pixels";
         return false;
     }
 
-    // Skip ID field if present
-    if (header.idLength > 0)
-        m_device->seek(m_device->pos() + header.idLength);
+    const bool hasAlpha = (header.imageDescriptor & TGA_ALPHA_BITS) != 0;
+
+    // Skip the ID field, then read or skip the color map
+    qint64 offset = qint64(sizeof(header)) + header.idLength;
 
     QVector<QRgb> colorTable;
-    if (header.imageType == 1 && header.colorMapType == 1) {
-        const int colorMapSize = header.colorMapLength * (header.colorMapEntrySize / 8);
-        QByteArray colorMapData = m_device->read(colorMapSize);
-        if (colorMapData.size() != colorMapSize) {
+    if (header.colorMapType == 1) {
+        const int entryBytes = (header.colorMapEntrySize + 7) / 8;
+        const qint64 colorMapSize = qint64(header.colorMapLength) * entryBytes;
+        if (size - offset < colorMapSize) {
             qWarning() << "Failed to read TGA color map";
             return false;
         }
 
-        const uchar* data = reinterpret_cast<const uchar*>(colorMapData.constData());
-        for (int i = 0; i < header.colorMapLength; ++i) {
-            int index = i * (header.colorMapEntrySize / 8);
-            uchar b = data[index];
-            uchar g = data[index + 1];
-            uchar r = data[index + 2];
-            colorTable.append(qRgb(r, g, b));
+        if (baseType == 1) {
+            // Pixel values index from colorMapFirstEntry, an 8-bit index can only reach 256 entries
+            const int first = header.colorMapFirstEntry;
+            const int count = std::min<int>(header.colorMapLength, std::max(0, 256 - first));
+            colorTable.fill(qRgb(0, 0, 0), first + count);
+
+            const uchar* entries = data + offset;
+            for (int i = 0; i < count; ++i) {
+                const uchar* e = entries + i * entryBytes;
+                QRgb c;
+                switch (header.colorMapEntrySize) {
+                case 15:
+                case 16:
+                    c = argb1555ToRgb(quint16(e[0] | (e[1] << 8)), hasAlpha && header.colorMapEntrySize == 16);
+                    break;
+                case 32:
+                    c = hasAlpha ? qRgba(e[2], e[1], e[0], e[3]) : qRgb(e[2], e[1], e[0]);
+                    break;
+                default:
+                    c = qRgb(e[2], e[1], e[0]);
+                    break;
+                }
+                colorTable[first + i] = c;
+            }
         }
+        offset += colorMapSize;
     }
 
-    int width = header.width;
-    int height = header.height;
-    int bpp = header.pixelDepth;
+    const int pixelBytes = (bpp + 7) / 8;
+    const qint64 pixelCount = qint64(width) * height;
+    const qint64 imageBytes = pixelCount * pixelBytes;
 
-    bool flipVertical = (header.imageDescriptor & 0x20) == 0;
-
-    int yStart = flipVertical ? height - 1 : 0;
-    int yEnd = flipVertical ? -1 : height;
-    int yStep = flipVertical ? -1 : 1;
+    const uchar* pixels = data + offset;
+    std::vector<uchar> unpacked;
+    if (rle) {
+        unpacked.resize(size_t(imageBytes));
+        if (!unpackRle(pixels, size - offset, pixelBytes, unpacked.data(), pixelCount)) {
+            qWarning() << "TGA run-length data ends early";
+            return false;
+        }
+        pixels = unpacked.data();
+    } else if (size - offset < imageBytes) {
+        qWarning() << "Failed to read TGA pixels";
+        return false;
+    }
 
-    QImage img;
+    // Truecolor comes out as RGBA8888, which is what the frames are stored as anyway
+    QImage::Format format = QImage::Format_RGBA8888;
+    if (baseType == 1) {
+        format = QImage::Format_Indexed8;
+    } else if (baseType == 3) {
+        format = QImage::Format_Grayscale8;
+    }
 
-    if (header.imageType == 1) {
-        // Indexed color
-        img = QImage(width, height, QImage::Format_Indexed8);
+    QImage img(width, height, format);
+    if (img.isNull()) {
+        qWarning() << "Failed to allocate TGA image";
+        return false;
+    }
+    if (baseType == 1) {
         img.setColorTable(colorTable);
-        for (int y = yStart; y != yEnd; y += yStep) {
-            uchar* scanline = img.scanLine(y);
-            if (m_device->read(reinterpret_cast<char*>(scanline), width) != width) {
-                qWarning() << "Failed to read TGA scanline";
-                return false;
-            }
-        }
-    } else if (header.imageType == 2) {
-        // Uncompressed truecolor
-        QImage::Format format = (bpp == 32) ? QImage::Format_RGBA8888 : QImage::Format_RGB888;
-        img = QImage(width, height, format);
-
-        for (int y = yStart; y != yEnd; y += yStep) {
-            uchar* scanline = img.scanLine(y);
-            int lineBytes = width * (bpp / 8);
-            if (m_device->read(reinterpret_cast<char*>(scanline), lineBytes) != lineBytes) {
-                qWarning() << "Failed to read TGA scanline";
-                return false;
-            }
+    }
 
-            // Swap BGR(A) to RGB(A)
-            for (int x = 0; x < width; ++x) {
-                uchar* px = scanline + x * (bpp / 8);
-                std::swap(px[0], px[2]);
-            }
+    const bool bottomUp = (header.imageDescriptor & TGA_TOP_TO_BOTTOM) == 0;
+    const qint64 rowBytes = qint64(width) * pixelBytes;
+
+    for (int row = 0; row < height; ++row) {
+        const uchar* src = pixels + row * rowBytes;
+        uchar* dst = img.scanLine(bottomUp ? height - 1 - row : row);
+
+        if (pixelBytes == 1) {
+            memcpy(dst, src, size_t(width));
+        } else if (bpp == 32) {
+            swapRedBlue(src, dst, width);
+        } else if (bpp == 24) {
+            bgrToRgba(src, dst, width);
+        } else {
+            argb1555ToRgba(src, dst, width, hasAlpha && bpp == 16);
         }
-    } else {
-        qWarning() << "Unsupported or compressed TGA type";
-        return false;
+    }
+
+    if (header.imageDescriptor & TGA_RIGHT_TO_LEFT) {
+        img = img.mirrored(true, false);
     }
 
     *outImage = img;
@@ -113,36 +424,43 @@ bool TgaHandler::write(const QImage& image) {
     if (!m_device)
         return false;
 
-    QImage img = image.convertToFormat(QImage::Format_RGBA8888);
-    int width = img.width();
-    int height = img.height();
+    const QImage img = image.convertToFormat(QImage::Format_RGBA8888);
+    const int width = img.width();
+    const int height = img.height();
 
     TGAHeader header = {};
-    header.imageType = 2; // uncompressed truecolor
+    header.imageType = m_rle ? 10 : 2; // RLE or uncompressed truecolor
     header.width = width;
     header.height = height;
     header.pixelDepth = 32;
-    header.imageDescriptor = 0x20; // top-left origin
+    header.imageDescriptor = TGA_TOP_TO_BOTTOM | 8; // 8 alpha bits per pixel
 
-    if (m_device->write(reinterpret_cast<const char*>(&header), sizeof(header)) != sizeof(header)) {
-        qWarning() << "TGA: Failed to write header";
-        return false;
-    }
+    const qsizetype rowBytes = qsizetype(width) * 4;
+    QByteArray out;
 
-    for (int y = 0; y < height; ++y) {
-        const uchar* src = img.constScanLine(y);
-        for (int x = 0; x < width; ++x) {
-            uchar r = src[x * 4 + 0];
-            uchar g = src[x * 4 + 1];
-            uchar b = src[x * 4 + 2];
-            uchar a = src[x * 4 + 3];
+    if (!m_rle) {
+        out.resize(qsizetype(sizeof(header)) + rowBytes * height);
+        memcpy(out.data(), &header, sizeof(header));
+        uchar* dst = reinterpret_cast<uchar*>(out.data()) + sizeof(header);
+        for (int y = 0; y < height; ++y) {
+            swapRedBlue(img.constScanLine(y), dst + y * rowBytes, width);
+        }
+    } else {
+        // Worst case is one packet byte per 128 pixels on top of the raw pixels
+        out.reserve(qsizetype(sizeof(header)) + (rowBytes + (width + TGA_MAX_PACKET - 1) / TGA_MAX_PACKET) * height);
+        out.append(reinterpret_cast<const char*>(&header), sizeof(header));
 
-            m_device->putChar(b);
-            m_device->putChar(g);
-            m_device->putChar(r);
-            m_device->putChar(a);
+        std::vector<uchar> row(size_t(rowBytes));
+        for (int y = 0; y < height; ++y) {
+            swapRedBlue(img.constScanLine(y), row.data(), width);
+            appendRleRow(row.data(), width, out);
         }
     }
 
+    if (m_device->write(out) != out.size()) {
+        qWarning() << "TGA: Failed to write image";
+        return false;
+    }
+
     return true;
 }
@@ -7,9 +7,22 @@ class TgaHandler {
 public:
     void setDevice(QIODevice* device) { m_device = device; }
 
+    // Write run-length encoded truecolor (type 10) instead of uncompressed (type 2)
+    void setRle(bool rle) { m_rle = rle; }
+
+    // Reads color-mapped, truecolor and grayscale images, plain or RLE (types 1, 2, 3, 9, 10, 11).
+    // Files are memory mapped, other devices are read in one go.
     bool read(QImage* image);
+
+    // Size and pixel layout from the 18 byte header, without reading the device further
+    bool readInfo(QSize* size, QString* pixelFormat);
+
+    // Builds the whole file in memory and hands it to the device in a single write
     bool write(const QImage& image);
 
 private:
+    bool decode(const uchar* data, qint64 size, QImage* image);
+
     QIODevice* m_device = nullptr;
+    bool m_rle = false;
 };
@@ -1,32 +1,43 @@
 #include "AniExporter.h"
-#include <QFile>
-#include <QDataStream>
+#include "Animation/StagePool.h"
+#include <QSaveFile>
 #include <QImage>
 #include <QColor>
 #include <QVector>
 #include <QDebug>   // For qWarning, qInfo
 #include <QDir>     // For constructing file paths
+#include <QThread>
+#include <QtConcurrent>
+#include <QtEndian>
+#include <algorithm>
+
+#include "Formats/RleKernels.h"
 
 // Define constants from FreeSpace code
 #define PACKER_CODE                 0xEE    // The escape byte for Hoffoss RLE (used in header and RLE)
 #define PACKING_METHOD_RLE          0       // The byte at the start of the frame noting a non-keyframe
 #define PACKING_METHOD_RLE_KEY      1       // The byte at the start of the frame noting a keyframe
 #define FRAME_HOLDOVER_COLOR_INDEX  254     // As per ani documentation, 254 is holdover from last frame
+#define RLE_WORST_CASE_BYTES(width) (2 * (width)) // Every pixel a literal packer code
 
 void AniExporter::setProgressCallback(std::function<void(float)> cb) {
     m_progressCallback = std::move(cb);
 }
 
-// Helper function to write a short (2 bytes) to the QDataStream in little-endian format.
+// Helper function to append a short (2 bytes) in little-endian format.
 // FreeSpace ANI files use little-endian byte order.
-void writeShort(QDataStream& stream, short value) {
-    stream.writeRawData(reinterpret_cast<const char*>(&value), sizeof(short));
+static void appendShort(QByteArray& out, short value) {
+    char bytes[sizeof(short)];
+    qToLittleEndian<qint16>(value, bytes);
+    out.append(bytes, sizeof(bytes));
 }
 
-// Helper function to write an int (4 bytes) to the DataStream in little-endian format.
+// Helper function to append an int (4 bytes) in little-endian format.
 // FreeSpace ANI files use little-endian byte order.
-void writeInt(QDataStream& stream, int value) {
-    stream.writeRawData(reinterpret_cast<const char*>(&value), sizeof(int));
+static void appendInt(QByteArray& out, int value) {
+    char bytes[sizeof(int)];
+    qToLittleEndian<qint32>(value, bytes);
+    out.append(bytes, sizeof(bytes));
 }
 
 /**
@@ -84,30 +95,26 @@ void writeInt(QDataStream& stream, int value) {
  *
  * @param scanline Pointer to the current scanline's 8-bit indexed pixel data.
  * @param width The width of the image (number of pixels in the scanline).
- * @return A QByteArray containing the compressed data for the scanline.
+ * @param out Where the compressed data goes. Must have room for RLE_WORST_CASE_BYTES(width) bytes.
+ * @return The number of bytes written to `out`.
  */
-QByteArray compressScanlineHoffossRLE(const uchar* scanline, int width) {
-    QByteArray compressedData;
+qsizetype compressScanlineHoffossRLE(const uchar* scanline, int width, uchar* out) {
+    uchar* compressedData = out;
     int x = 0;
     int pixelCount = 0; // Counts reconstructed pixels for sanity check
 
     while (x < width) {
         uchar currentPixel = scanline[x];
-        int runLength = 1;
-        while (x + runLength < width
-            && scanline[x + runLength] == currentPixel
-            && runLength < 255) { // Max run length for a single byte
-            runLength++;
-        }
+        int runLength = RleKernels::runLength(scanline + x, width - x, 255); // Max run length for a single byte
 
         if (runLength > 2) {
             // 3-byte RLE for runs of 3 or more identical pixels
             // Format: PACKER_CODE, (runLength - 1), pixel_value
             // When read, the PACKER_CODE notes a rune then the length of the run is expected as
             // "repeat this many times not including current pixel" and then the pixel
-            compressedData.append(static_cast<char>(PACKER_CODE));
-            compressedData.append(static_cast<char>(runLength - 1)); // Store N-1, as unpacker increments runcount
-            compressedData.append(static_cast<char>(currentPixel));
+            *compressedData++ = PACKER_CODE;
+            *compressedData++ = static_cast<uchar>(runLength - 1); // Store N-1, as unpacker increments runcount
+            *compressedData++ = currentPixel;
             pixelCount += runLength;
         } else {
             // For runs of 1 or 2 pixels, or single literal 0xEE pixels
@@ -116,12 +123,12 @@ QByteArray compressScanlineHoffossRLE(const uchar* scanline, int width) {
                     // Single 0xEE literal (for a pixel that IS our packer code)
                     // Format: PACKER_CODE, 0
                     // The unpacker for `count < 2` infers the pixel is PACKER_CODE (0xEE) itself.
-                    compressedData.append(static_cast<char>(PACKER_CODE));
-                    compressedData.append(static_cast<char>(0)); // Special count 0 for literal 0xEE
+                    *compressedData++ = PACKER_CODE;
+                    *compressedData++ = 0; // Special count 0 for literal 0xEE
                 } else {
                     // 1-byte literal for all other colors (non-PACKER_CODE pixels)
                     // Format: pixel_value
-                    compressedData.append(static_cast<char>(currentPixel));
+                    *compressedData++ = currentPixel;
                 }
             }
             pixelCount += runLength; // Add the number of pixels processed in this literal loop
@@ -136,7 +143,63 @@ QByteArray compressScanlineHoffossRLE(const uchar* scanline, int width) {
     }
     Q_ASSERT(pixelCount == width); // Assert for debugging in development builds
 
-    return compressedData;
+    return compressedData - out;
+}
+
+/**
+ * @brief Compresses one frame: the packing method byte followed by every scanline.
+ *
+ * A delta frame only depends on the original pixels of the frame before it, not on how that
+ * frame was encoded, so frames can be compressed independently and in any order.
+ *
+ * @param currentImage The frame to compress.
+ * @param lastFrame The original pixels of the previous frame, or null for the first frame.
+ * @param isKeyFrame Whether the frame is stored whole rather than as a delta.
+ * @param scanlineBuffer One scanline of working space for keyframe sanitizing / delta substitution.
+ * @param out Where the compressed frame goes. Must have room for 1 + height * RLE_WORST_CASE_BYTES(width) bytes.
+ * @return The number of bytes written to `out`.
+ */
+static qsizetype compressFrameHoffossRLE(const QImage& currentImage, const QImage* lastFrame, bool isKeyFrame, uchar* scanlineBuffer, uchar* out) {
+    const int frameWidth = currentImage.width();
+    const int frameHeight = currentImage.height();
+    uchar* frameCompressedData = out;
+
+    // The first byte of each frame's compressed data indicates the packing method.
+    // For keyframes, use PACKING_METHOD_RLE_KEY (1).
+    // For non-keyframes, use PACKING_METHOD_RLE (0).
+    *frameCompressedData++ = isKeyFrame ? PACKING_METHOD_RLE_KEY : PACKING_METHOD_RLE;
+
+    // Iterate through each scanline (row) of the image for compression.
+    // Rows are rewritten into a one-row scratch buffer so the shared frame is never copied.
+    for (int y = 0; y < frameHeight; ++y) {
+        const uchar* sourceScanline = currentImage.constScanLine(y);
+        uchar* currentScanline = scanlineBuffer;
+
+        if (isKeyFrame) {
+            // For keyframes, we sanitize transparent pixels by replacing FRAME_HOLDOVER_COLOR_INDEX (254) with 0,
+            // the first color in the palette (usually black).
+            // This ensures a "clean" base frame for the decoder, as per ANIVIEW32's behavior.
+            RleKernels::replaceValue(sourceScanline, currentScanline, frameWidth, FRAME_HOLDOVER_COLOR_INDEX, 0);
+            frameCompressedData += compressScanlineHoffossRLE(currentScanline, frameWidth, frameCompressedData);
+        } else {
+            // For non-keyframes, apply delta compression:
+            // If a pixel is identical to the corresponding pixel in the last frame,
+            // replace it with FRAME_HOLDOVER_COLOR_INDEX (254).
+            // This will create runs of 254s, which RLE will compress efficiently.
+            if (lastFrame && !lastFrame->isNull() && lastFrame->size() == currentImage.size()) {
+                const uchar* lastScanline = lastFrame->constScanLine(y);
+                RleKernels::substituteUnchanged(sourceScanline, lastScanline, currentScanline, frameWidth, FRAME_HOLDOVER_COLOR_INDEX);
+                frameCompressedData += compressScanlineHoffossRLE(currentScanline, frameWidth, frameCompressedData);
+            } else {
+                // Fallback: If lastFrame is not valid (e.g., first frame is not a keyframe, though it should be),
+                // compress the frame without delta optimization.
+                qWarning() << "AniExporter: lastFrame not available for non-keyframe, scanline " << y << ". Compressing as full frame.";
+                frameCompressedData += compressScanlineHoffossRLE(sourceScanline, frameWidth, frameCompressedData);
+            }
+        }
+    }
+
+    return frameCompressedData - out;
 }
 
 /**
@@ -146,12 +209,17 @@ QByteArray compressScanlineHoffossRLE(const uchar* scanline, int width) {
  * and compresses them into the ANI format, including header information,
  * palette, keyframes, and RLE compressed pixel data.
  *
- * @param data The AnimationData struct containing frames, FPS, dimensions, and keyframe info.
+ * @param source The AnimationData struct containing frames, FPS, dimensions, and keyframe info.
+ * Frames with their own durations are expanded to a fixed tick rate first.
  * Assumes `data.frames[i].image` are `QImage::Format_Indexed8` and `data.quantizedPalette` is valid.
  * @param aniPath The full path (including filename and .ani extension) where the file should be saved.
  * @return True if the export was successful, false otherwise.
  */
-ExportResult AniExporter::exportAnimation(const AnimationData& data, const QString& aniPath, QString name) {
+ExportResult AniExporter::exportAnimation(const AnimationData& source, const QString& aniPath, QString name) {
+    // ANI only stores a single fps, so per-frame durations get expanded into fixed ticks
+    const bool expand = hasVariableTiming(source);
+    const AnimationData expanded = expand ? expandToFixedRate(source) : AnimationData{};
+    const AnimationData& data = expand ? expanded : source;
 
     if (m_progressCallback)
         m_progressCallback(0.0f);
@@ -159,30 +227,26 @@ ExportResult AniExporter::exportAnimation(const AnimationData& data, const QStri
     // Construct the full file path: aniPath (directory) + data.baseName + ".ani"
     QString fullAniFilePath = QDir(aniPath).filePath(name + ".ani");
 
-    QFile file(fullAniFilePath);
+    // Everything goes to a temporary file that only replaces the .ani on commit(), so nobody
+    // ever sees a half-written file. Returning early discards it.
+    QSaveFile file(fullAniFilePath);
     if (!file.open(QIODevice::WriteOnly)) {
         return ExportResult::fail(QString("Could not open file for writing: %1").arg(fullAniFilePath));
     }
 
-    QDataStream stream(&file);
-    stream.setByteOrder(QDataStream::LittleEndian); // FreeSpace uses little-endian byte order
-
     // --- Validate Input Data ---
     if (data.quantizedFrames.isEmpty()) {
-        file.close();
         return ExportResult::fail(QString("No quantized frames found. You must reduce colors before exporting as ANI."));
     }
 
     // All frames must have the same size and be 8-bit indexed
     const QImage& firstImage = data.quantizedFrames.first().image;
     if (firstImage.format() != QImage::Format_Indexed8) {
-        file.close();
         return ExportResult::fail(QString("Input must be Format_Indexed8. Please ensure images are correctly quantized."));
     }
 
     // Validate the quantizedPalette from AnimationData
     if (data.quantizedPalette.size() != 256) {
-        file.close();
         return ExportResult::fail(QString("Quantized palette size is not 256. It must be exactly 256 colors for ANI export."));
     }
 
@@ -191,19 +255,10 @@ ExportResult AniExporter::exportAnimation(const AnimationData& data, const QStri
 
     QVector<QRgb> palette = data.quantizedPalette;
 
-    // Placeholder for keyframe data: stores pairs of (frame_num, offset_in_compressed_data)
-    QVector<QPair<short, int>> keyframes;
-
     // Calculate dimensions from the provided AnimationData
     int frameWidth = data.originalSize.width();
     int frameHeight = data.originalSize.height();
 
-    // Prepare a QByteArray to store all compressed image data
-    QByteArray compressedImageData;
-    // `lastFramePixels` stores the raw pixel data of the previously encoded (and logically 'decoded') frame.
-    // This is crucial for delta compression of subsequent frames.
-    QByteArray lastFramePixels;
-
     // If we have transparency then make it bright green
     if (qAlpha(palette[255]) == 0) {
         palette[255] = transparentRgb.rgb();
@@ -217,14 +272,14 @@ ExportResult AniExporter::exportAnimation(const AnimationData& data, const QStri
         keyframeIndices.append(0); // Always include the first frame as a keyframe
     }
 
-    // --- Iterate through ALL frames to compress and build keyframe info ---
-    for (int i = 0; i < data.quantizedFrames.size(); ++i) {
-        const AnimationFrame& currentAnimationFrame = data.quantizedFrames[i];
-        const QImage& currentImage = currentAnimationFrame.image;
+    const int frameTotal = data.quantizedFrames.size();
+    QVector<bool> isKeyFrame(frameTotal);
+    int keyframeCount = 0;
+    for (int i = 0; i < frameTotal; ++i) {
+        const QImage& currentImage = data.quantizedFrames[i].image;
 
         // Basic validation for current frame dimensions
         if (currentImage.width() != frameWidth || currentImage.height() != frameHeight) {
-            file.close();
             return ExportResult::fail(QString("Frame %1 has incorrect dimensions (%2x%3 instead of %4x%5).")
                 .arg(i)
                 .arg(currentImage.width())
@@ -236,147 +291,134 @@ ExportResult AniExporter::exportAnimation(const AnimationData& data, const QStri
         // Determine if the current frame should be a keyframe.
         // The very first frame (index 0) is always a keyframe.
         // Other keyframes are determined by the `keyframeIndices`.
-        bool isKeyFrame = (i == 0) || keyframeIndices.contains(i);
-
-        // If it's a keyframe, record its position (offset) in the compressed data.
-        // Frame numbers in ANI are 1-based.
-        if (isKeyFrame) {
-            keyframes.append({ static_cast<short>(i + 1), compressedImageData.size() });
-        }
-
-        // This will hold the compressed data for the current frame
-        QByteArray frameCompressedData;
-
-        // The first byte of each frame's compressed data indicates the packing method.
-        // For keyframes, use PACKING_METHOD_RLE_KEY (1).
-        // For non-keyframes, use PACKING_METHOD_RLE (0).
-        if (isKeyFrame) {
-            frameCompressedData.append(static_cast<char>(PACKING_METHOD_RLE_KEY));
-        } else {
-            frameCompressedData.append(static_cast<char>(PACKING_METHOD_RLE));
-        }
-
-        // Create a modifiable copy of the current frame's pixel data for processing
-        QByteArray currentFrameModifiablePixels(
-            reinterpret_cast<const char*>(currentImage.constBits()),
-            currentImage.sizeInBytes()
-        );
-        uchar* modifiableImagePixels = reinterpret_cast<uchar*>(currentFrameModifiablePixels.data());
-
-
-        // Iterate through each scanline (row) of the image for compression
-        int stride = currentImage.bytesPerLine();
-        for (int y = 0; y < frameHeight; ++y) {
-            uchar* currentScanline = modifiableImagePixels + (y * stride);
-
-            if (isKeyFrame) {
-                // For keyframes, we sanitize transparent pixels by replacing FRAME_HOLDOVER_COLOR_INDEX (254) with 0.
-                // This ensures a "clean" base frame for the decoder, as per ANIVIEW32's behavior.
-                for (int x = 0; x < frameWidth; ++x) {
-                    if (currentScanline[x] == FRAME_HOLDOVER_COLOR_INDEX) {
-                        currentScanline[x] = 0; // Replace with the first color in the palette (usually black)
-                    }
-                }
-                frameCompressedData.append(compressScanlineHoffossRLE(currentScanline, frameWidth));
-            } else {
-                // For non-keyframes, apply delta compression:
-                // If a pixel is identical to the corresponding pixel in the last frame,
-                // replace it with FRAME_HOLDOVER_COLOR_INDEX (254).
-                // This will create runs of 254s, which RLE will compress efficiently.
-                if (!lastFramePixels.isEmpty() && lastFramePixels.size() == currentImage.sizeInBytes()) {
-                    const uchar* lastScanline = reinterpret_cast<const uchar*>(lastFramePixels.constData()) + (y * stride);
-
-                    for (int x = 0; x < frameWidth; ++x) {
-                        if (currentScanline[x] == lastScanline[x]) {
-                            currentScanline[x] = FRAME_HOLDOVER_COLOR_INDEX;
-                        }
-                    }
-                    frameCompressedData.append(compressScanlineHoffossRLE(currentScanline, frameWidth));
-                } else {
-                    // Fallback: If lastFramePixels is not valid (e.g., first frame is not a keyframe, though it should be),
-                    // compress the frame without delta optimization.
-                    qWarning() << "AniExporter: lastFramePixels not available for non-keyframe " << i << ", scanline " << y << ". Compressing as full frame.";
-                    frameCompressedData.append(compressScanlineHoffossRLE(currentImage.constScanLine(y), frameWidth));
-                }
-            }
-        }
-
-        // Append the compressed data for the current frame to the total compressed data buffer
-        compressedImageData.append(frameCompressedData);
-
-        // Update `lastFramePixels` with the *original* (or fully reconstructed) pixel data of the current frame.
-        // This is crucial because the *next* frame's delta compression will compare against the actual image data
-        // of *this* frame, not the delta-compressed version.
-        lastFramePixels.clear();
-        lastFramePixels.append(reinterpret_cast<const char*>(currentImage.bits()), currentImage.sizeInBytes());
-
-        // Emit progress (frame-wise granularity)
-        if (m_progressCallback) {
-            float progress = float(i + 1) / float(data.quantizedFrames.size());
-            m_progressCallback(progress);
-        }
+        isKeyFrame[i] = (i == 0) || keyframeIndices.contains(i);
+        keyframeCount += isKeyFrame[i] ? 1 : 0;
     }
 
-    // --- Write ANI Header to File ---
+    // --- Write ANI Header ---
+    // The keyframe table and the compressed data length aren't known until every frame has been
+    // written, so they are reserved here and patched at the end. The header goes out in one write.
+    QByteArray header;
 
     // 1. should_be_zero (short) - always 0
-    writeShort(stream, 0);
+    appendShort(header, 0);
 
     // 2. version (short) - >= 2 for custom transparency
-    writeShort(stream, 2);
+    appendShort(header, 2);
 
     // 3. fps (short)
-    writeShort(stream, data.fps);
+    appendShort(header, data.fps);
 
     // 4. transparent RGB color (3 bytes: red, green, blue)
-    uchar tR = static_cast<uchar>(transparentRgb.red());
-    uchar tG = static_cast<uchar>(transparentRgb.green());
-    uchar tB = static_cast<uchar>(transparentRgb.blue());
-    stream.writeRawData(reinterpret_cast<const char*>(&tR), 1);
-    stream.writeRawData(reinterpret_cast<const char*>(&tG), 1);
-    stream.writeRawData(reinterpret_cast<const char*>(&tB), 1);
+    header.append(static_cast<char>(transparentRgb.red()));
+    header.append(static_cast<char>(transparentRgb.green()));
+    header.append(static_cast<char>(transparentRgb.blue()));
 
     // 5. width (short)
-    writeShort(stream, frameWidth);
+    appendShort(header, frameWidth);
 
     // 6. height (short)
-    writeShort(stream, frameHeight);
+    appendShort(header, frameHeight);
 
     // 7. nframes (short) - total number of frames
-    writeShort(stream, data.frameCount); // Use actual frame count
+    appendShort(header, data.frameCount); // Use actual frame count
 
     // 8. packer_code (char) - used for compressed (repeated) bytes
-    char packerCodeVal = static_cast<char>(PACKER_CODE);
-    stream.writeRawData(&packerCodeVal, 1);
+    header.append(static_cast<char>(PACKER_CODE));
 
     // 9. palette[256] (256 * 3 bytes) - RGB triplets
     for (const QRgb& color : palette) {
-        QColor qColor(color);
-        uchar r = static_cast<uchar>(qColor.red());
-        uchar g = static_cast<uchar>(qColor.green());
-        uchar b = static_cast<uchar>(qColor.blue());
-        stream.writeRawData(reinterpret_cast<const char*>(&r), 1);
-        stream.writeRawData(reinterpret_cast<const char*>(&g), 1);
-        stream.writeRawData(reinterpret_cast<const char*>(&b), 1);
+        header.append(static_cast<char>(qRed(color)));
+        header.append(static_cast<char>(qGreen(color)));
+        header.append(static_cast<char>(qBlue(color)));
     }
 
     // 10. num_keys (short)
-    writeShort(stream, keyframes.size());
+    appendShort(header, keyframeCount);
 
-    // 11. keyframe definitions (variable number)
+    // 11. keyframe definitions (variable number), patched later
     // Each keyframe has: short twobyte (frame_num), int startcount (offset)
-    for (const auto& keyframe : keyframes) {
-        writeShort(stream, keyframe.first);  // frame_num (1-based)
-        writeInt(stream, keyframe.second);   // offset in the compressed data block
+    const qint64 keyframeTablePos = header.size();
+    header.append(keyframeCount * 6 + 4, '\0'); // + 12. Compressed data length (int), patched later
+
+    if (file.write(header) != header.size()) {
+        return ExportResult::fail(QString("Failed writing ANI header to %1").arg(fullAniFilePath));
     }
 
-    // 12. Compressed data length (int)
-    writeInt(stream, compressedImageData.size());
+    // --- Compress and stream the frames ---
+    // A delta frame only needs the *original* pixels of the frame before it, so a batch of frames is
+    // compressed in parallel (one per worker, each into its own preallocated buffer) and then written
+    // in order. Only one batch of compressed frames is ever held in memory.
+    const int cores = m_workerCount > 0 ? m_workerCount : QThread::idealThreadCount();
+    const int workerCount = std::max(1, std::min(cores, frameTotal));
+    const qsizetype frameWorstCase = 1 + qsizetype(frameHeight) * RLE_WORST_CASE_BYTES(frameWidth);
+
+    struct FrameSlot {
+        int frame = -1;
+        QByteArray bytes;       // Sized for the worst case once, then reused
+        QByteArray scanlineBuffer;
+        qsizetype used = 0;
+    };
+    QVector<FrameSlot> slots(workerCount);
+    for (FrameSlot& slot : slots) {
+        slot.bytes.resize(frameWorstCase);
+        slot.scanlineBuffer.resize(frameWidth);
+    }
 
-    // --- Write Compressed Image Data to File ---
-    stream.writeRawData(compressedImageData.constData(), compressedImageData.size());
+    StagePool pool(m_threadPool, workerCount);
 
-    file.close();
+    // Keyframe data: pairs of (frame_num, offset_in_compressed_data). Frame numbers in ANI are 1-based.
+    QVector<QPair<short, int>> keyframes;
+    qint64 compressedSize = 0;
+
+    for (int batchStart = 0; batchStart < frameTotal; batchStart += workerCount) {
+        const int batchSize = std::min(workerCount, frameTotal - batchStart);
+        for (int s = 0; s < workerCount; ++s) {
+            slots[s].frame = s < batchSize ? batchStart + s : -1;
+        }
+
+        QtConcurrent::blockingMap(pool.get(), slots, [&](FrameSlot& slot) {
+            if (slot.frame < 0)
+                return;
+            const int i = slot.frame;
+            const QImage* lastFrame = i > 0 ? &data.quantizedFrames[i - 1].image.image() : nullptr;
+            slot.used = compressFrameHoffossRLE(data.quantizedFrames[i].image, lastFrame, isKeyFrame.at(i),
+                reinterpret_cast<uchar*>(slot.scanlineBuffer.data()), reinterpret_cast<uchar*>(slot.bytes.data()));
+        });
+
+        for (int s = 0; s < batchSize; ++s) {
+            const FrameSlot& slot = slots[s];
+            if (isKeyFrame[slot.frame]) {
+                keyframes.append({ static_cast<short>(slot.frame + 1), static_cast<int>(compressedSize) });
+            }
+            if (file.write(slot.bytes.constData(), slot.used) != slot.used) {
+                return ExportResult::fail(QString("Failed writing frame %1 to %2").arg(slot.frame).arg(fullAniFilePath));
+            }
+            compressedSize += slot.used;
+
+            // Emit progress (frame-wise granularity)
+            if (m_progressCallback) {
+                float progress = float(slot.frame + 1) / float(frameTotal);
+                m_progressCallback(progress);
+            }
+        }
+    }
+
+    // --- Patch the keyframe table and compressed data length ---
+    QByteArray keyframeTable;
+    for (const auto& keyframe : keyframes) {
+        appendShort(keyframeTable, keyframe.first);  // frame_num (1-based)
+        appendInt(keyframeTable, keyframe.second);   // offset in the compressed data block
+    }
+    appendInt(keyframeTable, static_cast<int>(compressedSize));
+
+    if (!file.seek(keyframeTablePos) || file.write(keyframeTable) != keyframeTable.size()) {
+        return ExportResult::fail(QString("Failed writing ANI keyframe table to %1").arg(fullAniFilePath));
+    }
+
+    if (!file.commit()) {
+        return ExportResult::fail(QString("Could not save %1: %2").arg(fullAniFilePath, file.errorString()));
+    }
 
     if (m_progressCallback)
         m_progressCallback(1.0f);
@@ -13,6 +13,18 @@ public:
     // Call with values from 0.0 to 1.0 (progress %)
     void setProgressCallback(std::function<void(float)> cb);
 
+    // Frames compressed at once. 0 (the default) uses one worker per core
+    void setWorkerCount(int workers) { m_workerCount = workers; }
+
+    // Compress on this pool instead of a private one, see StagePool
+    void setThreadPool(QThreadPool* pool) { m_threadPool = pool; }
+
 private:
     std::function<void(float)> m_progressCallback;
-};
\ No newline at end of file
+    int m_workerCount = 0;
+    QThreadPool* m_threadPool = nullptr;
+};
+
+// Hoffoss RLE of one scanline of palette indices, as stored in ANI frames. out needs room for
+// 2 * width bytes (every pixel a literal packer code); returns the number of bytes written.
+qsizetype compressScanlineHoffossRLE(const uchar* scanline, int width, uchar* out);
\ No newline at end of file
@@ -7,11 +7,54 @@
 #include "apngframe.h"   // declares apngasm::rgba
 
 #include <numeric>       // for std::gcd
+#include <optional>
+
+// Palette to write the quantized frames with, if they can be written as they are: they all
+// share one color table and use no index past it. The quantizer moves transparent pixels to
+// index 255 without growing the frames' table, so if 255 is used the palette is padded to 256
+// with transparent entries. Nullopt means the frames have to be written as RGBA.
+static std::optional<QVector<QRgb>> indexedPalette(const AnimationData& data) {
+    if (!data.quantized || data.quantizedFrames.size() != data.frames.size())
+        return std::nullopt;
+
+    QVector<QRgb> palette = data.quantizedFrames.first().image.colorTable();
+    if (palette.isEmpty() || palette.size() > 256)
+        return std::nullopt;
+
+    const QSize size = data.frames.first().image.size();
+    bool usesTransparent = false;
+    for (const auto& frame : data.quantizedFrames) {
+        const FrameBuffer& img = frame.image;
+        if (img.format() != QImage::Format_Indexed8 || img.size() != size || img.colorTable() != palette)
+            return std::nullopt;
+
+        for (int y = 0; y < img.height(); ++y) {
+            const uchar* row = img.constScanLine(y);
+            for (int x = 0; x < img.width(); ++x) {
+                if (row[x] < palette.size())
+                    continue;
+                if (row[x] != 255)
+                    return std::nullopt;
+                usesTransparent = true;
+            }
+        }
+    }
+
+    if (usesTransparent) {
+        while (palette.size() < 256)
+            palette.append(qRgba(0, 0, 0, 0));
+    }
+    return palette;
+}
 
 void ApngExporter::setProgressCallback(std::function<void(float)> cb) {
     m_progressCallback = std::move(cb);
 }
 
+void ApngExporter::setPreset(ApngPreset preset) {
+    m_preset = preset;
+}
+
 ExportResult ApngExporter::exportAnimation(const AnimationData& data, const QString& path, QString name)
 {
     if (m_progressCallback)
@@ -43,6 +86,19 @@ ExportResult ApngExporter::exportAnimation(const AnimationData& data, const QStr
     apngasm::APNGAsm builder;
     builder.setLoops(0);       // 0 == infinite
     builder.setSkipFirst(false);
+    builder.setThreadCount(m_workerCount > 0 ? static_cast<unsigned>(m_workerCount) : 0u); // 0 is one per core there too
+
+    switch (m_preset) {
+    case ApngPreset::Fast:
+        builder.setCompressionPreset(apngasm::COMPRESSION_FAST);
+        break;
+    case ApngPreset::Max:
+        builder.setCompressionPreset(apngasm::COMPRESSION_MAX);
+        break;
+    default:
+        builder.setCompressionPreset(apngasm::COMPRESSION_BALANCED);
+        break;
+    }
 
     // Carry the loop keyframe across as an FSO.Keyframe iTXt chunk so FreeSpaceOpen
     // (and our own importer) can loop back to it. Each frame in data.frames is
@@ -52,31 +108,62 @@ ExportResult ApngExporter::exportAnimation(const AnimationData& data, const QStr
         builder.setKeyframe(data.loopPoint);
     }
 
-    // compute uniform per-frame delay = 1/data.fps
-    unsigned num = 1;
-    unsigned den = static_cast<unsigned>(data.fps);
-    unsigned g = std::gcd(num, den);
-    num /= g; den /= g;
+    // Quantized animations are written as an indexed PNG straight from the 8-bit frames,
+    // a quarter of the data to filter and deflate, and a smaller file
+    const std::optional<QVector<QRgb>> colors = indexedPalette(data);
+    const bool indexed = colors.has_value();
+    QVector<apngasm::rgba> palette;
+    if (indexed) {
+        for (QRgb c : *colors) {
+            palette.append({ uchar(qRed(c)), uchar(qGreen(c)), uchar(qBlue(c)), uchar(qAlpha(c)) });
+        }
+    }
 
-    // add each frame�s RGBA buffer
+    // add each frame, indexed or RGBA
     int count = 0;
-    for (const auto& frame : data.frames) {
-        QImage img = frame.image;
-        if (img.format() != QImage::Format_RGBA8888)
-            img = img.convertToFormat(QImage::Format_RGBA8888);
-
-        // fully qualify rgba from the apngasm namespace
-        apngasm::rgba* pixels =
-            reinterpret_cast<apngasm::rgba*>(img.bits());
-
-        // addFrame(rgba*, width, height, delayNum, delayDen) :contentReference[oaicite:0]{index=0}
-        builder.addFrame(
-            pixels,
-            static_cast<unsigned>(img.width()),
-            static_cast<unsigned>(img.height()),
-            num,
-            den
-        );
+    for (int i = 0; i < data.frames.size(); ++i) {
+        const AnimationFrame& frame = data.frames[i];
+
+        // per-frame delay, defaulting to 1/data.fps
+        unsigned num = 1;
+        unsigned den = static_cast<unsigned>(data.fps);
+        if (frame.delayDen > 0) {
+            num = static_cast<unsigned>(frame.delayNum);
+            den = static_cast<unsigned>(frame.delayDen);
+        }
+        unsigned g = std::gcd(num, den);
+        if (g > 1) { num /= g; den /= g; }
+
+        if (indexed) {
+            const FrameBuffer& img = data.quantizedFrames[i].image;
+            builder.addFrame(
+                img.constBits(),
+                static_cast<unsigned>(img.width()),
+                static_cast<unsigned>(img.height()),
+                static_cast<unsigned>(img.bytesPerLine()),
+                palette.constData(),
+                static_cast<int>(palette.size()),
+                num,
+                den
+            );
+        } else {
+            // Frames are stored as RGBA8888 so this normally shares the frame's buffer
+            const QImage img = frame.image.view(QImage::Format_RGBA8888);
+
+            // fully qualify rgba from the apngasm namespace
+            // (addFrame copies the pixels, it never writes through this pointer)
+            apngasm::rgba* pixels =
+                reinterpret_cast<apngasm::rgba*>(const_cast<uchar*>(img.constBits()));
+
+            // addFrame(rgba*, width, height, delayNum, delayDen) :contentReference[oaicite:0]{index=0}
+            builder.addFrame(
+                pixels,
+                static_cast<unsigned>(img.width()),
+                static_cast<unsigned>(img.height()),
+                num,
+                den
+            );
+        }
 
         // Emit progress mapped into [0.0, 0.05]
         if (m_progressCallback) {
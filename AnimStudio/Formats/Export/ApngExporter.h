@@ -3,6 +3,7 @@
 
 #include <QString>
 #include "Animation/AnimationData.h"
+#include "Formats/ImageFormats.h"
 
 class ApngExporter {
 public:
@@ -13,6 +14,14 @@ public:
     // Call with values from 0.0 to 1.0 (progress %)
     void setProgressCallback(std::function<void(float)> cb);
 
+    // Trade export time for file size, Balanced by default
+    void setPreset(ApngPreset preset);
+
+    // Compression trials run at once. 0 (the default) uses one worker per core
+    void setWorkerCount(int workers) { m_workerCount = workers; }
+
 private:
     std::function<void(float)> m_progressCallback;
+    ApngPreset m_preset = ApngPreset::Balanced;
+    int m_workerCount = 0;
 };
\ No newline at end of file
@@ -1,6 +1,6 @@
 // EffExporter.cpp
 #include "EffExporter.h"
-#include "RawExporter.h"
+#include "FrameWriter.h"
 #include <QFile>
 #include <QTextStream>
 #include <QDir>
@@ -32,8 +32,13 @@ ExportResult writeEffFile(const AnimationData& data,
     return ExportResult::ok();
 }
 
-ExportResult EffExporter::exportAnimation(const AnimationData& data, const QString& outputDir, ImageFormat fmt, CompressionFormat cFormat, QString name)
+ExportResult EffExporter::exportAnimation(const AnimationData& source, const QString& outputDir, ImageFormat fmt, CompressionFormat cFormat, QString name)
 {
+    // EFF only stores a single fps, so per-frame durations get expanded into fixed ticks
+    const bool expand = hasVariableTiming(source);
+    const AnimationData expanded = expand ? expandToFixedRate(source) : AnimationData{};
+    const AnimationData& data = expand ? expanded : source;
+
     if (m_progressCallback)
         m_progressCallback(0.0f);
     
@@ -49,28 +54,24 @@ ExportResult EffExporter::exportAnimation(const AnimationData& data, const QStri
 
     // Export all frames with 4-digit zero-padding
     const int padDigits = 4;
-    QStringList errors;
+    QStringList paths;
     for (int i = 0; i < data.frames.size(); ++i) {
         QString fileName = QString("%1_%2%3")
             .arg(name)
             .arg(i, padDigits, 10, QChar('0'))
             .arg(extensionForFormat(fmt));
-        QString fullPath = QDir(targetDir).filePath(fileName);
-        RawExporter exporter;
-        ExportResult result = exporter.exportCurrentFrame(data, i, fullPath, fmt, cFormat, false);
-        if (!result.success) {
-            errors << result.errorMessage;
-        }
-
-        // Emit progress (frame-wise granularity)
-        if (m_progressCallback) {
-            float progress = float(i + 1) / float(data.frames.size());
-            m_progressCallback(progress);
-        }
+        paths << QDir(targetDir).filePath(fileName);
     }
 
-    if (!errors.isEmpty()) {
-        return ExportResult::fail("One or more frames failed to export:\n" + errors.join("\n"));
+    FrameWriter writer(fmt, cFormat);
+    writer.setDdsSettings(m_ddsSettings);
+    writer.setTgaRle(m_tgaRle);
+    writer.setWorkerCount(m_workerCount);
+    writer.setThreadPool(m_threadPool);
+    writer.setProgressCallback(m_progressCallback);
+    ExportResult framesResult = writer.write(data, paths);
+    if (!framesResult.success) {
+        return framesResult;
     }
 
     // Write the .eff metadata file inside the same subfolder
@@ -14,6 +14,22 @@ public:
     // Call with values from 0.0 to 1.0 (progress %)
     void setProgressCallback(std::function<void(float)> cb);
 
+    // Quality, mip count and backend used for DDS frames
+    void setDdsSettings(const DdsSettings& settings) { m_ddsSettings = settings; }
+
+    // Run-length encode TGA frames
+    void setTgaRle(bool rle) { m_tgaRle = rle; }
+
+    // Frames encoded at once. 0 (the default) uses one worker per core
+    void setWorkerCount(int workers) { m_workerCount = workers; }
+
+    // Encode on this pool instead of a private one, see StagePool
+    void setThreadPool(QThreadPool* pool) { m_threadPool = pool; }
+
 private:
     std::function<void(float)> m_progressCallback;
+    DdsSettings m_ddsSettings;
+    bool m_tgaRle = false;
+    int m_workerCount = 0;
+    QThreadPool* m_threadPool = nullptr;
 };
\ No newline at end of file
@@ -0,0 +1,134 @@
+// FrameWriter.cpp
+#include "FrameWriter.h"
+#include "RawExporter.h"
+#include "Formats/ImageWriter.h"
+#include "Formats/Custom Handlers/DdsBatchEncoder.h"
+#include "Animation/StagePool.h"
+
+#include <QtConcurrent/QtConcurrent>
+#include <QFileInfo>
+#include <QFuture>
+#include <QSaveFile>
+#include <deque>
+
+#define ENCODED_FRAMES_PER_WORKER   2   // How far encoding may run ahead of the writer
+
+namespace {
+    struct EncodedFrame {
+        bool ok = false;
+        QByteArray bytes;
+    };
+}
+
+FrameWriter::FrameWriter(ImageFormat format, CompressionFormat cFormat)
+    : m_format(format)
+    , m_compression(cFormat)
+{
+}
+
+void FrameWriter::setWorkerCount(int workers) {
+    m_workerCount = workers;
+}
+
+void FrameWriter::setThreadPool(QThreadPool* pool) {
+    m_threadPool = pool;
+}
+
+void FrameWriter::setDdsSettings(const DdsSettings& settings) {
+    m_ddsSettings = settings;
+}
+
+void FrameWriter::setTgaRle(bool rle) {
+    m_tgaRle = rle;
+}
+
+void FrameWriter::setProgressCallback(std::function<void(float)> cb) {
+    m_progressCallback = std::move(cb);
+}
+
+ExportResult FrameWriter::write(const AnimationData& data, const QStringList& paths)
+{
+    const int total = static_cast<int>(std::min<qsizetype>(data.frames.size(), paths.size()));
+    if (total == 0) {
+        return ExportResult::fail(QString("No frames available to export!"));
+    }
+
+    if (m_format == ImageFormat::Dds) {
+        return writeDds(data, paths, total);
+    }
+
+    const int workerCount = m_workerCount > 0 ? m_workerCount : std::max(1, QThread::idealThreadCount());
+    const qsizetype maxPending = qsizetype(workerCount) * ENCODED_FRAMES_PER_WORKER;
+
+    StagePool pool(m_threadPool, workerCount);
+
+    auto encode = [this, &data](int i) -> EncodedFrame {
+        EncodedFrame result;
+        const QImage frame = RawExporter::frameForExport(data, i, m_format, m_compression);
+        result.ok = ImageWriter::encode(frame, m_format, m_compression, result.bytes, m_tgaRle);
+        return result;
+    };
+
+    QStringList errors;
+    std::deque<QFuture<EncodedFrame>> pending;
+    int nextToEncode = 0;
+
+    for (int i = 0; i < total; ++i) {
+        // Keep the workers busy, but don't let finished frames pile up
+        while (nextToEncode < total && qsizetype(pending.size()) < maxPending) {
+            pending.push_back(QtConcurrent::run(pool.get(), encode, nextToEncode++));
+        }
+
+        EncodedFrame frame = pending.front().result();
+        pending.pop_front();
+
+        bool ok = frame.ok;
+        if (ok) {
+            QSaveFile file(paths[i]);
+            ok = file.open(QIODevice::WriteOnly)
+                && file.write(frame.bytes) == frame.bytes.size()
+                && file.commit();
+        }
+
+        if (!ok) {
+            errors << QString("Failed to write frame %1 to '%2'")
+                .arg(i)
+                .arg(QFileInfo(paths[i]).fileName());
+        }
+
+        // Emit progress (frame-wise granularity)
+        if (m_progressCallback) {
+            m_progressCallback(float(i + 1) / float(total));
+        }
+    }
+
+    if (!errors.isEmpty()) {
+        return ExportResult::fail("One or more frames failed to export:\n" + errors.join("\n"));
+    }
+
+    return ExportResult::ok();
+}
+
+ExportResult FrameWriter::writeDds(const AnimationData& data, const QStringList& paths, int total)
+{
+    DdsBatchEncoder encoder(m_compression, m_ddsSettings);
+    encoder.setWorkerCount(m_workerCount);
+    encoder.setThreadPool(m_threadPool);
+    encoder.setProgressCallback(m_progressCallback);
+
+    const QVector<int> failed = encoder.write(paths.mid(0, total), [this, &data](int i) {
+        return RawExporter::frameForExport(data, i, m_format, m_compression);
+    });
+
+    if (!failed.isEmpty()) {
+        QStringList errors;
+        for (int i : failed) {
+            errors << QString("Failed to write frame %1 to '%2'")
+                .arg(i)
+                .arg(QFileInfo(paths[i]).fileName());
+        }
+        return ExportResult::fail("One or more frames failed to export:\n" + errors.join("\n"));
+    }
+
+    return ExportResult::ok();
+}
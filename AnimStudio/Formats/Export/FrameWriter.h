@@ -0,0 +1,47 @@
+// FrameWriter.h
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <functional>
+#include "Animation/AnimationData.h"
+#include "Formats/ImageFormats.h"
+
+// Writes every frame of an animation to its own image file. Frames are encoded on a pool of
+// worker threads while the calling thread writes the finished files in frame order, so only a
+// bounded number of encoded frames ever wait in memory. DDS frames go to DdsBatchEncoder,
+// which saves them straight from its workers.
+class FrameWriter {
+public:
+    FrameWriter(ImageFormat format, CompressionFormat cFormat);
+
+    // Write data.frames[i] to paths[i]. A failed frame does not stop the others,
+    // the result lists every frame that could not be written.
+    ExportResult write(const AnimationData& data, const QStringList& paths);
+
+    // 0 (the default) uses one worker per core
+    void setWorkerCount(int workers);
+
+    // Encode on this pool instead of a private one, see StagePool
+    void setThreadPool(QThreadPool* pool);
+
+    // Quality, mip count and backend used for DDS frames
+    void setDdsSettings(const DdsSettings& settings);
+
+    // Run-length encode TGA frames
+    void setTgaRle(bool rle);
+
+    // Call with values from 0.0 to 1.0 (progress %), in frame order
+    void setProgressCallback(std::function<void(float)> cb);
+
+private:
+    ExportResult writeDds(const AnimationData& data, const QStringList& paths, int total);
+
+    ImageFormat m_format;
+    CompressionFormat m_compression;
+    int m_workerCount = 0;
+    QThreadPool* m_threadPool = nullptr;
+    DdsSettings m_ddsSettings;
+    bool m_tgaRle = false;
+    std::function<void(float)> m_progressCallback;
+};
@@ -1,24 +1,16 @@
 // RawExporter.cpp
 #include "RawExporter.h"
+#include "FrameWriter.h"
 #include "Formats/ImageWriter.h"
 #include <QDir>
-#include <QImageWriter>
 #include <QPainter>
 
 void RawExporter::setProgressCallback(std::function<void(float)> cb) {
     m_progressCallback = std::move(cb);
 }
 
-ExportResult RawExporter::exportCurrentFrame(const AnimationData& data, int frameIndex, const QString& outputPath, ImageFormat format, CompressionFormat cFormat, bool updateProgress)
+QImage RawExporter::frameForExport(const AnimationData& data, int frameIndex, ImageFormat format, CompressionFormat cFormat)
 {
-    if (frameIndex < 0 || frameIndex >= data.frames.size())
-        return ExportResult::fail(QString("Invalid frame index: %1. Total frames: %2.")
-            .arg(frameIndex)
-            .arg(data.frames.size()));
-
-    if (m_progressCallback && updateProgress)
-        m_progressCallback(0.0f);
-
     const QImage& originalFrame = [&]() -> const QImage& {
         if (format == ImageFormat::Pcx &&
             frameIndex < data.quantizedFrames.size() &&
@@ -46,8 +38,22 @@ ExportResult RawExporter::exportCurrentFrame(const AnimationData& data, int fram
         }
     }
 
-    QImageWriter writer(outputPath);
-    if (!ImageWriter::write(frame, outputPath, format, cFormat)) {
+    return frame;
+}
+
+ExportResult RawExporter::exportCurrentFrame(const AnimationData& data, int frameIndex, const QString& outputPath, ImageFormat format, CompressionFormat cFormat, bool updateProgress)
+{
+    if (frameIndex < 0 || frameIndex >= data.frames.size())
+        return ExportResult::fail(QString("Invalid frame index: %1. Total frames: %2.")
+            .arg(frameIndex)
+            .arg(data.frames.size()));
+
+    if (m_progressCallback && updateProgress)
+        m_progressCallback(0.0f);
+
+    const QImage frame = frameForExport(data, frameIndex, format, cFormat);
+
+    if (!ImageWriter::write(frame, outputPath, format, cFormat, m_ddsSettings, m_tgaRle)) {
         return ExportResult::fail(QString("Failed to write frame %1 to '%2'")
             .arg(frameIndex)
             .arg(QFileInfo(outputPath).fileName()));
@@ -79,7 +85,7 @@ ExportResult RawExporter::exportAllFrames(const AnimationData& data, const QStri
     int digits = QString::number(maxIndex).length();
     QString ext = extensionForFormat(format);  // includes the leading .
 
-    QStringList errors;
+    QStringList paths;
     for (int i = 0; i < data.frameCount; ++i) {
         // zero-pad the frame number to 'digits' width
         QString fileName = QString("%1_%2%3")
@@ -87,26 +93,22 @@ ExportResult RawExporter::exportAllFrames(const AnimationData& data, const QStri
             .arg(i, digits, 10, QChar('0'))
             .arg(ext);
 
-        QString fullPath = dir.filePath(fileName);
-        ExportResult result = exportCurrentFrame(data, i, fullPath, format, cFormat, false);
-
-        if (!result.success) {
-            errors << result.errorMessage;
-        }
+        paths << dir.filePath(fileName);
+    }
 
-        // Emit progress (frame-wise granularity)
-        if (m_progressCallback) {
-            float progress = float(i + 1) / float(data.frames.size());
-            m_progressCallback(progress);
-        }
+    FrameWriter writer(format, cFormat);
+    writer.setDdsSettings(m_ddsSettings);
+    writer.setTgaRle(m_tgaRle);
+    writer.setWorkerCount(m_workerCount);
+    writer.setThreadPool(m_threadPool);
+    writer.setProgressCallback(m_progressCallback);
+    ExportResult result = writer.write(data, paths);
+    if (!result.success) {
+        return result;
     }
 
     if (m_progressCallback)
         m_progressCallback(1.0f);
 
-    if (!errors.isEmpty()) {
-        return ExportResult::fail("One or more frames failed to export:\n" + errors.join("\n"));
-    }
-
     return ExportResult::ok();
 }
@@ -18,6 +18,22 @@ const std::unordered_map<CompressionFormat, QString> compressionFormatDescriptio
     { CompressionFormat::BC7, "BC7 - Best quality, slowest, full 8-bit alpha" }
 };
 
+const std::unordered_map<ApngPreset, QString> apngPresetDescriptions = {
+    { ApngPreset::Fast, "Fast - Quickest export, larger files (previews)" },
+    { ApngPreset::Balanced, "Balanced - Good compression, moderate speed" },
+    { ApngPreset::Max, "Max - Smallest files, slowest (release builds)" }
+};
+
+const std::unordered_map<DdsBackend, QString> ddsBackendDescriptions = {
+    { DdsBackend::Cpu, "CPU - Reference encoders" },
+    { DdsBackend::Hpc, "HPC - SIMD encoders, usually faster" }
+};
+
+// Short name of a preset or backend description, e.g. "Fast"
+static QString descriptionShortName(const QString& desc) {
+    return desc.section(" - ", 0, 0);
+}
+
 QByteArray formatToQtString(ImageFormat fmt) {
     auto it = imageFormatExtensions.find(fmt);
     if (it != imageFormatExtensions.end()) {
@@ -98,6 +114,54 @@ bool isValidCompressionFormat(const QString& desc) {
     return false;
 }
 
+ApngPreset getApngPresetFromDescription(const QString& desc) {
+    for (const auto& kv : apngPresetDescriptions) {
+        const QString& fullDesc = kv.second;
+        if (desc.compare(fullDesc, Qt::CaseInsensitive) == 0 ||
+            desc.compare(descriptionShortName(fullDesc), Qt::CaseInsensitive) == 0) {
+            return kv.first;
+        }
+    }
+
+    // Default to Balanced if no match is found
+    return ApngPreset::Balanced;
+}
+
+bool isValidApngPreset(const QString& desc) {
+    for (const auto& kv : apngPresetDescriptions) {
+        const QString& fullDesc = kv.second;
+        if (desc.compare(fullDesc, Qt::CaseInsensitive) == 0 ||
+            desc.compare(descriptionShortName(fullDesc), Qt::CaseInsensitive) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+DdsBackend getDdsBackendFromDescription(const QString& desc) {
+    for (const auto& kv : ddsBackendDescriptions) {
+        const QString& fullDesc = kv.second;
+        if (desc.compare(fullDesc, Qt::CaseInsensitive) == 0 ||
+            desc.compare(descriptionShortName(fullDesc), Qt::CaseInsensitive) == 0) {
+            return kv.first;
+        }
+    }
+
+    // Default to CPU if no match is found
+    return DdsBackend::Cpu;
+}
+
+bool isValidDdsBackend(const QString& desc) {
+    for (const auto& kv : ddsBackendDescriptions) {
+        const QString& fullDesc = kv.second;
+        if (desc.compare(fullDesc, Qt::CaseInsensitive) == 0 ||
+            desc.compare(descriptionShortName(fullDesc), Qt::CaseInsensitive) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 QStringList availableFilters() {
     QStringList filters;
     filters.reserve(static_cast<int>(imageFormatExtensions.size()));
@@ -127,6 +191,23 @@ QStringList availableCompressionFormats() {
     return exts;
 }
 
+QStringList availableApngPresets() {
+    // Listed in enum order so the choices read fastest to smallest
+    QStringList presets;
+    for (ApngPreset preset : { ApngPreset::Fast, ApngPreset::Balanced, ApngPreset::Max }) {
+        presets.append(apngPresetDescriptions.at(preset));
+    }
+    return presets;
+}
+
+QStringList availableDdsBackends() {
+    QStringList backends;
+    for (DdsBackend backend : { DdsBackend::Cpu, DdsBackend::Hpc }) {
+        backends.append(ddsBackendDescriptions.at(backend));
+    }
+    return backends;
+}
+
 bool isSupportedFormat(const QString& ext) {
     // Normalize: ensure leading dot and lowercase
     QString norm = ext;
@@ -23,6 +23,26 @@ enum class CompressionFormat {
     BC7,
 };
 
+// Define an enum for apng export speed/size presets
+enum class ApngPreset {
+    Fast,
+    Balanced,
+    Max,
+};
+
+// Define an enum for the dds encoder backend
+enum class DdsBackend {
+    Cpu,
+    Hpc,
+};
+
+// Settings for dds compression
+struct DdsSettings {
+    float quality = 0.8f;                   // 0.05 (fastest) to 1.0 (best)
+    int mipLevels = 0;                      // 0 = full mip chain, 1 = no mips, N = at most N levels
+    DdsBackend backend = DdsBackend::Cpu;
+};
+
 // Provide a hash function so ImageFormat can be used as a key in unordered_map
 namespace std {
     template<>
@@ -39,6 +59,12 @@ extern const std::unordered_map<ImageFormat, QString> imageFormatExtensions;
 // Mapping from CompressionFormat to its description string
 extern const std::unordered_map<CompressionFormat, QString> compressionFormatDescriptions;
 
+// Mapping from ApngPreset to its description string
+extern const std::unordered_map<ApngPreset, QString> apngPresetDescriptions;
+
+// Mapping from DdsBackend to its description string
+extern const std::unordered_map<DdsBackend, QString> ddsBackendDescriptions;
+
 // Convert an ImageFormat into the Qt image format string (for QImageWriter)
 QByteArray formatToQtString(ImageFormat fmt);
 
@@ -57,6 +83,18 @@ CompressionFormat getCompressionFormatFromDescription(const QString& desc);
 // Check if the given compression format is valid
 bool isValidCompressionFormat(const QString& desc);
 
+// Get the ApngPreset enum value for the given description string or short name ("fast", "balanced", "max")
+ApngPreset getApngPresetFromDescription(const QString& desc);
+
+// Check if the given apng preset is valid
+bool isValidApngPreset(const QString& desc);
+
+// Get the DdsBackend enum value for the given description string or short name ("cpu", "hpc")
+DdsBackend getDdsBackendFromDescription(const QString& desc);
+
+// Check if the given dds backend is valid
+bool isValidDdsBackend(const QString& desc);
+
 // Get a list of file patterns (e.g. "*.png") for all supported formats
 QStringList availableFilters();
 
@@ -66,5 +104,11 @@ QStringList availableExtensions();
 // Get a list of supported compression formats
 QStringList availableCompressionFormats();
 
+// Get a list of apng presets, fastest first
+QStringList availableApngPresets();
+
+// Get a list of dds encoder backends
+QStringList availableDdsBackends();
+
 // Check if a given file extension is supported
 bool isSupportedFormat(const QString& ext);
\ No newline at end of file
@@ -1,13 +1,81 @@
 #include "ImageLoader.h"
 #include "Custom Handlers/DdsHandler.h"
 #include "Custom Handlers/PcxHandler.h"
+#include "Custom Handlers/PngHandler.h"
 #include "Custom Handlers/TgaHandler.h"
 
 #include <QFile>
 #include <QImageReader>
 #include <QDebug>
 
+namespace {
+    // Names for what Qt reports for the formats it reads itself
+    QString pixelFormatName(QImage::Format format) {
+        switch (format) {
+        case QImage::Format_Mono:
+        case QImage::Format_MonoLSB:
+            return "indexed1";
+        case QImage::Format_Indexed8:
+            return "indexed8";
+        case QImage::Format_Grayscale8:
+            return "gray8";
+        case QImage::Format_Grayscale16:
+            return "gray16";
+        case QImage::Format_RGB32:
+        case QImage::Format_RGB888:
+        case QImage::Format_RGBX8888:
+            return "rgb8";
+        case QImage::Format_ARGB32:
+        case QImage::Format_ARGB32_Premultiplied:
+        case QImage::Format_RGBA8888:
+        case QImage::Format_RGBA8888_Premultiplied:
+            return "rgba8";
+        case QImage::Format_RGBX64:
+            return "rgb16";
+        case QImage::Format_RGBA64:
+        case QImage::Format_RGBA64_Premultiplied:
+            return "rgba16";
+        default:
+            return "other";
+        }
+    }
+
+    // Run one of our handlers' readInfo() on an opened file
+    template <typename Handler>
+    std::optional<ImageLoader::ImageInfo> probeWith(const QString& path) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return std::nullopt;
+        }
+
+        Handler handler;
+        handler.setDevice(&file);
+        ImageLoader::ImageInfo info;
+        if (!handler.readInfo(&info.size, &info.pixelFormat)) {
+            return std::nullopt;
+        }
+        return info;
+    }
+}
+
 QImage ImageLoader::load(const QString& path) {
+    if (path.endsWith(".png", Qt::CaseInsensitive)) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            qWarning() << "PNG file could not be opened:" << path;
+            return QImage();
+        }
+
+        // One per loader thread, so each keeps its libpng allocations between frames
+        thread_local PngHandler handler;
+        handler.setDevice(&file);
+        QImage img;
+        if (handler.read(&img)) {
+            return img;
+        }
+        qWarning() << "Falling back to Qt for PNG image:" << path;
+    }
+
     if (path.endsWith(".pcx", Qt::CaseInsensitive)) {
         QFile file(path);
         if (!file.open(QIODevice::ReadOnly)) {
@@ -61,3 +129,54 @@ QImage ImageLoader::load(const QString& path) {
 
     return QImage(path); // fallback to Qt-native
 }
+
+BcnImage ImageLoader::loadCompressed(const QString& path) {
+    if (!path.endsWith(".dds", Qt::CaseInsensitive)) {
+        return BcnImage();
+    }
+
+    DdsHandler handler;
+    handler.setDevice(path);
+    BcnImage img;
+    if (!handler.readCompressed(&img)) {
+        return BcnImage();
+    }
+    return img;
+}
+
+std::optional<ImageLoader::ImageInfo> ImageLoader::probe(const QString& path) {
+    if (path.endsWith(".png", Qt::CaseInsensitive)) {
+        if (auto info = probeWith<PngHandler>(path)) {
+            return info;
+        }
+        // Let Qt have a go below, the same as load() falls back
+    }
+
+    if (path.endsWith(".pcx", Qt::CaseInsensitive)) {
+        return probeWith<PcxHandler>(path);
+    }
+
+    if (path.endsWith(".tga", Qt::CaseInsensitive)) {
+        return probeWith<TgaHandler>(path);
+    }
+
+    if (path.endsWith(".dds", Qt::CaseInsensitive)) {
+        DdsHandler handler;
+        handler.setDevice(path);
+        ImageInfo info;
+        if (!handler.readInfo(&info.size, &info.pixelFormat)) {
+            return std::nullopt;
+        }
+        return info;
+    }
+
+    QImageReader reader(path);
+    if (!reader.canRead()) {
+        return std::nullopt;
+    }
+
+    ImageInfo info;
+    info.size = reader.size();
+    info.pixelFormat = pixelFormatName(reader.imageFormat());
+    return info;
+}
@@ -1,8 +1,23 @@
 #pragma once
 
+#include "BcnDecoder.h"
 #include <QImage>
+#include <QSize>
 #include <QString>
+#include <optional>
 
 namespace ImageLoader {
+    // Size and pixel layout of an image file as stored ("indexed8", "rgba8", "bc7"...)
+    struct ImageInfo {
+        QSize size;
+        QString pixelFormat;
+    };
+
     QImage load(const QString& path);
+
+    // Reads only the file's header. Nullopt if it can't be opened or isn't a readable image.
+    std::optional<ImageInfo> probe(const QString& path);
+
+    // The still-compressed top level of a BC1/BC3/BC7 DDS file. Null for any other file.
+    BcnImage loadCompressed(const QString& path);
 }
@@ -3,11 +3,12 @@
 #include "Custom Handlers/PcxHandler.h"
 #include "Custom Handlers/TgaHandler.h"
 
+#include <QBuffer>
 #include <QFile>
 #include <QImageWriter>
 #include <QDebug>
 
-bool ImageWriter::write(const QImage& image, const QString& path, ImageFormat fmt, CompressionFormat cFormat) {
+bool ImageWriter::write(const QImage& image, const QString& path, ImageFormat fmt, CompressionFormat cFormat, const DdsSettings& dds, bool tgaRle) {
     if (fmt == ImageFormat::Pcx || path.endsWith(".pcx", Qt::CaseInsensitive)) {
         QFile file(path);
         if (!file.open(QIODevice::WriteOnly)) {
@@ -29,6 +30,7 @@ bool ImageWriter::write(const QImage& image, const QString& path, ImageFormat fm
 
         TgaHandler handler;
         handler.setDevice(&file);
+        handler.setRle(tgaRle);
         return handler.write(image);
     }
 
@@ -42,6 +44,7 @@ bool ImageWriter::write(const QImage& image, const QString& path, ImageFormat fm
         DdsHandler handler;
         handler.setDevice(path);
         handler.setCompression(cFormat);
+        handler.setSettings(dds);
         return handler.write(image);
     }
 
@@ -56,3 +59,45 @@ bool ImageWriter::write(const QImage& image, const QString& path, ImageFormat fm
     writer.setFormat(ext.toUtf8());
     return writer.write(image);
 }
+
+bool ImageWriter::encode(const QImage& image, ImageFormat fmt, CompressionFormat cFormat, QByteArray& out, bool tgaRle) {
+    Q_UNUSED(cFormat);
+    out.clear();
+
+    QBuffer buffer(&out);
+    if (!buffer.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    switch (fmt) {
+    case ImageFormat::Pcx: {
+        PcxHandler handler;
+        handler.setDevice(&buffer);
+        return handler.write(image);
+    }
+    case ImageFormat::Tga: {
+        TgaHandler handler;
+        handler.setDevice(&buffer);
+        handler.setRle(tgaRle);
+        return handler.write(image);
+    }
+    case ImageFormat::Dds:
+        qWarning() << "DDS frames can't be encoded into memory, use ImageWriter::write";
+        return false;
+    default:
+        break;
+    }
+
+    // QImageWriter expects an extension format without a leading '.'
+    QString ext = extensionForFormat(fmt);
+    if (ext.startsWith('.')) {
+        ext.remove(0, 1);
+    }
+
+    QImageWriter writer(&buffer, ext.toUtf8());
+    return writer.write(image);
+}
+
+bool ImageWriter::canEncode(ImageFormat fmt) {
+    return fmt != ImageFormat::Dds;
+}
@@ -1,9 +1,18 @@
 #pragma once
 
 #include "Formats/ImageFormats.h"
+#include <QByteArray>
 #include <QImage>
 #include <QString>
 
 namespace ImageWriter {
-    bool write(const QImage& image, const QString& path, ImageFormat fmt, CompressionFormat cFormat);
+    // tgaRle writes run-length encoded TGA files instead of uncompressed ones
+    bool write(const QImage& image, const QString& path, ImageFormat fmt, CompressionFormat cFormat, const DdsSettings& dds = DdsSettings(), bool tgaRle = false);
+
+    // Encode into memory instead of a file, so the encoding can happen away from the thread
+    // doing the file I/O. Not every format can do this, see canEncode().
+    bool encode(const QImage& image, ImageFormat fmt, CompressionFormat cFormat, QByteArray& out, bool tgaRle = false);
+
+    // True if encode() supports the format. DDS can only be saved straight to a file.
+    bool canEncode(ImageFormat fmt);
 }
@@ -0,0 +1,318 @@
+#include "AniDecoder.h"
+#include "Animation/StagePool.h"
+#include <QMutex>
+#include <QThread>
+#include <QtConcurrent>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+
+#define FRAME_HOLDOVER_COLOR_INDEX  254     // As per ani documentation, 254 is holdover from last frame
+
+// Bounds checked reader over the mapped file. Reading past the end yields zeros,
+// matching what QDataStream used to hand back, and records that the data was short.
+struct AniCursor {
+    const uchar* data;
+    qint64 size;
+    qint64 pos;
+    bool overrun = false;
+
+    quint8 u8() {
+        if (pos < size)
+            return data[pos++];
+        overrun = true;
+        return 0;
+    }
+
+    quint16 u16() {
+        if (pos + 2 <= size) {
+            quint16 v = qFromLittleEndian<quint16>(data + pos);
+            pos += 2;
+            return v;
+        }
+        pos = size;
+        overrun = true;
+        return 0;
+    }
+
+    quint32 u32() {
+        if (pos + 4 <= size) {
+            quint32 v = qFromLittleEndian<quint32>(data + pos);
+            pos += 4;
+            return v;
+        }
+        pos = size;
+        overrun = true;
+        return 0;
+    }
+};
+
+AniDecoder::~AniDecoder() {
+    close();
+}
+
+void AniDecoder::close() {
+    if (m_file.isOpen()) {
+        m_file.close(); // Also unmaps
+    }
+    m_fallback.clear();
+    m_data = nullptr;
+    m_dataSize = 0;
+    m_segments.clear();
+    m_keyframeIndices.clear();
+    m_warnings.clear();
+}
+
+bool AniDecoder::open(const QString& aniPath) {
+    close();
+
+    m_file.setFileName(aniPath);
+    if (!m_file.open(QIODevice::ReadOnly))
+        return false;
+
+    const qint64 fileSize = m_file.size();
+    const uchar* base = fileSize > 0 ? m_file.map(0, fileSize) : nullptr;
+    if (!base) {
+        m_fallback = m_file.readAll();
+        base = reinterpret_cast<const uchar*>(m_fallback.constData());
+    }
+
+    AniCursor in{ base, fileSize, 0 };
+
+    // 1) Fixed-size header (DDN spec)
+    quint16 shouldBeZero = in.u16();
+    quint16 version = in.u16();
+    quint16 fps = in.u16();
+    quint8 rgbR = in.u8();
+    quint8 rgbG = in.u8();
+    quint8 rgbB = in.u8();
+    quint16 w = in.u16();
+    quint16 h = in.u16();
+    quint16 nframes = in.u16();
+    m_packerCode = in.u8();
+
+    if (in.overrun || shouldBeZero != 0 || version < 2 || nframes == 0) {
+        close();
+        return false; // invalid ANI
+    }
+
+    m_width = w;
+    m_height = h;
+    m_frameCount = nframes;
+    m_fps = fps;
+
+    // 2) 256-entry palette
+    m_palette.clear();
+    m_palette.reserve(256);
+    for (int i = 0; i < 256; ++i) {
+        quint8 pr = in.u8();
+        quint8 pg = in.u8();
+        quint8 pb = in.u8();
+        m_palette.append(qRgb(pr, pg, pb));
+    }
+
+    int transparentIndex = -1;
+    for (int i = 0; i < m_palette.size(); ++i) {
+        QRgb color = m_palette[i];
+        if (qRed(color) == rgbR && qGreen(color) == rgbG && qBlue(color) == rgbB) {
+            transparentIndex = i;
+            break;
+        }
+    }
+
+    for (int i = 0; i < 256; ++i) {
+        m_indexMap[i] = static_cast<uchar>(i);
+    }
+
+    if (transparentIndex >= 0) {
+        m_palette[transparentIndex] = qRgba(rgbR, rgbG, rgbB, 0); // force alpha=0
+    }
+
+    // Ensure the transparent pixel is at the end for easy export later. Pixels are
+    // remapped through m_indexMap as they are decoded.
+    if (transparentIndex >= 0 && transparentIndex != 255) {
+        qSwap(m_palette[transparentIndex], m_palette[255]);
+        m_indexMap[transparentIndex] = 255;
+        m_indexMap[255] = static_cast<uchar>(transparentIndex);
+    }
+
+    // 3) Keyframe table
+    quint16 numKeys = in.u16();
+    QVector<Keyframe> keys;
+    keys.reserve(numKeys);
+    for (int i = 0; i < numKeys; ++i) {
+        quint16 twobyte = in.u16();
+        quint32 startcount = in.u32();
+        // ANI stores keyframe numbers 1..N but our frames are 0..N-1
+        int idx = (twobyte > 0) ? int(twobyte) - 1 : 0;
+        m_keyframeIndices.append(idx);
+        keys.append({ idx, qint64(startcount) });
+    }
+    in.u32(); // endcount, the actual file size is what bounds decoding
+
+    if (in.overrun) {
+        close();
+        return false;
+    }
+
+    m_data = base + in.pos;
+    m_dataSize = fileSize - in.pos;
+
+    // Segments start at frame 0 and at every keyframe whose entry is consistent with the others.
+    // Anything odd is skipped here; it only costs parallelism, not correctness.
+    std::sort(keys.begin(), keys.end(), [](const Keyframe& a, const Keyframe& b) { return a.frame < b.frame; });
+    m_segments.append({ 0, m_frameCount, 0 });
+    for (const Keyframe& key : keys) {
+        if (key.frame == 0)
+            continue;
+
+        const Segment& prev = m_segments.last();
+        if (key.frame >= m_frameCount || key.frame <= prev.first || key.offset <= prev.offset || key.offset >= m_dataSize) {
+            m_warnings << QString("Ignoring keyframe entry for frame %1 with invalid offset %2.").arg(key.frame + 1).arg(key.offset);
+            continue;
+        }
+
+        m_segments.last().last = key.frame;
+        m_segments.append({ key.frame, m_frameCount, key.offset });
+    }
+
+    return true;
+}
+
+AniDecoder::SegmentResult AniDecoder::decodeSegment(int first, int last, qint64 offset, const QImage* previous, bool keepAll,
+    const std::function<void()>& frameDone) const {
+    SegmentResult result;
+    if (keepAll)
+        result.frames.reserve(last - first);
+
+    AniCursor in{ m_data, m_dataSize, std::min(offset, m_dataSize) };
+    const int w = m_width;
+    const int h = m_height;
+
+    QImage prevImage = previous ? *previous : QImage();
+
+    for (int i = first; i < last; ++i) {
+        in.u8(); // Flag byte, often unused
+
+        QImage img(w, h, QImage::Format_Indexed8);
+        img.setColorTable(m_palette);
+
+        // Runs carry across scanlines but never across frames
+        int remaining = 0;
+        quint8 runValue = 0;
+
+        for (int y = 0; y < h; ++y) {
+            uchar* dst = img.scanLine(y);
+            const uchar* src = prevImage.isNull() ? nullptr : prevImage.constScanLine(y);
+
+            int x = 0;
+            while (x < w) {
+                if (remaining == 0) {
+                    runValue = in.u8();
+                    remaining = 1;
+                    if (runValue == m_packerCode) {
+                        // A count below 2 is a literal packer code, otherwise the value follows.
+                        // Either way the count is "repeat this many times after the current pixel".
+                        quint8 runCount = in.u8();
+                        if (runCount >= 2) {
+                            runValue = in.u8();
+                        }
+                        remaining = runCount + 1;
+                    }
+                }
+
+                int n = std::min(remaining, w - x);
+                if (runValue == FRAME_HOLDOVER_COLOR_INDEX) {
+                    if (src) {
+                        std::memcpy(dst + x, src + x, n);
+                    } else {
+                        // Nothing to hold over from; the very first frame decodes these as index 0
+                        std::memset(dst + x, m_indexMap[0], n);
+                        if (i > 0)
+                            result.needsPrevious = true;
+                    }
+                } else {
+                    std::memset(dst + x, m_indexMap[runValue], n);
+                }
+                x += n;
+                remaining -= n;
+            }
+        }
+
+        prevImage = img;
+        if (keepAll || i == last - 1)
+            result.frames.append(img);
+
+        if (frameDone)
+            frameDone();
+    }
+
+    result.endOffset = in.pos;
+    result.truncated = in.overrun;
+    return result;
+}
+
+QImage AniDecoder::decodeFrame(int index) {
+    if (!m_data || index < 0 || index >= m_frameCount)
+        return QImage();
+
+    int seg = static_cast<int>(m_segments.size()) - 1;
+    while (seg > 0 && m_segments[seg].first > index)
+        --seg;
+
+    // A keyframe that still references holdover pixels can't stand alone, so back up until one does
+    for (; seg >= 0; --seg) {
+        SegmentResult r = decodeSegment(m_segments[seg].first, index + 1, m_segments[seg].offset, nullptr, false);
+        if (!r.needsPrevious || seg == 0) {
+            if (r.truncated)
+                m_warnings << QString("ANI data ends early while decoding frame %1; missing pixels were filled with index 0.").arg(index);
+            return r.frames.isEmpty() ? QImage() : r.frames.last();
+        }
+    }
+
+    return QImage();
+}
+
+QVector<QImage> AniDecoder::decodeAll(std::function<void(float)> progressCallback) {
+    QVector<QImage> frames;
+    if (!m_data)
+        return frames;
+
+    const int cores = m_workerCount > 0 ? m_workerCount : QThread::idealThreadCount();
+    StagePool pool(m_threadPool, std::max(1, std::min(cores, int(m_segments.size()))));
+
+    QMutex progressMutex;
+    int completed = 0;
+    auto frameDone = [&]() {
+        if (progressCallback) {
+            QMutexLocker lock(&progressMutex);
+            progressCallback(static_cast<float>(++completed) / m_frameCount);
+        }
+    };
+
+    QVector<SegmentResult> results = QtConcurrent::blockingMapped<QVector<SegmentResult>>(pool.get(), m_segments, [&](const Segment& s) {
+        return decodeSegment(s.first, s.last, s.offset, nullptr, true, frameDone);
+    });
+
+    // Stitch segments together. If a segment's keyframe turned out to depend on the previous frame,
+    // or the previous segment didn't end where the table said this one starts, decode it again
+    // serially so the result is exactly what a front-to-back decode would give.
+    for (int j = 1; j < results.size(); ++j) {
+        const SegmentResult& prev = results[j - 1];
+        if (results[j].needsPrevious || prev.endOffset != m_segments[j].offset) {
+            results[j] = decodeSegment(m_segments[j].first, m_segments[j].last, prev.endOffset, &prev.frames.last(), true);
+        }
+    }
+
+    frames.reserve(m_frameCount);
+    bool truncated = false;
+    for (SegmentResult& r : results) {
+        truncated = truncated || r.truncated;
+        frames.append(std::move(r.frames));
+    }
+
+    if (truncated)
+        m_warnings << "ANI data ends early; missing pixels were filled with index 0.";
+
+    return frames;
+}
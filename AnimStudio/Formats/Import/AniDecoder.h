@@ -0,0 +1,90 @@
+#pragma once
+
+#include <QFile>
+#include <QImage>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <functional>
+
+class QThreadPool;
+
+// Decodes FreeSpace ANI files straight from a memory-mapped view of the file.
+// The keyframe offset table is kept so a single frame can be decoded by replaying
+// only from the nearest keyframe, and a full decode splits the stream into
+// keyframe-delimited segments that are decoded in parallel.
+class AniDecoder {
+public:
+    struct Keyframe {
+        int frame;     // 0-based frame index
+        qint64 offset; // Offset of the frame's flag byte within the compressed data
+    };
+
+    ~AniDecoder();
+
+    // Parses the header, palette and keyframe table. Returns false if the file is not a valid ANI.
+    bool open(const QString& aniPath);
+    void close();
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    int frameCount() const { return m_frameCount; }
+    int fps() const { return m_fps; }
+
+    // Palette with the transparent color (if any) moved to index 255 and given alpha 0
+    const QVector<QRgb>& palette() const { return m_palette; }
+
+    // Keyframe numbers exactly as listed in the file, converted to 0-based indices
+    const QVector<int>& keyframeIndices() const { return m_keyframeIndices; }
+
+    // Problems found while parsing or decoding (bad keyframe entries, truncated data)
+    QStringList warnings() const { return m_warnings; }
+
+    // Decode a single frame, replaying from the closest usable keyframe
+    QImage decodeFrame(int index);
+
+    // Decode every frame. Call with values from 0.0 to 1.0 (progress %)
+    QVector<QImage> decodeAll(std::function<void(float)> progressCallback = nullptr);
+
+    // Segments decodeAll() decodes at once. 0 (the default) uses one worker per core
+    void setWorkerCount(int workers) { m_workerCount = workers; }
+
+    // Have decodeAll() run on this pool instead of a private one, see StagePool
+    void setThreadPool(QThreadPool* pool) { m_threadPool = pool; }
+
+private:
+    struct Segment {
+        int first;     // First frame in the segment
+        int last;      // One past the last frame in the segment
+        qint64 offset; // Where the first frame starts in the compressed data
+    };
+
+    struct SegmentResult {
+        QVector<QImage> frames;
+        qint64 endOffset = 0;
+        bool needsPrevious = false; // First frame referenced holdover pixels with no previous frame
+        bool truncated = false;
+    };
+
+    SegmentResult decodeSegment(int first, int last, qint64 offset, const QImage* previous, bool keepAll,
+        const std::function<void()>& frameDone = nullptr) const;
+
+    QFile m_file;
+    QByteArray m_fallback;       // Used when the file cannot be mapped
+    const uchar* m_data = nullptr; // Start of the compressed frame data
+    qint64 m_dataSize = 0;
+
+    int m_width = 0;
+    int m_height = 0;
+    int m_frameCount = 0;
+    int m_fps = 0;
+    quint8 m_packerCode = 0;
+    int m_workerCount = 0;
+    QThreadPool* m_threadPool = nullptr;
+
+    QVector<QRgb> m_palette;
+    uchar m_indexMap[256];       // Stored index -> index in m_palette
+    QVector<int> m_keyframeIndices;
+    QVector<Segment> m_segments; // Frame 0 plus every usable keyframe, in order
+    QStringList m_warnings;
+};
@@ -8,10 +8,21 @@
 class AniImporter {
 public:
     std::optional<AnimationData> importFromFile(const QString& aniPath);
+
+    // Header and keyframe table only, no frame is decompressed
+    std::optional<AnimationInfo> probe(const QString& aniPath);
     
     // Call with values from 0.0 to 1.0 (progress %)
     void setProgressCallback(std::function<void(float)> cb);
 
+    // Keyframe segments decoded at once. 0 (the default) uses one worker per core
+    void setWorkerCount(int workers) { m_workerCount = workers; }
+
+    // Decode on this pool instead of a private one, see StagePool
+    void setThreadPool(QThreadPool* pool) { m_threadPool = pool; }
+
 private:
     std::function<void(float)> m_progressCallback;
+    int m_workerCount = 0;
+    QThreadPool* m_threadPool = nullptr;
 };
@@ -1,13 +1,18 @@
 #include "ApngImporter.h"
 #include "Animation/AnimationData.h"
+#include "Formats/Custom Handlers/PngHandler.h"
 #include "apng_dis.h"
 #include <QFileInfo>
 #include <QFile>
 #include <QImage>
 #include <QDebug>
 
+#include <algorithm>
+#include <cmath>
 #include <cstdlib>
 #include <cstring>
+#include <functional>
+#include <numeric>
 #include <string>
 
 namespace {
@@ -52,35 +57,50 @@ bool parseFsoKeyframeItxt(const QByteArray& data, int& outKeyframe) {
     return true;
 }
 
-// Scan a PNG/APNG file for the FSO.Keyframe iTXt chunk. Returns the raw APNG
-// frame index the animation should loop back to, or -1 if none is present.
-int extractApngKeyframe(const QString& path) {
+// Walk a PNG/APNG file's chunks up to IEND. Only the data of the chunk types in
+// wanted is read, everything else (the image data) is seeked past. visit gets the
+// type and, for wanted chunks, the data; returning false stops the walk. Returns
+// false if the file can't be opened or isn't a PNG.
+bool walkChunks(const QString& path, std::initializer_list<const char*> wanted,
+                const std::function<bool(const QByteArray& type, const QByteArray& data)>& visit) {
     QFile file(path);
-    if (!file.open(QIODevice::ReadOnly)) return -1;
-    const QByteArray bytes = file.readAll();
-    file.close();
+    if (!file.open(QIODevice::ReadOnly)) return false;
 
     static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
-    if (bytes.size() < 8 || memcmp(bytes.constData(), signature, 8) != 0) return -1;
-
-    qint64 pos = 8;
-    while (pos + 8 <= bytes.size()) {
-        const unsigned char* u = reinterpret_cast<const unsigned char*>(bytes.constData() + pos);
+    const QByteArray head = file.read(8);
+    if (head.size() < 8 || memcmp(head.constData(), signature, 8) != 0) return false;
+
+    const qint64 fileSize = file.size();
+    for (;;) {
+        const QByteArray chunkHead = file.read(8);
+        if (chunkHead.size() < 8) break;
+        const unsigned char* u = reinterpret_cast<const unsigned char*>(chunkHead.constData());
         const qint64 length = (qint64(u[0]) << 24) | (qint64(u[1]) << 16) | (qint64(u[2]) << 8) | qint64(u[3]);
-        const char* type = bytes.constData() + pos + 4;
-        const qint64 dataPos = pos + 8;
-        if (length < 0 || dataPos + length + 4 > bytes.size()) break;  // truncated/corrupt
-
-        if (memcmp(type, "iTXt", 4) == 0) {
-            int keyframe = -1;
-            if (parseFsoKeyframeItxt(bytes.mid(int(dataPos), int(length)), keyframe))
-                return keyframe;
+        const QByteArray type = chunkHead.mid(4, 4);
+        if (file.pos() + length + 4 > fileSize) break;  // truncated/corrupt
+
+        QByteArray data;
+        const bool read = std::any_of(wanted.begin(), wanted.end(),
+                                      [&](const char* t) { return type == t; });
+        if (read) {
+            data = file.read(length);
+            if (data.size() != length) break;
         }
-        if (memcmp(type, "IEND", 4) == 0) break;
+        file.seek(file.pos() + (read ? 0 : length) + 4);  // past data + crc
 
-        pos = dataPos + length + 4;  // advance past data + crc
+        if (!visit(type, data) || type == "IEND") break;
     }
-    return -1;
+    return true;
+}
+
+// Scan a PNG/APNG file for the FSO.Keyframe iTXt chunk. Returns the raw APNG
+// frame index the animation should loop back to, or -1 if none is present.
+int extractApngKeyframe(const QString& path) {
+    int keyframe = -1;
+    walkChunks(path, { "iTXt" }, [&](const QByteArray& type, const QByteArray& data) {
+        return !(type == "iTXt" && parseFsoKeyframeItxt(data, keyframe));
+    });
+    return keyframe;
 }
 
 }  // namespace
@@ -120,54 +140,49 @@ std::optional<AnimationData> ApngImporter::importFromFile(const QString& path) {
             if (f.delay_num == 0) f.delay_num = 1;
         }
 
-        // 2) Compute common denominator = LCM of all frame delay_den
-        int baseDen = frames.empty() ? 100 : frames[0].delay_den;
-        auto lcm = [&](int a, int b) {
-            return a / std::gcd(a, b) * b;
-            };
-        for (size_t i = 1; i < frames.size(); ++i) {
-            baseDen = lcm(baseDen, int(frames[i].delay_den));
+        // 2) Reduce each delay. If every frame has the same whole-number rate we keep
+        // the animation uniform, otherwise each frame keeps its own duration.
+        bool uniform = true;
+        for (auto& f : frames) {
+            unsigned int g = std::gcd(f.delay_num, f.delay_den);
+            f.delay_num /= g;
+            f.delay_den /= g;
+            if (f.delay_num != frames[0].delay_num || f.delay_den != frames[0].delay_den)
+                uniform = false;
         }
+        const bool perFrameTiming = !frames.empty() && !(uniform && frames[0].delay_num == 1);
 
         if (m_progressCallback) m_progressCallback(0.4f);
 
-        // 3) fps = baseDen (i.e. tick = 1/baseDen seconds)
-        out.fps = baseDen;
+        // 3) fps is only a display hint when frames carry their own timing
+        out.fps = frames.empty()
+            ? 15
+            : std::max(1, int(std::lround(double(frames[0].delay_den) / frames[0].delay_num)));
 
-        // 4) Expand frames into discrete ticks
+        // 4) One AnimationFrame per APNG frame
         out.frames.clear();
-        // Record the tick index at which each source APNG frame begins, so an
-        // FSO.Keyframe (expressed as an APNG frame index) can be mapped into our
-        // expanded tick space below.
-        std::vector<int> frameStartTicks;
-        frameStartTicks.reserve(frames.size());
-        int globalIndex = 0;
         for (size_t i = 0; i < frames.size(); ++i) {
             auto& f = frames[i];
-            frameStartTicks.push_back(globalIndex);
-            // how many ticks this frame should occupy
-            int repeatCount = int(f.delay_num) * (baseDen / int(f.delay_den));
 
-            // wrap raw RGBA into a QImage once
+            // wrap raw RGBA into a QImage once, already in our storage format
             QImage img(
                 reinterpret_cast<const uchar*>(f.p),
                 int(f.w), int(f.h),
                 int(f.w * f.bpp),
-                QImage::Format_ARGB32
+                FRAME_STORAGE_FORMAT
             );
-            img = img.rgbSwapped();
-            QImage copy = img.copy();
-
-            // duplicate
-            for (int t = 0; t < repeatCount; ++t) {
-                AnimationFrame af;
-                af.image = copy;
-                af.index = globalIndex++;              // sequential tick index
-                af.filename = QStringLiteral("%1_frame%2")
-                    .arg(out.baseName)
-                    .arg(int(i));
-                out.frames.append(std::move(af));
+
+            AnimationFrame af;
+            af.image = img.copy(); // deep copy, safe to free the loader's buffer
+            af.index = int(i);
+            af.filename = QStringLiteral("%1_frame%2")
+                .arg(out.baseName)
+                .arg(int(i));
+            if (perFrameTiming) {
+                af.delayNum = int(f.delay_num);
+                af.delayDen = int(f.delay_den);
             }
+            out.frames.append(std::move(af));
 
             // free the loader’s buffers
             f.free();
@@ -175,7 +190,7 @@ std::optional<AnimationData> ApngImporter::importFromFile(const QString& path) {
             // report 40 -> 100% over the load loop
             if (m_progressCallback) {
                 float frac = float(i + 1) / float(frames.size());
-                float p = 0.4f + frac * 1.0f;
+                float p = 0.4f + frac * 0.6f;
                 m_progressCallback(p);
             }
         }
@@ -184,16 +199,16 @@ std::optional<AnimationData> ApngImporter::importFromFile(const QString& path) {
         out.frameCount = out.frames.size();
 
         // 6) Apply the FSO loop keyframe, if present. The chunk stores an APNG
-        // frame index; map it into our expanded tick space. A keyframe of 0 (or
-        // an out-of-range value) just means "loop to the start".
+        // frame index, which is also our frame index. A keyframe of 0 (or an
+        // out-of-range value) just means "loop to the start".
         int apngKeyframe = extractApngKeyframe(path);
-        if (apngKeyframe > 0 && apngKeyframe < int(frameStartTicks.size())) {
-            out.loopPoint = frameStartTicks[apngKeyframe];
-            out.hasLoopPoint = out.loopPoint > 0;
+        if (apngKeyframe > 0 && apngKeyframe < out.frameCount) {
+            out.loopPoint = apngKeyframe;
+            out.hasLoopPoint = true;
         } else if (apngKeyframe > 0) {
             out.importWarnings.append(
                 QStringLiteral("Ignoring invalid APNG loop keyframe %1 (%2 frames).")
-                    .arg(apngKeyframe).arg(int(frameStartTicks.size())));
+                    .arg(apngKeyframe).arg(out.frameCount));
         }
 
         if (m_progressCallback) m_progressCallback(1.0f);
@@ -203,4 +218,74 @@ std::optional<AnimationData> ApngImporter::importFromFile(const QString& path) {
     catch (...) {
         return std::nullopt;
     }
-}
\ No newline at end of file
+}
+std::optional<AnimationInfo> ApngImporter::probe(const QString& path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return std::nullopt;
+
+    AnimationInfo info;
+    PngHandler handler;
+    handler.setDevice(&file);
+    if (!handler.readInfo(&info.size, &info.pixelFormat)) return std::nullopt;
+    file.close();
+
+    info.baseName = QFileInfo(path).completeBaseName();
+    info.animationType = AnimationType::Apng;
+
+    // Count frames the way apng_dis assembles them: a frame ends at the next fcTL
+    // once image data has been seen, or at IEND. A default image without its own
+    // fcTL is still a frame, with apng_dis' default delay of 1/10s.
+    struct Delay { unsigned int num; unsigned int den; };
+    std::vector<Delay> delays;
+    Delay pending = { 1, 10 };
+    bool animated = false;
+    bool hasImage = false;
+    int apngKeyframe = -1;
+    bool keyframeFound = false;
+
+    const bool isPng = walkChunks(path, { "acTL", "fcTL", "iTXt" }, [&](const QByteArray& type, const QByteArray& data) {
+        const unsigned char* u = reinterpret_cast<const unsigned char*>(data.constData());
+        if (type == "acTL" && !hasImage) {
+            animated = true;
+        } else if (type == "fcTL" && (!hasImage || animated)) {
+            if (data.size() < 26) return false;  // apng_dis stops on a bad fcTL too
+            if (hasImage) delays.push_back(pending);
+            pending.num = (unsigned(u[20]) << 8) | u[21];
+            pending.den = (unsigned(u[22]) << 8) | u[23];
+        } else if (type == "IDAT") {
+            hasImage = true;
+        } else if (type == "IEND") {
+            if (hasImage) delays.push_back(pending);
+        } else if (type == "iTXt" && !keyframeFound) {
+            keyframeFound = parseFsoKeyframeItxt(data, apngKeyframe);
+        }
+        return true;
+    });
+    if (!isPng || delays.empty()) return std::nullopt;
+
+    info.frameCount = int(delays.size());
+
+    // Same normalization as importFromFile()
+    bool uniform = true;
+    for (auto& d : delays) {
+        if (d.den == 0) d.den = 100;
+        if (d.num == 0) d.num = 1;
+        unsigned int g = std::gcd(d.num, d.den);
+        d.num /= g;
+        d.den /= g;
+        if (d.num != delays[0].num || d.den != delays[0].den)
+            uniform = false;
+    }
+    info.variableTiming = !(uniform && delays[0].num == 1);
+    info.fps = std::max(1, int(std::lround(double(delays[0].den) / delays[0].num)));
+
+    if (apngKeyframe > 0 && apngKeyframe < info.frameCount) {
+        info.loopPoint = apngKeyframe;
+    } else if (apngKeyframe > 0) {
+        info.warnings.append(
+            QStringLiteral("Ignoring invalid APNG loop keyframe %1 (%2 frames).")
+                .arg(apngKeyframe).arg(info.frameCount));
+    }
+
+    return info;
+}
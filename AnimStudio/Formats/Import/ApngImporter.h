@@ -7,6 +7,9 @@ class ApngImporter {
 public:
     std::optional<AnimationData> importFromFile(const QString& path);
 
+    // IHDR plus the acTL/fcTL/iTXt chunks, image data is skipped and nothing is decoded
+    std::optional<AnimationInfo> probe(const QString& path);
+
     // Call with values from 0.0 to 1.0 (progress %)
     void setProgressCallback(std::function<void(float)> cb);
 
@@ -15,48 +15,61 @@ void EffImporter::setProgressCallback(std::function<void(float)> cb) {
     m_progressCallback = std::move(cb);
 }
 
-std::optional<AnimationData> EffImporter::parseEff(const QString& effPath) {
-    QFile file(effPath);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
-        return std::nullopt;
+namespace {
+    // Reads the .eff fields into data and lists the frame files they name. False if the file
+    // can't be read or its frame type isn't supported.
+    bool readEffFields(const QString& effPath, AnimationData& data, QStringList& filePaths) {
+        QFile file(effPath);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+            return false;
 
-    if (m_progressCallback) m_progressCallback(0.0f);
+        QTextStream in(&file);
+        data.baseName = QFileInfo(effPath).completeBaseName();
 
-    QTextStream in(&file);
-    AnimationData data;
-    data.baseName = QFileInfo(effPath).completeBaseName();
-
-    QString type;
-
-    while (!in.atEnd()) {
-        const QString line = in.readLine().trimmed();
-        if (line.startsWith("$Type:", Qt::CaseInsensitive))
-            type = line.section(':', 1).trimmed();
-        else if (line.startsWith("$Frames:", Qt::CaseInsensitive))
-            data.frameCount = line.section(':', 1).trimmed().toInt();
-        else if (line.startsWith("$FPS:", Qt::CaseInsensitive))
-            data.fps = line.section(':', 1).trimmed().toInt();
-        else if (line.startsWith("$Keyframe:", Qt::CaseInsensitive))
-            data.keyframeIndices.append(line.section(':', 1).trimmed().toInt());
-    }
+        QString type;
 
-    if (!isSupportedFormat(type)) {
-        return std::nullopt; // unsupported type
-    } else {
-        data.type = formatFromExtension(type);
+        while (!in.atEnd()) {
+            const QString line = in.readLine().trimmed();
+            if (line.startsWith("$Type:", Qt::CaseInsensitive))
+                type = line.section(':', 1).trimmed();
+            else if (line.startsWith("$Frames:", Qt::CaseInsensitive))
+                data.frameCount = line.section(':', 1).trimmed().toInt();
+            else if (line.startsWith("$FPS:", Qt::CaseInsensitive))
+                data.fps = line.section(':', 1).trimmed().toInt();
+            else if (line.startsWith("$Keyframe:", Qt::CaseInsensitive))
+                data.keyframeIndices.append(line.section(':', 1).trimmed().toInt());
+        }
+
+        if (!isSupportedFormat(type)) {
+            return false; // unsupported type
+        } else {
+            data.type = formatFromExtension(type);
+        }
+
+        QDir dir = QFileInfo(effPath).absoluteDir();
+        QString suffix = extensionForFormat(data.type.value());
+
+        for (int i = 0; i < data.frameCount; ++i) {
+            QString frameName = QString("%1_%2%3").arg(data.baseName).arg(i, 4, 10, QChar('0')).arg(suffix);
+            QString fullPath = dir.filePath(frameName);
+            filePaths.append(fullPath);
+        }
+        return true;
     }
+}
 
-    QDir dir = QFileInfo(effPath).absoluteDir();
-    QString suffix = extensionForFormat(data.type.value());
-    
+std::optional<AnimationData> EffImporter::parseEff(const QString& effPath) {
+    AnimationData data;
     QStringList filePaths;
-    for (int i = 0; i < data.frameCount; ++i) {
-        QString frameName = QString("%1_%2%3").arg(data.baseName).arg(i, 4, 10, QChar('0')).arg(suffix);
-        QString fullPath = dir.filePath(frameName);
-        filePaths.append(fullPath);
-    }
+    if (!readEffFields(effPath, data, filePaths))
+        return std::nullopt;
+
+    if (m_progressCallback) m_progressCallback(0.0f);
 
     RawImporter importer;
+    importer.setKeepCompressed(m_keepCompressed);
+    importer.setWorkerCount(m_workerCount);
+    importer.setThreadPool(m_threadPool);
     data.frames = importer.loadImageSequence(filePaths, data.importWarnings, m_progressCallback);
 
     if (m_progressCallback) m_progressCallback(1.0f);
@@ -68,4 +81,43 @@ std::optional<AnimationData> EffImporter::parseEff(const QString& effPath) {
 
 std::optional<AnimationData> EffImporter::importFromFile(const QString& effPath) {
     return parseEff(effPath);
-}
\ No newline at end of file
+}
+std::optional<AnimationInfo> EffImporter::probe(const QString& effPath) {
+    AnimationData data;
+    QStringList filePaths;
+    if (!readEffFields(effPath, data, filePaths))
+        return std::nullopt;
+
+    AnimationInfo info;
+    info.baseName = data.baseName;
+    info.type = data.type;
+    info.animationType = AnimationType::Eff;
+    info.frameCount = data.frameCount;
+    info.fps = data.fps;
+    info.keyframeIndices = data.keyframeIndices;
+
+    // Only the first frame's header is read, the rest are assumed to match
+    if (filePaths.isEmpty()) {
+        info.warnings << "EFF lists no frames.";
+    } else if (const auto first = ImageLoader::probe(filePaths.first())) {
+        info.size = first->size;
+        info.pixelFormat = first->pixelFormat;
+    } else {
+        info.warnings << QString("Missing or unreadable frame: %1").arg(QFileInfo(filePaths.first()).fileName());
+    }
+    return info;
+}
+
+QStringList EffImporter::sourceFiles(const QString& effPath) {
+    AnimationData data;
+    QStringList filePaths;
+    if (!readEffFields(effPath, data, filePaths))
+        return {};
+
+    QStringList files{ effPath };
+    for (const QString& path : filePaths) {
+        if (QFileInfo(path).isFile())
+            files.append(path);
+    }
+    return files;
+}
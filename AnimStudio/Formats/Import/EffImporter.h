@@ -10,10 +10,28 @@ class EffImporter {
 public:
     std::optional<AnimationData> importFromFile(const QString& effPath);
 
+    // The .eff fields plus the first frame's image header, no frame is decoded
+    std::optional<AnimationInfo> probe(const QString& effPath);
+
+    // The .eff and the frame files it names that exist, in order. Empty if it can't be read.
+    QStringList sourceFiles(const QString& effPath);
+
     // Call with values from 0.0 to 1.0 (progress %)
     void setProgressCallback(std::function<void(float)> cb);
 
+    // Keep BC1/BC3/BC7 DDS frames block-compressed in memory, see FrameBuffer
+    void setKeepCompressed(bool keep) { m_keepCompressed = keep; }
+
+    // Frames decoded at once. 0 (the default) uses one worker per core
+    void setWorkerCount(int workers) { m_workerCount = workers; }
+
+    // Decode on this pool instead of a private one, see StagePool
+    void setThreadPool(QThreadPool* pool) { m_threadPool = pool; }
+
 private:
     std::function<void(float)> m_progressCallback;
+    bool m_keepCompressed = false;
+    int m_workerCount = 0;
+    QThreadPool* m_threadPool = nullptr;
     std::optional<AnimationData> parseEff(const QString& effPath);
 };
\ No newline at end of file
@@ -2,10 +2,14 @@
 #include "Animation/AnimationData.h"
 #include "Formats/ImageFormats.h"
 #include "Formats/ImageLoader.h"
+#include "Animation/StagePool.h"
 #include <QDir>
 #include <QImageReader>
+#include <QMutex>
 #include <QRegularExpression>
+#include <QtConcurrent>
 #include <algorithm>
+#include <numeric>
 
 void RawImporter::setProgressCallback(std::function<void(float)> cb) {
     m_progressCallback = std::move(cb);
@@ -13,7 +17,34 @@ void RawImporter::setProgressCallback(std::function<void(float)> cb) {
 
 QVector<AnimationFrame> RawImporter::loadImageSequence(const QStringList& filePaths, QStringList& warnings, std::function<void(float)> progressCallback)
 {
+    const int total = filePaths.size();
+    QVector<FrameBuffer> decoded(total);
+
+    StagePool pool(m_threadPool, m_workerCount > 0 ? m_workerCount : std::max(1, QThread::idealThreadCount()));
+
+    QMutex progressMutex;
+    int completed = 0;
+
+    QVector<int> indices(total);
+    std::iota(indices.begin(), indices.end(), 0);
+
+    QtConcurrent::blockingMap(pool.get(), indices, [&](int i) {
+        BcnImage compressed = m_keepCompressed ? ImageLoader::loadCompressed(filePaths[i]) : BcnImage();
+        if (!compressed.isNull()) {
+            decoded[i] = FrameBuffer(std::move(compressed));
+        } else {
+            decoded[i] = ImageLoader::load(filePaths[i]);
+        }
+
+        if (progressCallback) {
+            QMutexLocker lock(&progressMutex);
+            progressCallback(static_cast<float>(++completed) / total);
+        }
+    });
+
+    // Assemble frames and warnings in order so the output matches a serial decode
     QVector<AnimationFrame> result;
+    result.reserve(total);
     QSize refSize;
     bool refSizeSet = false;
 
@@ -22,10 +53,9 @@ QVector<AnimationFrame> RawImporter::loadImageSequence(const QStringList& filePa
     tinyBlank.fill(Qt::transparent);
     QVector<int> blankIndices;
 
-    for (int i = 0; i < filePaths.size(); ++i) {
-        const QString& path = filePaths[i];
-        QString fileName = QFileInfo(path).fileName();
-        QImage img = ImageLoader::load(path);
+    for (int i = 0; i < total; ++i) {
+        QString fileName = QFileInfo(filePaths[i]).fileName();
+        FrameBuffer& img = decoded[i];
         if (img.isNull()) {
             warnings.append(QString("Missing or unreadable frame: %1").arg(fileName));
             result.append(AnimationFrame{ tinyBlank, i, fileName });
@@ -43,11 +73,8 @@ QVector<AnimationFrame> RawImporter::loadImageSequence(const QStringList& filePa
                     .arg(refSize.width())
                     .arg(refSize.height());
             }
-            result.append(AnimationFrame{ img, i, fileName });
+            result.append(AnimationFrame{ std::move(img), i, fileName });
         }
-
-        if (progressCallback)
-            progressCallback(static_cast<float>(i + 1) / filePaths.size());
     }
 
     // Fix placeholder frames if refSize is known
@@ -62,15 +89,14 @@ QVector<AnimationFrame> RawImporter::loadImageSequence(const QStringList& filePa
     return result;
 }
 
-AnimationData RawImporter::importBlocking(const QString& dir) {
-    AnimationData data;
+bool RawImporter::collectFramePaths(const QString& dir, AnimationData& data, QStringList& filePaths) {
     QStringList filters = availableFilters();
     QDir directory(dir);
     QStringList files = directory.entryList(filters, QDir::Files, QDir::Name);
 
     if (files.isEmpty()) {
         data.importWarnings << "No files found in directory.";
-        return data;
+        return false;
     }
 
     if (m_progressCallback) m_progressCallback(0.0f);
@@ -133,15 +159,81 @@ AnimationData RawImporter::importBlocking(const QString& dir) {
         }
     }
 
-    QStringList filePaths;
     for (int i = 0; i <= maxIndex; ++i) {
         QString fullPath = directory.filePath(frameMap[i]);
         filePaths.append(fullPath);
     }
+    return true;
+}
+
+AnimationData RawImporter::importBlocking(const QString& dir) {
+    AnimationData data;
+    QStringList filePaths;
+    if (!collectFramePaths(dir, data, filePaths)) {
+        return data;
+    }
+
     data.frames = loadImageSequence(filePaths, data.importWarnings, m_progressCallback);
 
     if (m_progressCallback) { m_progressCallback(1); }
 
     data.frameCount = data.frames.size();
     return data;
+}
+
+AnimationInfo RawImporter::probe(const QString& dir) {
+    AnimationInfo info;
+    info.animationType = AnimationType::Raw;
+
+    AnimationData data;
+    QStringList filePaths;
+    const bool found = collectFramePaths(dir, data, filePaths);
+    info.warnings = data.importWarnings;
+    if (!found) {
+        return info;
+    }
+
+    info.baseName = data.baseName;
+    info.type = data.type;
+    info.fps = data.fps;
+    info.frameCount = filePaths.size();
+
+    // Every frame's header, with the same warnings a full load would give
+    bool refSizeSet = false;
+    for (int i = 0; i < filePaths.size(); ++i) {
+        const QString fileName = QFileInfo(filePaths[i]).fileName();
+        const auto image = ImageLoader::probe(filePaths[i]);
+        if (!image) {
+            info.warnings << QString("Missing or unreadable frame: %1").arg(fileName);
+        } else if (!refSizeSet) {
+            info.size = image->size;
+            info.pixelFormat = image->pixelFormat;
+            refSizeSet = true;
+        } else if (image->size != info.size) {
+            info.warnings << QString("Size mismatch at frame %1: %2 (%3x%4), expected %5x%6")
+                .arg(i)
+                .arg(fileName)
+                .arg(image->size.width())
+                .arg(image->size.height())
+                .arg(info.size.width())
+                .arg(info.size.height());
+        }
+    }
+    return info;
+}
+
+QStringList RawImporter::sourceFiles(const QString& dir) {
+    AnimationData data;
+    QStringList filePaths;
+    if (!collectFramePaths(dir, data, filePaths)) {
+        return {};
+    }
+
+    QStringList files;
+    for (const QString& path : filePaths) {
+        if (QFileInfo(path).isFile()) {
+            files.append(path);
+        }
+    }
+    return files;
 }
\ No newline at end of file
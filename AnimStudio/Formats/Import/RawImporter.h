@@ -11,9 +11,31 @@ public:
 
     AnimationData importBlocking(const QString& dir);
 
+    // Finds the sequence like importBlocking() and reads every frame's image header, nothing is decoded
+    AnimationInfo probe(const QString& dir);
+
+    // The sequence's frame files, in order. Empty if the directory has no images.
+    QStringList sourceFiles(const QString& dir);
+
     // Call with values from 0.0 to 1.0 (progress %)
     void setProgressCallback(std::function<void(float)> cb);
 
+    // Keep BC1/BC3/BC7 DDS frames block-compressed in memory, see FrameBuffer
+    void setKeepCompressed(bool keep) { m_keepCompressed = keep; }
+
+    // Frames decoded at once. 0 (the default) uses one worker per core
+    void setWorkerCount(int workers) { m_workerCount = workers; }
+
+    // Decode on this pool instead of a private one, see StagePool
+    void setThreadPool(QThreadPool* pool) { m_threadPool = pool; }
+
 private:
+    // Lists the sequence's frame files in order, missing indices as the directory itself.
+    // Fills in the name, type and warnings. False if the directory has no images.
+    bool collectFramePaths(const QString& dir, AnimationData& data, QStringList& filePaths);
+
     std::function<void(float)> m_progressCallback;
+    bool m_keepCompressed = false;
+    int m_workerCount = 0;
+    QThreadPool* m_threadPool = nullptr;
 };
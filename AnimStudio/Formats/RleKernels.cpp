@@ -0,0 +1,202 @@
+// RleKernels.cpp
+#include "RleKernels.h"
+#include <QtAlgorithms>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define RLE_KERNELS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// SSE2 is part of x64 and assumed for 32-bit builds that target it
+#if defined(RLE_KERNELS_X86) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define RLE_KERNELS_SSE2 1
+#endif
+
+// MSVC allows AVX2 intrinsics in any function, GCC and Clang need them enabled per function
+#if defined(RLE_KERNELS_X86)
+#if defined(__GNUC__) || defined(__clang__)
+#define RLE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define RLE_TARGET_AVX2
+#endif
+#define RLE_KERNELS_AVX2 1
+#endif
+
+namespace RleKernels {
+
+    // --- Plain C++ ---
+
+    static int runLengthScalar(const uchar* data, int length, int maxRun) {
+        const int limit = std::min(length, maxRun);
+        const uchar value = data[0];
+        int n = 1;
+        while (n < limit && data[n] == value) {
+            ++n;
+        }
+        return n;
+    }
+
+    static void substituteUnchangedScalar(const uchar* current, const uchar* previous, uchar* out, int length, uchar holdover) {
+        for (int x = 0; x < length; ++x) {
+            out[x] = (current[x] == previous[x]) ? holdover : current[x];
+        }
+    }
+
+    static void replaceValueScalar(const uchar* in, uchar* out, int length, uchar from, uchar to) {
+        for (int x = 0; x < length; ++x) {
+            out[x] = (in[x] == from) ? to : in[x];
+        }
+    }
+
+    // --- SSE2, 16 bytes at a time ---
+
+#ifdef RLE_KERNELS_SSE2
+    static int runLengthSse2(const uchar* data, int length, int maxRun) {
+        const int limit = std::min(length, maxRun);
+        const __m128i value = _mm_set1_epi8(static_cast<char>(data[0]));
+        int n = 0;
+        for (; n + 16 <= limit; n += 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + n));
+            quint32 differs = ~static_cast<quint32>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, value))) & 0xFFFFu;
+            if (differs) {
+                return n + static_cast<int>(qCountTrailingZeroBits(differs));
+            }
+        }
+        while (n < limit && data[n] == data[0]) {
+            ++n;
+        }
+        return n;
+    }
+
+    static void substituteUnchangedSse2(const uchar* current, const uchar* previous, uchar* out, int length, uchar holdover) {
+        const __m128i hold = _mm_set1_epi8(static_cast<char>(holdover));
+        int x = 0;
+        for (; x + 16 <= length; x += 16) {
+            __m128i cur = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current + x));
+            __m128i prev = _mm_loadu_si128(reinterpret_cast<const __m128i*>(previous + x));
+            __m128i same = _mm_cmpeq_epi8(cur, prev);
+            __m128i result = _mm_or_si128(_mm_and_si128(same, hold), _mm_andnot_si128(same, cur));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), result);
+        }
+        substituteUnchangedScalar(current + x, previous + x, out + x, length - x, holdover);
+    }
+
+    static void replaceValueSse2(const uchar* in, uchar* out, int length, uchar from, uchar to) {
+        const __m128i fromV = _mm_set1_epi8(static_cast<char>(from));
+        const __m128i toV = _mm_set1_epi8(static_cast<char>(to));
+        int x = 0;
+        for (; x + 16 <= length; x += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x));
+            __m128i hit = _mm_cmpeq_epi8(v, fromV);
+            __m128i result = _mm_or_si128(_mm_and_si128(hit, toV), _mm_andnot_si128(hit, v));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), result);
+        }
+        replaceValueScalar(in + x, out + x, length - x, from, to);
+    }
+#endif
+
+    // --- AVX2, 32 bytes at a time ---
+
+#ifdef RLE_KERNELS_AVX2
+    RLE_TARGET_AVX2 static int runLengthAvx2(const uchar* data, int length, int maxRun) {
+        const int limit = std::min(length, maxRun);
+        const __m256i value = _mm256_set1_epi8(static_cast<char>(data[0]));
+        int n = 0;
+        for (; n + 32 <= limit; n += 32) {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + n));
+            quint32 differs = ~static_cast<quint32>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, value)));
+            if (differs) {
+                return n + static_cast<int>(qCountTrailingZeroBits(differs));
+            }
+        }
+        while (n < limit && data[n] == data[0]) {
+            ++n;
+        }
+        return n;
+    }
+
+    RLE_TARGET_AVX2 static void substituteUnchangedAvx2(const uchar* current, const uchar* previous, uchar* out, int length, uchar holdover) {
+        const __m256i hold = _mm256_set1_epi8(static_cast<char>(holdover));
+        int x = 0;
+        for (; x + 32 <= length; x += 32) {
+            __m256i cur = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(current + x));
+            __m256i prev = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(previous + x));
+            __m256i same = _mm256_cmpeq_epi8(cur, prev);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), _mm256_blendv_epi8(cur, hold, same));
+        }
+        substituteUnchangedScalar(current + x, previous + x, out + x, length - x, holdover);
+    }
+
+    RLE_TARGET_AVX2 static void replaceValueAvx2(const uchar* in, uchar* out, int length, uchar from, uchar to) {
+        const __m256i fromV = _mm256_set1_epi8(static_cast<char>(from));
+        const __m256i toV = _mm256_set1_epi8(static_cast<char>(to));
+        int x = 0;
+        for (; x + 32 <= length; x += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + x));
+            __m256i hit = _mm256_cmpeq_epi8(v, fromV);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), _mm256_blendv_epi8(v, toV, hit));
+        }
+        replaceValueScalar(in + x, out + x, length - x, from, to);
+    }
+
+    // AVX2 needs both the instructions and an OS that saves the YMM registers
+    static bool cpuHasAvx2() {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+            return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+#endif
+
+    // --- Dispatch ---
+
+    QVector<KernelSet> availableKernels() {
+        QVector<KernelSet> sets{ { "scalar", runLengthScalar, substituteUnchangedScalar, replaceValueScalar } };
+#ifdef RLE_KERNELS_SSE2
+        sets.append({ "sse2", runLengthSse2, substituteUnchangedSse2, replaceValueSse2 });
+#endif
+#ifdef RLE_KERNELS_AVX2
+        if (cpuHasAvx2())
+            sets.append({ "avx2", runLengthAvx2, substituteUnchangedAvx2, replaceValueAvx2 });
+#endif
+        return sets;
+    }
+
+    // The fastest one there is
+    static KernelSet pickKernels() {
+        return availableKernels().last();
+    }
+
+    static const KernelSet& kernels() {
+        static const KernelSet set = pickKernels();
+        return set;
+    }
+
+    int runLength(const uchar* data, int length, int maxRun) {
+        return kernels().runLength(data, length, maxRun);
+    }
+
+    void substituteUnchanged(const uchar* current, const uchar* previous, uchar* out, int length, uchar holdover) {
+        kernels().substituteUnchanged(current, previous, out, length, holdover);
+    }
+
+    void replaceValue(const uchar* in, uchar* out, int length, uchar from, uchar to) {
+        kernels().replaceValue(in, out, length, from, to);
+    }
+
+} // namespace RleKernels
@@ -0,0 +1,35 @@
+// RleKernels.h
+#pragma once
+
+#include <QVector>
+#include <QtGlobal>
+
+// Byte-scanning helpers shared by the run-length encoders (ANI and PCX).
+// Each call picks an AVX2, SSE2 or plain C++ implementation once, based on what the
+// CPU supports. All of them produce exactly the same result.
+namespace RleKernels {
+
+    // Number of bytes equal to data[0] at the start of data, at most min(length, maxRun).
+    // length and maxRun must both be at least 1.
+    int runLength(const uchar* data, int length, int maxRun);
+
+    // out[x] = (current[x] == previous[x]) ? holdover : current[x]
+    // Used for ANI delta frames, where unchanged pixels become the holdover index.
+    void substituteUnchanged(const uchar* current, const uchar* previous, uchar* out, int length, uchar holdover);
+
+    // out[x] = (in[x] == from) ? to : in[x]
+    void replaceValue(const uchar* in, uchar* out, int length, uchar from, uchar to);
+
+    // One implementation of the three kernels above
+    struct KernelSet {
+        const char* name;
+        int (*runLength)(const uchar*, int, int);
+        void (*substituteUnchanged)(const uchar*, const uchar*, uchar*, int, uchar);
+        void (*replaceValue)(const uchar*, uchar*, int, uchar, uchar);
+    };
+
+    // Every implementation this CPU can run, plain C++ first, so they can be checked and timed
+    // against each other (Tests/RleEncoderTest, Bench/RleBench)
+    QVector<KernelSet> availableKernels();
+
+} // namespace RleKernels
@@ -0,0 +1,122 @@
+#include "Formats/BcnDecoder.h"
+#include "compressonator.h"
+
+#include <QRandomGenerator>
+#include <QTest>
+#include <cstring>
+
+// BcnDecoder against CMP_ConvertMipTexture, which decoded every DDS frame before BcnDecoder did
+class BcnDecoderTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void matchesCompressonator_data();
+    void matchesCompressonator();
+    void reservedBc7IsTransparentBlack();
+
+private:
+    static constexpr int WIDTH = 256;
+    static constexpr int HEIGHT = 64;
+
+    static QByteArray decodeWithCompressonator(CMP_FORMAT format, const QByteArray& blocks, int width, int height);
+};
+
+QByteArray BcnDecoderTest::decodeWithCompressonator(CMP_FORMAT format, const QByteArray& blocks, int width, int height) {
+    // The same conversion DdsHandler::readWithCompressonator() does after loading the file
+    CMP_MipSet in = {};
+    if (CMP_CreateMipSet(&in, width, height, 1, CF_Compressed, TT_2D) != CMP_OK) {
+        return {};
+    }
+    in.m_format = format;
+    CMP_MipLevel* inLevel = nullptr;
+    CMP_GetMipLevel(&inLevel, &in, 0, 0);
+    memcpy(inLevel->m_pbData, blocks.constData(), size_t(blocks.size()));
+
+    CMP_MipSet out = {};
+    if (CMP_CreateMipSet(&out, width, height, 1, CF_8bit, TT_2D) != CMP_OK) {
+        CMP_FreeMipSet(&in);
+        return {};
+    }
+    out.m_format = CMP_FORMAT_RGBA_8888;
+
+    CMP_CompressOptions options = {};
+    options.dwSize = sizeof(CMP_CompressOptions);
+    options.SourceFormat = in.m_format;
+    options.DestFormat = out.m_format;
+
+    QByteArray pixels;
+    if (CMP_ConvertMipTexture(&in, &out, &options, nullptr) == CMP_OK) {
+        CMP_MipLevel* outLevel = nullptr;
+        CMP_GetMipLevel(&outLevel, &out, 0, 0);
+        pixels = QByteArray(reinterpret_cast<const char*>(outLevel->m_pbData), width * height * 4);
+    }
+    CMP_FreeMipSet(&in);
+    CMP_FreeMipSet(&out);
+    return pixels;
+}
+
+void BcnDecoderTest::matchesCompressonator_data() {
+    QTest::addColumn<int>("formatIndex");
+    QTest::addColumn<int>("cmpFormat");
+
+    QTest::newRow("bc1") << int(CompressionFormat::BC1) << int(CMP_FORMAT_BC1);
+    QTest::newRow("bc3") << int(CompressionFormat::BC3) << int(CMP_FORMAT_BC3);
+    QTest::newRow("bc7") << int(CompressionFormat::BC7) << int(CMP_FORMAT_BC7);
+}
+
+// Random blocks cover both BC1 colour modes and every BC7 mode, partition and rotation
+void BcnDecoderTest::matchesCompressonator() {
+    QFETCH(int, formatIndex);
+    QFETCH(int, cmpFormat);
+    const CompressionFormat format = CompressionFormat(formatIndex);
+
+    const int blockBytes = BcnDecoder::blockBytes(format);
+    QByteArray blocks(BcnDecoder::surfaceBytes(format, WIDTH, HEIGHT), Qt::Uninitialized);
+    QRandomGenerator random(17);
+    for (char& byte : blocks) {
+        byte = char(random.bounded(256));
+    }
+    if (format == CompressionFormat::BC7) {
+        // Compressonator writes nothing for the reserved mode, see reservedBc7IsTransparentBlack()
+        for (qsizetype i = 0; i < blocks.size(); i += blockBytes) {
+            if (blocks[i] == 0) {
+                blocks[i] = char(0x40);
+            }
+        }
+    }
+
+    const QImage decoded = BcnDecoder::decode(format, blocks, WIDTH, HEIGHT);
+    QCOMPARE(decoded.format(), QImage::Format_RGBA8888);
+    const QByteArray expected = decodeWithCompressonator(CMP_FORMAT(cmpFormat), blocks, WIDTH, HEIGHT);
+    QVERIFY(!expected.isEmpty());
+
+    const int blocksPerRow = WIDTH / 4;
+    for (int by = 0; by < HEIGHT / 4; ++by) {
+        for (int bx = 0; bx < blocksPerRow; ++bx) {
+            for (int y = by * 4; y < by * 4 + 4; ++y) {
+                const QByteArray ours(reinterpret_cast<const char*>(decoded.constScanLine(y)) + bx * 16, 16);
+                const QByteArray theirs = expected.mid(qsizetype(y) * WIDTH * 4 + bx * 16, 16);
+                if (ours != theirs) {
+                    const QByteArray block = blocks.mid(qsizetype(by * blocksPerRow + bx) * blockBytes, blockBytes);
+                    QFAIL(qPrintable(QString("Block %1 (%2) row %3: %4, Compressonator %5")
+                        .arg(by * blocksPerRow + bx).arg(QString::fromLatin1(block.toHex()))
+                        .arg(y % 4).arg(QString::fromLatin1(ours.toHex()), QString::fromLatin1(theirs.toHex()))));
+                }
+            }
+        }
+    }
+}
+
+// Compressonator returns without writing the block, D3D defines it as transparent black
+void BcnDecoderTest::reservedBc7IsTransparentBlack() {
+    QByteArray reserved(16, char(0x5A));
+    reserved[0] = 0;
+
+    const QImage decoded = BcnDecoder::decode(CompressionFormat::BC7, reserved, 4, 4);
+    for (int y = 0; y < 4; ++y) {
+        QCOMPARE(QByteArray(reinterpret_cast<const char*>(decoded.constScanLine(y)), 16), QByteArray(16, 0));
+    }
+}
+
+QTEST_GUILESS_MAIN(BcnDecoderTest)
+#include "BcnDecoderTest.moc"
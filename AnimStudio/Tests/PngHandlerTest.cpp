@@ -0,0 +1,183 @@
+#include "Animation/AnimationData.h"
+#include "Formats/Custom Handlers/PngHandler.h"
+#include "png.h"
+
+#include <QRandomGenerator>
+#include <QTest>
+#include <vector>
+
+// PngHandler (libpng) against QImage, which decoded every PNG frame before PngHandler did.
+// The test images are written with libpng here, since Qt can't write gray+alpha or
+// interlaced PNGs.
+class PngHandlerTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void matchesQImage_data();
+    void matchesQImage();
+
+private:
+    static constexpr int WIDTH = 37;    // Odd sizes leave every Adam7 pass partly filled
+    static constexpr int HEIGHT = 11;
+};
+
+namespace {
+    struct PngLayout {
+        int colorType;
+        int bitDepth;
+        bool interlaced;
+        bool transparency;  // tRNS chunk: palette alpha, or the first pixel's color as key
+    };
+
+    void appendToBuffer(png_structp png, png_bytep data, size_t length) {
+        std::vector<uchar>* out = static_cast<std::vector<uchar>*>(png_get_io_ptr(png));
+        out->insert(out->end(), data, data + length);
+    }
+
+    // The setjmp lives in its own function with nothing but trivial locals, like PngHandler's
+    bool writeRows(png_structp png, png_infop info, png_bytepp rows) {
+        if (setjmp(png_jmpbuf(png))) {
+            return false;
+        }
+
+        png_write_info(png, info);
+        png_write_image(png, rows);
+        png_write_end(png, nullptr);
+        return true;
+    }
+
+    // Random pixels in the given layout. Palettes have every entry the bit depth can address,
+    // so any index is valid.
+    QByteArray encodePng(const PngLayout& layout, int width, int height, quint32 seed) {
+        QRandomGenerator random(seed);
+        const int channels = layout.colorType == PNG_COLOR_TYPE_PALETTE ? 1
+            : layout.colorType == PNG_COLOR_TYPE_GRAY ? 1
+            : layout.colorType == PNG_COLOR_TYPE_GRAY_ALPHA ? 2
+            : layout.colorType == PNG_COLOR_TYPE_RGB ? 3 : 4;
+        const size_t rowBytes = (size_t(width) * channels * layout.bitDepth + 7) / 8;
+
+        std::vector<uchar> pixels(rowBytes * height);
+        for (uchar& byte : pixels) {
+            byte = uchar(random.bounded(256));
+        }
+        std::vector<png_bytep> rows(height);
+        for (int y = 0; y < height; ++y) {
+            rows[y] = pixels.data() + rowBytes * y;
+        }
+
+        png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+        png_infop info = png_create_info_struct(png);
+        std::vector<uchar> out;
+        png_set_write_fn(png, &out, appendToBuffer, nullptr);
+        png_set_IHDR(png, info, png_uint_32(width), png_uint_32(height), layout.bitDepth, layout.colorType,
+            layout.interlaced ? PNG_INTERLACE_ADAM7 : PNG_INTERLACE_NONE,
+            PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+
+        std::vector<png_color> palette(size_t(1) << layout.bitDepth);
+        std::vector<png_byte> paletteAlpha(palette.size());
+        if (layout.colorType == PNG_COLOR_TYPE_PALETTE) {
+            for (size_t i = 0; i < palette.size(); ++i) {
+                palette[i] = { png_byte(random.bounded(256)), png_byte(random.bounded(256)), png_byte(random.bounded(256)) };
+                paletteAlpha[i] = png_byte(random.bounded(256));
+            }
+            png_set_PLTE(png, info, palette.data(), int(palette.size()));
+            if (layout.transparency) {
+                png_set_tRNS(png, info, paletteAlpha.data(), int(paletteAlpha.size() / 2), nullptr);
+            }
+        } else if (layout.transparency) {
+            // The first pixel's color, so at least one pixel turns transparent
+            const uchar* first = pixels.data();
+            png_color_16 key = {};
+            if (layout.bitDepth == 16) {
+                key.gray = key.red = png_uint_16(first[0] << 8 | first[1]);
+                key.green = png_uint_16(first[2] << 8 | first[3]);
+                key.blue = png_uint_16(first[4] << 8 | first[5]);
+            } else if (layout.bitDepth < 8) {
+                key.gray = png_uint_16(first[0] >> (8 - layout.bitDepth));
+            } else {
+                key.gray = key.red = first[0];
+                key.green = first[1];
+                key.blue = first[2];
+            }
+            png_set_tRNS(png, info, nullptr, 0, &key);
+        }
+
+        const bool ok = writeRows(png, info, rows.data());
+        png_destroy_write_struct(&png, &info);
+        return ok ? QByteArray(reinterpret_cast<const char*>(out.data()), qsizetype(out.size())) : QByteArray();
+    }
+}
+
+void PngHandlerTest::matchesQImage_data() {
+    QTest::addColumn<int>("colorType");
+    QTest::addColumn<int>("bitDepth");
+    QTest::addColumn<bool>("interlaced");
+    QTest::addColumn<bool>("transparency");
+
+    QTest::newRow("palette1") << int(PNG_COLOR_TYPE_PALETTE) << 1 << false << false;
+    QTest::newRow("palette4 tRNS") << int(PNG_COLOR_TYPE_PALETTE) << 4 << false << true;
+    QTest::newRow("palette8") << int(PNG_COLOR_TYPE_PALETTE) << 8 << false << false;
+    QTest::newRow("palette8 tRNS") << int(PNG_COLOR_TYPE_PALETTE) << 8 << false << true;
+    QTest::newRow("gray2") << int(PNG_COLOR_TYPE_GRAY) << 2 << false << false;
+    QTest::newRow("gray2 tRNS") << int(PNG_COLOR_TYPE_GRAY) << 2 << false << true;
+    QTest::newRow("gray8") << int(PNG_COLOR_TYPE_GRAY) << 8 << false << false;
+    QTest::newRow("gray8 tRNS") << int(PNG_COLOR_TYPE_GRAY) << 8 << false << true;
+    QTest::newRow("gray16") << int(PNG_COLOR_TYPE_GRAY) << 16 << false << false;
+    QTest::newRow("gray16 tRNS") << int(PNG_COLOR_TYPE_GRAY) << 16 << false << true;
+    QTest::newRow("gray+alpha8") << int(PNG_COLOR_TYPE_GRAY_ALPHA) << 8 << false << false;
+    QTest::newRow("gray+alpha16") << int(PNG_COLOR_TYPE_GRAY_ALPHA) << 16 << false << false;
+    QTest::newRow("rgb8") << int(PNG_COLOR_TYPE_RGB) << 8 << false << false;
+    QTest::newRow("rgb8 tRNS") << int(PNG_COLOR_TYPE_RGB) << 8 << false << true;
+    QTest::newRow("rgb16") << int(PNG_COLOR_TYPE_RGB) << 16 << false << false;
+    // No "rgb16 tRNS": QImage reads those as RGBA64 without adding the alpha channel, so every
+    // pixel after the first comes out shifted. PngHandler gets them right.
+    QTest::newRow("rgba8") << int(PNG_COLOR_TYPE_RGB_ALPHA) << 8 << false << false;
+    QTest::newRow("rgba16") << int(PNG_COLOR_TYPE_RGB_ALPHA) << 16 << false << false;
+    QTest::newRow("palette8 interlaced") << int(PNG_COLOR_TYPE_PALETTE) << 8 << true << true;
+    QTest::newRow("gray+alpha8 interlaced") << int(PNG_COLOR_TYPE_GRAY_ALPHA) << 8 << true << false;
+    QTest::newRow("gray16 interlaced") << int(PNG_COLOR_TYPE_GRAY) << 16 << true << false;
+    QTest::newRow("rgba8 interlaced") << int(PNG_COLOR_TYPE_RGB_ALPHA) << 8 << true << false;
+    QTest::newRow("rgba16 interlaced") << int(PNG_COLOR_TYPE_RGB_ALPHA) << 16 << true << false;
+}
+
+// Both decodes converted to the frame storage format, as ImageLoader's callers do
+void PngHandlerTest::matchesQImage() {
+    QFETCH(int, colorType);
+    QFETCH(int, bitDepth);
+    QFETCH(bool, interlaced);
+    QFETCH(bool, transparency);
+
+    const QByteArray file = encodePng({ colorType, bitDepth, interlaced, transparency }, WIDTH, HEIGHT, 17);
+    QVERIFY(!file.isEmpty());
+
+    PngHandler handler;
+    QImage decoded;
+    QVERIFY(handler.read(reinterpret_cast<const uchar*>(file.constData()), file.size(), &decoded));
+    const QImage expected = QImage::fromData(file, "PNG");
+    QVERIFY(!expected.isNull());
+
+    // Palette images and keyed gray stay indexed, see PngHandler.h
+    const bool indexed = colorType == PNG_COLOR_TYPE_PALETTE
+        || (colorType == PNG_COLOR_TYPE_GRAY && bitDepth <= 8 && transparency);
+    QCOMPARE(decoded.format() == QImage::Format_Indexed8, indexed);
+
+    const QImage ours = decoded.convertToFormat(FRAME_STORAGE_FORMAT);
+    const QImage theirs = expected.convertToFormat(FRAME_STORAGE_FORMAT);
+    QCOMPARE(ours.size(), theirs.size());
+    for (int y = 0; y < HEIGHT; ++y) {
+        const QByteArray ourRow(reinterpret_cast<const char*>(ours.constScanLine(y)), WIDTH * 4);
+        const QByteArray theirRow(reinterpret_cast<const char*>(theirs.constScanLine(y)), WIDTH * 4);
+        if (ourRow != theirRow) {
+            QFAIL(qPrintable(QString("Row %1: %2, QImage %3").arg(y)
+                .arg(QString::fromLatin1(ourRow.toHex()), QString::fromLatin1(theirRow.toHex()))));
+        }
+    }
+
+    // A second read through the same handler reuses the blocks kept from the first
+    QImage again;
+    QVERIFY(handler.read(reinterpret_cast<const uchar*>(file.constData()), file.size(), &again));
+    QCOMPARE(again.convertToFormat(FRAME_STORAGE_FORMAT), ours);
+}
+
+QTEST_GUILESS_MAIN(PngHandlerTest)
+#include "PngHandlerTest.moc"
@@ -0,0 +1,196 @@
+#include "Formats/Custom Handlers/PcxHandler.h"
+#include "Formats/Export/AniExporter.h"
+#include "Formats/RleKernels.h"
+
+#include <QBuffer>
+#include <QTest>
+#include <cstring>
+#include <random>
+
+// The ANI and PCX run-length encoders against the byte-at-a-time loops they had before
+// RleKernels, and every kernel implementation the CPU has against the plain C++ one
+class RleEncoderTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void kernelsMatchScalar();
+    void aniMatchesBaseline();
+    void pcxMatchesBaseline();
+
+private:
+    static QVector<QByteArray> scanlines();
+};
+
+namespace {
+    constexpr uchar PACKER_CODE = 0xEE;
+
+    // compressScanlineHoffossRLE() as it was before RleKernels
+    QByteArray baselineAniScanline(const uchar* scanline, int width) {
+        QByteArray compressedData;
+        int x = 0;
+        while (x < width) {
+            uchar currentPixel = scanline[x];
+            int runLength = 1;
+            while (x + runLength < width
+                && scanline[x + runLength] == currentPixel
+                && runLength < 255) {
+                runLength++;
+            }
+
+            if (runLength > 2) {
+                compressedData.append(static_cast<char>(PACKER_CODE));
+                compressedData.append(static_cast<char>(runLength - 1));
+                compressedData.append(static_cast<char>(currentPixel));
+            } else {
+                for (int i = 0; i < runLength; i++) {
+                    if (currentPixel == PACKER_CODE) {
+                        compressedData.append(static_cast<char>(PACKER_CODE));
+                        compressedData.append(static_cast<char>(0));
+                    } else {
+                        compressedData.append(static_cast<char>(currentPixel));
+                    }
+                }
+            }
+            x += runLength;
+        }
+        return compressedData;
+    }
+
+    // PcxHandler's writeRleLine() as it was before RleKernels
+    void baselinePcxLine(QByteArray& out, const uchar* data, int length) {
+        int i = 0;
+        while (i < length) {
+            uchar val = data[i];
+            int count = 1;
+            while (i + count < length && data[i + count] == val && count < 63) {
+                ++count;
+            }
+
+            if (count > 1 || (val & 0xC0) == 0xC0) {
+                out.append(static_cast<char>(0xC0 | count));
+            }
+            out.append(static_cast<char>(val));
+            i += count;
+        }
+    }
+}
+
+// Noise, short runs, runs either side of the PCX (63) and ANI (255) caps, packer codes and
+// PCX escape values as literals and in runs, and a single value, over widths that end inside
+// and on the edge of a 16 or 32 byte block
+QVector<QByteArray> RleEncoderTest::scanlines() {
+    std::mt19937 rng(1234);
+    QVector<int> widths;
+    for (int w = 1; w <= 70; ++w) {
+        widths.append(w);
+    }
+    widths << 127 << 128 << 129 << 254 << 255 << 256 << 257 << 511 << 1023 << 1024 << 1025;
+
+    const uchar special[] = { 0x00, PACKER_CODE, 0xFE, 0xC0, 0xFF, 0x07 };
+    QVector<QByteArray> rows;
+    for (int width : widths) {
+        for (int pattern = 0; pattern < 6; ++pattern) {
+            QByteArray row(width, '\0');
+            int x = 0;
+            while (x < width) {
+                int run = 1;
+                uchar value = uchar(rng() & 0xFF);
+                switch (pattern) {
+                case 0: break;
+                case 1: run = int(rng() % 80) + 1; value = special[rng() % 6]; break;
+                case 2: run = width; value = 0xFE; break;
+                case 3: run = 62 + int(rng() % 3); value = special[x % 6]; break;
+                case 4: run = 254 + int(rng() % 3); value = special[x % 6]; break;
+                case 5: run = int(rng() % 3) + 1; value = special[rng() % 6]; break;
+                }
+                for (int i = 0; i < run && x < width; ++i) {
+                    row[x++] = char(value);
+                }
+            }
+            rows.append(row);
+        }
+    }
+    return rows;
+}
+
+void RleEncoderTest::kernelsMatchScalar() {
+    const QVector<RleKernels::KernelSet> sets = RleKernels::availableKernels();
+    const RleKernels::KernelSet& reference = sets.first();
+    const QVector<QByteArray> rows = scanlines();
+
+    for (const RleKernels::KernelSet& set : sets) {
+        for (const QByteArray& row : rows) {
+            const int width = int(row.size());
+            QByteArray previous = row;
+            for (int i = 0; i < width; i += 3) {
+                previous[i] = char(previous[i] + 1);
+            }
+            const uchar* in = reinterpret_cast<const uchar*>(row.constData());
+            const uchar* prev = reinterpret_cast<const uchar*>(previous.constData());
+
+            for (int x = 0; x < width; ++x) {
+                for (int maxRun : { 1, 63, 64, 255, width }) {
+                    if (set.runLength(in + x, width - x, maxRun) != reference.runLength(in + x, width - x, maxRun)) {
+                        QFAIL(qPrintable(QString("%1 runLength: width %2, x %3, maxRun %4")
+                            .arg(set.name).arg(width).arg(x).arg(maxRun)));
+                    }
+                }
+            }
+
+            QByteArray expected(width, '\0');
+            QByteArray actual(width, '\0');
+            reference.substituteUnchanged(in, prev, reinterpret_cast<uchar*>(expected.data()), width, 0xFE);
+            set.substituteUnchanged(in, prev, reinterpret_cast<uchar*>(actual.data()), width, 0xFE);
+            QVERIFY2(expected == actual, qPrintable(QString("%1 substituteUnchanged: width %2").arg(set.name).arg(width)));
+            reference.replaceValue(in, reinterpret_cast<uchar*>(expected.data()), width, 0xFE, 0x00);
+            set.replaceValue(in, reinterpret_cast<uchar*>(actual.data()), width, 0xFE, 0x00);
+            QVERIFY2(expected == actual, qPrintable(QString("%1 replaceValue: width %2").arg(set.name).arg(width)));
+        }
+    }
+}
+
+void RleEncoderTest::aniMatchesBaseline() {
+    for (const QByteArray& row : scanlines()) {
+        const int width = int(row.size());
+        const uchar* in = reinterpret_cast<const uchar*>(row.constData());
+
+        QByteArray encoded(2 * width, Qt::Uninitialized);
+        encoded.resize(compressScanlineHoffossRLE(in, width, reinterpret_cast<uchar*>(encoded.data())));
+        QVERIFY2(encoded == baselineAniScanline(in, width), qPrintable(QString::fromLatin1(row.toHex())));
+    }
+}
+
+// Every scanline as a one-row image through PcxHandler::write(). The pixel data sits between
+// the 128 byte header and the 0x0C marker plus 768 byte palette.
+void RleEncoderTest::pcxMatchesBaseline() {
+    QVector<QRgb> palette;
+    for (int i = 0; i < 256; ++i) {
+        palette.append(qRgb(i, i, i));
+    }
+
+    for (const QByteArray& row : scanlines()) {
+        const int width = int(row.size());
+        QImage image(width, 1, QImage::Format_Indexed8);
+        image.setColorTable(palette);
+        memcpy(image.scanLine(0), row.constData(), size_t(width));
+
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+        PcxHandler handler;
+        handler.setDevice(&buffer);
+        QVERIFY(handler.write(image));
+        const QByteArray file = buffer.data();
+        QVERIFY(file.size() > 128 + 769);
+
+        QByteArray expected;
+        baselinePcxLine(expected, reinterpret_cast<const uchar*>(row.constData()), width);
+        if (width % 2) {
+            const uchar pad = 0;
+            baselinePcxLine(expected, &pad, 1);
+        }
+        QVERIFY2(file.mid(128, file.size() - 128 - 769) == expected, qPrintable(QString::fromLatin1(row.toHex())));
+    }
+}
+
+QTEST_GUILESS_MAIN(RleEncoderTest)
+#include "RleEncoderTest.moc"
@@ -306,7 +306,6 @@ void AnimStudio::updateFrameTimeDisplay() {
     // zero based
     int idx = ui.timelineSlider->value() ;
     int total = animCtrl->getFrameCount() ;
-    int fps = animCtrl->getFPS();
 
     //  Frame X/Y 
     ui.currentFrameView->setText(
@@ -314,7 +313,7 @@ void AnimStudio::updateFrameTimeDisplay() {
     );
 
     //  Timecode mm:ss.mmm 
-    double seconds = idx / double(fps);
+    double seconds = animCtrl->getFrameTime(idx);
     int wholeSec = int(seconds);
     int mins = wholeSec / 60;
     int secs = wholeSec % 60;
@@ -333,6 +332,11 @@ void AnimStudio::on_actionExit_triggered()
     close();
 }
 
+void AnimStudio::on_actionKeep_DDS_Frames_Compressed_toggled(bool checked)
+{
+    animCtrl->setKeepFramesCompressed(checked);
+}
+
 void AnimStudio::on_actionAbout_triggered() {
     // Build the about text
     QString aboutText = QString(
@@ -433,7 +437,7 @@ void AnimStudio::on_actionExport_Animation_triggered()
     toggleToolebarControls();
 
     // Dispatch
-    animCtrl->exportAnimation(outDir, dlg.selectedAnimationType(), dlg.selectedImageFormat(), dlg.selectedCompressionFormat(), dlg.chosenBaseName());
+    animCtrl->exportAnimation(outDir, dlg.selectedAnimationType(), dlg.selectedImageFormat(), dlg.selectedCompressionFormat(), dlg.chosenBaseName(), dlg.selectedApngPreset());
 
 }
 
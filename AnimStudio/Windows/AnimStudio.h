@@ -38,6 +38,7 @@ protected:
 private slots:
     // Menu Handlers
     void on_actionExit_triggered();
+    void on_actionKeep_DDS_Frames_Compressed_toggled(bool checked);
     void on_actionAbout_triggered();
 
     // Toolbar Handlers
@@ -21,6 +21,11 @@ ExportAnimationDialog::ExportAnimationDialog(const QString& defaultBaseName, QWi
     ui->compressionComboBox->addItems(availableCompressionFormats());
     ui->compressionComboBox->setEnabled(false);  // Hidden unless EFF/DDS is selected
 
+    // Populate apng preset choices (used only for APNG)
+    ui->apngPresetComboBox->addItems(availableApngPresets());
+    ui->apngPresetComboBox->setCurrentText(apngPresetDescriptions.at(ApngPreset::Balanced));
+    ui->apngPresetComboBox->setEnabled(ui->typeComboBox->currentText().toLower() == "apng");
+
     // Set base name
     ui->nameLineEdit->setText(defaultBaseName);
 
@@ -47,6 +52,7 @@ void ExportAnimationDialog::onTypeChanged(int index)
     const QString format = ui->formatComboBox->currentText().toLower();
     ui->formatComboBox->setEnabled(type == "eff");
     ui->compressionComboBox->setEnabled(type == "eff" && format == "dds");
+    ui->apngPresetComboBox->setEnabled(type == "apng");
 
     // APNG now carries the loop keyframe as an FSO.Keyframe iTXt chunk, so no
     // keyframe warning is needed for any format.
@@ -82,6 +88,11 @@ CompressionFormat ExportAnimationDialog::selectedCompressionFormat() const
     return getCompressionFormatFromDescription(selectedText);
 }
 
+ApngPreset ExportAnimationDialog::selectedApngPreset() const
+{
+    return getApngPresetFromDescription(ui->apngPresetComboBox->currentText());
+}
+
 QString ExportAnimationDialog::chosenBaseName() const
 {
     return ui->nameLineEdit->text().trimmed();
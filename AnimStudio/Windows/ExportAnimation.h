@@ -16,6 +16,7 @@ public:
     AnimationType selectedAnimationType() const;
     ImageFormat selectedImageFormat() const;
     CompressionFormat selectedCompressionFormat() const;
+    ApngPreset selectedApngPreset() const;
     QString chosenBaseName() const;
 
 private slots: